@@ -63,6 +63,9 @@
  * does not really use the table in a meaningful way. Also, this is a
  * demonstration of custom allocators, not a thought-through malloc
  * implementation. I'm actually not even sure it really works ;-)
+ *
+ * For entries of any size, ght_set_pool() enables a built-in allocator
+ * which works the same way.
  */
 
 /* A structure for the returned data from malloc */
@@ -0,0 +1,186 @@
+/*********************************************************************
+ *
+ * Copyright (C) 2001-2005,  Simon Kagstrom
+ *
+ * Filename:      arena_example.c
+ * Description:   A program that demonstrates the use of an allocator
+ *                with a context pointer, one arena per table.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ ********************************************************************/
+
+#include <stdlib.h>    /* malloc */
+#include <string.h>    /* strtok */
+#include <stdio.h>     /* printf */
+
+#include "ght_hash_table.h"
+
+/* Delimiters between words */
+#define DELIMS " \t\".,;:?!-\'/*()=+&%[]#$\n\r"
+
+#define ARENA_SIZE 65536
+
+/*
+ * Every line is handled like a request in a server: The words of the
+ * line are counted in a table of its own, and the most common word is
+ * printed. The entries of the table are allocated from an arena which
+ * only moves a pointer forward, and the whole arena is reset in one
+ * go when the table is finalized.
+ *
+ * The arena is passed to the allocation functions as their context
+ * pointer, so several tables (in different threads, for example) can
+ * each have their own arena without any global state.
+ */
+typedef struct
+{
+  char *p_mem;
+  size_t i_used;
+  size_t i_size;
+} arena_t;
+
+static void *arena_alloc(void *p_ctx, size_t size)
+{
+  arena_t *p_arena = (arena_t*)p_ctx;
+  void *p_ret;
+
+  /* Keep the allocations aligned for pointers */
+  size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+  if (p_arena->i_used + size > p_arena->i_size)
+    {
+      return NULL;
+    }
+  p_ret = p_arena->p_mem + p_arena->i_used;
+  p_arena->i_used += size;
+
+  return p_ret;
+}
+
+/* Single entries are never freed, the memory is reused after the reset */
+static void arena_free(void *p_ctx, void *ptr, size_t size)
+{
+  (void)p_ctx;
+  (void)ptr;
+  (void)size;
+}
+
+static void arena_reset(void *p_ctx)
+{
+  ((arena_t*)p_ctx)->i_used = 0;
+}
+
+static const ght_allocator_t arena_allocator =
+{
+  arena_alloc,
+  arena_free,
+  arena_reset,
+};
+
+/* Count the words of one line and print the most common one */
+static int handle_line(arena_t *p_arena, char *p_line)
+{
+  ght_hash_table_t *p_table;
+  ght_iterator_t iterator;
+  const void *p_key;
+  unsigned int i_key_size;
+  const void *p_best = NULL;
+  unsigned int i_best_size = 0;
+  unsigned int i_best = 0;
+  unsigned int i_words = 0;
+  unsigned int *p_count;
+  unsigned int *p_new = NULL;
+  char *p_word;
+
+  if ( !(p_table = ght_create(64)) )
+    {
+      return -1;
+    }
+  ght_set_rehash(p_table, TRUE);
+  ght_set_allocator(p_table, &arena_allocator, p_arena);
+
+  for (p_word = strtok(p_line, DELIMS); p_word; p_word = strtok(NULL, DELIMS))
+    {
+      /* The counts are in the arena as well. A new count is only
+       * used if the word is new, otherwise it is kept for the next. */
+      if ( (!p_new && !(p_new = (unsigned int*)arena_alloc(p_arena, sizeof(unsigned int)))) ||
+	   !(p_count = (unsigned int*)ght_get_or_insert(p_table, p_new, strlen(p_word), p_word)) )
+	{
+	  fprintf(stderr, "The arena is full\n");
+	  break;
+	}
+      if (p_count == p_new)
+	{
+	  *p_count = 0;
+	  p_new = NULL;
+	}
+      (*p_count)++;
+      i_words++;
+    }
+
+  for (p_count = (unsigned int*)ght_first_keysize(p_table, &iterator, &p_key, &i_key_size); p_count;
+       p_count = (unsigned int*)ght_next_keysize(p_table, &iterator, &p_key, &i_key_size))
+    {
+      if (*p_count > i_best)
+	{
+	  i_best = *p_count;
+	  p_best = p_key;
+	  i_best_size = i_key_size;
+	}
+    }
+  if (p_best)
+    {
+      printf("%u words, %u different, %lu bytes. Most common: %.*s (%u)\n",
+	     i_words, ght_size(p_table), (unsigned long)p_arena->i_used,
+	     (int)i_best_size, (const char*)p_best, i_best);
+    }
+
+  /* Resets the arena instead of freeing the entries */
+  ght_finalize(p_table);
+
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  FILE *p_file = stdin;
+  arena_t arena;
+  char line[4096];
+
+  if (argc > 1 && !(p_file = fopen(argv[1], "r")))
+    {
+      perror(argv[1]);
+      return 1;
+    }
+
+  if ( !(arena.p_mem = (char*)malloc(ARENA_SIZE)) )
+    {
+      perror("malloc");
+      return 1;
+    }
+  arena.i_used = 0;
+  arena.i_size = ARENA_SIZE;
+
+  while (fgets(line, sizeof(line), p_file))
+    {
+      if (handle_line(&arena, line) < 0)
+	{
+	  return 1;
+	}
+    }
+  free(arena.p_mem);
+
+  return 0;
+}
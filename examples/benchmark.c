@@ -0,0 +1,1323 @@
+/*********************************************************************
+ *
+ * Copyright (C) 2001-2005,  Simon Kagstrom
+ *
+ * Filename:      benchmark.c
+ * Description:   Benchmarks for comparing the storage engines of
+ *                the hash table.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ ********************************************************************/
+
+#include <stdlib.h> /* malloc */
+#include <string.h> /* strcmp */
+#include <stdio.h>  /* printf */
+#include <time.h>   /* clock */
+#ifdef _WIN32
+#include <windows.h> /* QueryPerformanceCounter */
+#else
+#include <pthread.h> /* pthread_create */
+#endif
+
+#include "ght_hash_table.h"
+
+typedef struct
+{
+  const char *p_name;
+  int i_engine;
+} engine_t;
+
+static engine_t engines[] =
+{
+  { "chained",    GHT_ENGINE_CHAINED },
+  { "robin-hood", GHT_ENGINE_ROBIN_HOOD },
+  { "swiss",      GHT_ENGINE_SWISS },
+  { "cuckoo",     GHT_ENGINE_CUCKOO },
+  { "blocks",     GHT_ENGINE_BLOCK_CHAINED },
+  { "compact",    GHT_ENGINE_COMPACT },
+  { "slim",       GHT_ENGINE_SLIM },
+  { "slim-unord", GHT_ENGINE_SLIM_UNORDERED },
+};
+#define N_ENGINES (sizeof(engines) / sizeof(engines[0]))
+
+/* The keys used are scrambled integers */
+static unsigned int make_key(unsigned int i)
+{
+  return i * 2654435761u;
+}
+
+/* Return the time in ns per operation since start */
+static double ns_per_op(clock_t start, unsigned int n_ops)
+{
+  return (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / n_ops;
+}
+
+/* A high resolution timestamp in ns, for timing single operations */
+static double now_ns(void)
+{
+#ifdef _WIN32
+  LARGE_INTEGER freq, count;
+
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&count);
+
+  return (double)count.QuadPart * 1e9 / freq.QuadPart;
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+#endif
+}
+
+static int compare_double(const void *p_a, const void *p_b)
+{
+  double a = *(const double*)p_a;
+  double b = *(const double*)p_b;
+
+  return (a > b) - (a < b);
+}
+
+/* Shuffle an array of keys */
+static void shuffle(unsigned int *p_keys, unsigned int n)
+{
+  unsigned int i;
+
+  for (i = n - 1; i > 0; i--)
+    {
+      unsigned int j = rand() % (i + 1);
+      unsigned int tmp = p_keys[i];
+
+      p_keys[i] = p_keys[j];
+      p_keys[j] = tmp;
+    }
+}
+
+/*
+ * Fill tables of i_size buckets/slots to load factors from 0.5 to 0.9
+ * and measure the time for successful and unsuccessful lookups.
+ */
+static int bench_load(unsigned int i_size, unsigned int i_lookups)
+{
+  unsigned int *p_hits;
+  unsigned int *p_misses;
+  unsigned int e;
+  int lf;
+
+  if ( !(p_hits = (unsigned int*)malloc(i_lookups * sizeof(unsigned int))) ||
+       !(p_misses = (unsigned int*)malloc(i_lookups * sizeof(unsigned int))) )
+    {
+      perror("malloc");
+      return 1;
+    }
+
+  printf("%-10s %5s %8s %10s %10s %10s\n", "engine", "load", "real", "insert", "hit", "miss");
+  for (lf = 5; lf <= 9; lf++)
+    {
+      unsigned int n = (unsigned int)((double)i_size * lf / 10);
+
+      for (e = 0; e < N_ENGINES; e++)
+	{
+	  ght_hash_table_t *p_table;
+	  unsigned int i;
+	  clock_t start;
+	  double t_insert;
+	  double t_hit;
+	  double t_miss;
+	  int found = 0;
+
+	  if ( !(p_table = ght_create_ex(i_size, engines[e].i_engine)) )
+	    {
+	      return 1;
+	    }
+
+	  start = clock();
+	  for (i = 0; i < n; i++)
+	    {
+	      unsigned int key = make_key(i);
+
+	      ght_insert(p_table, p_table, sizeof(key), &key);
+	    }
+	  t_insert = ns_per_op(start, n);
+
+	  /* Present keys are 0..n-1, missing keys n..2n-1 */
+	  for (i = 0; i < i_lookups; i++)
+	    {
+	      p_hits[i] = make_key(rand() % n);
+	      p_misses[i] = make_key(n + rand() % n);
+	    }
+	  shuffle(p_hits, i_lookups);
+
+	  start = clock();
+	  for (i = 0; i < i_lookups; i++)
+	    {
+	      found += ght_get(p_table, sizeof(unsigned int), &p_hits[i]) != NULL;
+	    }
+	  t_hit = ns_per_op(start, i_lookups);
+
+	  start = clock();
+	  for (i = 0; i < i_lookups; i++)
+	    {
+	      found += ght_get(p_table, sizeof(unsigned int), &p_misses[i]) != NULL;
+	    }
+	  t_miss = ns_per_op(start, i_lookups);
+
+	  if (found != i_lookups)
+	    {
+	      fprintf(stderr, "ERROR: %s found %d of %u keys\n",
+		      engines[e].p_name, found, i_lookups);
+	    }
+
+	  printf("%-10s %5.2f %8.2f %7.1f ns %7.1f ns %7.1f ns\n",
+		 engines[e].p_name, lf / 10.0,
+		 (double)ght_size(p_table) / ght_table_size(p_table),
+		 t_insert, t_hit, t_miss);
+	  ght_finalize(p_table);
+	}
+    }
+
+  free(p_hits);
+  free(p_misses);
+
+  return 0;
+}
+
+/*
+ * Insert i_items entries into chained tables without rehashing, with
+ * fewer buckets each time so the average chain gets longer, and
+ * measure the lookup times.
+ */
+static int bench_chain(unsigned int i_items, unsigned int i_lookups)
+{
+  static const int chained[] = { GHT_ENGINE_CHAINED, GHT_ENGINE_BLOCK_CHAINED };
+  unsigned int i_chain;
+
+  printf("%-10s %5s %10s %10s\n", "engine", "chain", "hit", "miss");
+  for (i_chain = 1; i_chain <= 16; i_chain *= 2)
+    {
+      unsigned int e;
+
+      for (e = 0; e < sizeof(chained) / sizeof(chained[0]); e++)
+	{
+	  ght_hash_table_t *p_table;
+	  unsigned int i;
+	  clock_t start;
+	  double t_hit;
+	  double t_miss;
+	  int found = 0;
+
+	  if ( !(p_table = ght_create_ex(i_items / i_chain, chained[e])) )
+	    {
+	      return 1;
+	    }
+	  for (i = 0; i < i_items; i++)
+	    {
+	      unsigned int key = make_key(i);
+
+	      ght_insert(p_table, p_table, sizeof(key), &key);
+	    }
+
+	  start = clock();
+	  for (i = 0; i < i_lookups; i++)
+	    {
+	      unsigned int key = make_key(rand() % i_items);
+
+	      found += ght_get(p_table, sizeof(key), &key) != NULL;
+	    }
+	  t_hit = ns_per_op(start, i_lookups);
+
+	  start = clock();
+	  for (i = 0; i < i_lookups; i++)
+	    {
+	      unsigned int key = make_key(i_items + rand() % i_items);
+
+	      found += ght_get(p_table, sizeof(key), &key) != NULL;
+	    }
+	  t_miss = ns_per_op(start, i_lookups);
+
+	  if (found != i_lookups)
+	    {
+	      fprintf(stderr, "ERROR: found %d of %u keys\n", found, i_lookups);
+	    }
+	  printf("%-10s %5.1f %7.1f ns %7.1f ns\n",
+		 e == 0 ? "chained" : "blocks",
+		 (double)ght_size(p_table) / ght_table_size(p_table), t_hit, t_miss);
+	  ght_finalize(p_table);
+	}
+    }
+
+  return 0;
+}
+
+/*
+ * Iterate over tables with i_items entries and measure the time per
+ * visited entry. Every fourth entry is replaced by a new one first,
+ * so that the entries are not allocated in iteration order.
+ */
+static int bench_iterate(unsigned int i_items, unsigned int i_rounds)
+{
+  unsigned int e;
+
+  printf("%-10s %10s %10s\n", "engine", "iterate", "checksum");
+  for (e = 0; e < N_ENGINES; e++)
+    {
+      ght_hash_table_t *p_table;
+      unsigned int i_sum = 0;
+      unsigned int i_visited = 0;
+      unsigned int i;
+      clock_t start;
+
+      if ( !(p_table = ght_create_ex(i_items, engines[e].i_engine)) )
+	{
+	  return 1;
+	}
+      ght_set_rehash(p_table, TRUE);
+      for (i = 0; i < i_items; i++)
+	{
+	  unsigned int key = make_key(i);
+
+	  ght_insert(p_table, p_table, sizeof(key), &key);
+	}
+      for (i = 0; i < i_items; i += 4)
+	{
+	  unsigned int key = make_key(i);
+
+	  ght_remove(p_table, sizeof(key), &key);
+	}
+      for (i = 0; i < i_items; i += 4)
+	{
+	  unsigned int key = make_key(i_items + i);
+
+	  ght_insert(p_table, p_table, sizeof(key), &key);
+	}
+
+      start = clock();
+      for (i = 0; i < i_rounds; i++)
+	{
+	  ght_iterator_t iterator;
+	  const void *p_key;
+	  void *p_e;
+
+	  for (p_e = ght_first(p_table, &iterator, &p_key); p_e;
+	       p_e = ght_next(p_table, &iterator, &p_key))
+	    {
+	      i_sum += *(const unsigned int*)p_key;
+	      i_visited++;
+	    }
+	}
+      printf("%-10s %7.1f ns %10u\n", engines[e].p_name,
+	     ns_per_op(start, i_visited), i_sum);
+      ght_finalize(p_table);
+    }
+
+  return 0;
+}
+
+/*
+ * Time every single lookup in a table filled to 90% of i_size and
+ * print the distribution, since the mean hides the long probe
+ * sequences. The timer overhead is included in all numbers.
+ */
+static int bench_latency(unsigned int i_size, unsigned int i_lookups)
+{
+  unsigned int n = i_size - i_size / 10;
+  double *p_times;
+  unsigned int e;
+
+  if ( !(p_times = (double*)malloc(i_lookups * sizeof(double))) )
+    {
+      perror("malloc");
+      return 1;
+    }
+
+  printf("%-10s %5s %8s %8s %8s %8s %8s %10s\n", "engine", "type",
+	 "p50", "p90", "p99", "p99.9", "p99.99", "max");
+  for (e = 0; e < N_ENGINES; e++)
+    {
+      ght_hash_table_t *p_table;
+      int miss;
+      unsigned int i;
+
+      if ( !(p_table = ght_create_ex(i_size, engines[e].i_engine)) )
+	{
+	  return 1;
+	}
+      for (i = 0; i < n; i++)
+	{
+	  unsigned int key = make_key(i);
+
+	  ght_insert(p_table, p_table, sizeof(key), &key);
+	}
+
+      for (miss = 0; miss < 2; miss++)
+	{
+	  for (i = 0; i < i_lookups; i++)
+	    {
+	      unsigned int key = make_key(miss * n + rand() % n);
+	      double start = now_ns();
+
+	      if ( (ght_get(p_table, sizeof(key), &key) != NULL) == miss )
+		{
+		  fprintf(stderr, "ERROR: %s lookup of %u failed\n", engines[e].p_name, key);
+		}
+	      p_times[i] = now_ns() - start;
+	    }
+	  qsort(p_times, i_lookups, sizeof(double), compare_double);
+
+	  printf("%-10s %5s %8.0f %8.0f %8.0f %8.0f %8.0f %10.0f\n",
+		 engines[e].p_name, miss ? "miss" : "hit",
+		 p_times[i_lookups / 2],
+		 p_times[(unsigned int)(i_lookups * 0.9)],
+		 p_times[(unsigned int)(i_lookups * 0.99)],
+		 p_times[(unsigned int)(i_lookups * 0.999)],
+		 p_times[(unsigned int)(i_lookups * 0.9999)],
+		 p_times[i_lookups - 1]);
+	}
+      ght_finalize(p_table);
+    }
+  free(p_times);
+
+  return 0;
+}
+
+/*
+ * Fill tables, which start out small, with i_items entries using
+ * ght_insert() and with one call to ght_insert_many(). Then look up
+ * random keys (half of them missing) with ght_get() and with
+ * ght_get_many(), in batches of 256 keys.
+ */
+static int bench_batch(unsigned int i_items, unsigned int i_lookups)
+{
+  unsigned int n_max = i_items > i_lookups ? i_items : i_lookups;
+  unsigned int *p_keys;
+  unsigned int *p_items;
+  const void **pp_keys;
+  const void **pp_items;
+  unsigned int *p_sizes;
+  void **pp_results;
+  unsigned int e, i;
+
+  if ( !(p_keys = (unsigned int*)malloc(i_lookups * sizeof(unsigned int))) ||
+       !(p_items = (unsigned int*)malloc(i_items * sizeof(unsigned int))) ||
+       !(pp_keys = (const void**)malloc(i_lookups * sizeof(void*))) ||
+       !(pp_items = (const void**)malloc(i_items * sizeof(void*))) ||
+       !(p_sizes = (unsigned int*)malloc(n_max * sizeof(unsigned int))) ||
+       !(pp_results = (void**)malloc(n_max * sizeof(void*))) )
+    {
+      perror("malloc");
+      return 1;
+    }
+  for (i = 0; i < n_max; i++)
+    {
+      p_sizes[i] = sizeof(unsigned int);
+    }
+  for (i = 0; i < i_items; i++)
+    {
+      p_items[i] = make_key(i);
+      pp_items[i] = &p_items[i];
+    }
+  for (i = 0; i < i_lookups; i++)
+    {
+      p_keys[i] = make_key(rand() % (2 * i_items));
+      pp_keys[i] = &p_keys[i];
+    }
+
+  printf("%-10s %10s %11s %10s %10s\n", "engine", "insert", "insert_many",
+	 "get", "get_many");
+  for (e = 0; e < N_ENGINES; e++)
+    {
+      ght_hash_table_t *p_table;
+      ght_hash_table_t *p_many;
+      unsigned int i_found = 0, i_found_many = 0;
+      double t_insert, t_insert_many, t_get;
+      clock_t start;
+
+      if ( !(p_table = ght_create_ex(128, engines[e].i_engine)) ||
+	   !(p_many = ght_create_ex(128, engines[e].i_engine)) )
+	{
+	  return 1;
+	}
+      ght_set_rehash(p_table, TRUE);
+      ght_set_rehash(p_many, TRUE);
+
+      start = clock();
+      for (i = 0; i < i_items; i++)
+	{
+	  ght_insert(p_table, &p_items[i], sizeof(unsigned int), &p_items[i]);
+	}
+      t_insert = ns_per_op(start, i_items);
+
+      start = clock();
+      ght_insert_many(p_many, i_items, (void *const *)pp_items, p_sizes, pp_items, NULL);
+      t_insert_many = ns_per_op(start, i_items);
+      if (ght_size(p_table) != ght_size(p_many))
+	{
+	  fprintf(stderr, "ERROR: ght_insert inserted %u, ght_insert_many %u\n",
+		  ght_size(p_table), ght_size(p_many));
+	}
+      ght_finalize(p_table);
+
+      start = clock();
+      for (i = 0; i < i_lookups; i++)
+	{
+	  i_found += ght_get(p_many, sizeof(unsigned int), &p_keys[i]) != NULL;
+	}
+      t_get = ns_per_op(start, i_lookups);
+
+      start = clock();
+      for (i = 0; i < i_lookups; i += 256)
+	{
+	  unsigned int n = i_lookups - i < 256 ? i_lookups - i : 256;
+
+	  i_found_many += ght_get_many(p_many, n, p_sizes + i, pp_keys + i, pp_results + i);
+	}
+      printf("%-10s %7.1f ns %8.1f ns %7.1f ns %7.1f ns\n", engines[e].p_name,
+	     t_insert, t_insert_many, t_get, ns_per_op(start, i_lookups));
+      if (i_found != i_found_many)
+	{
+	  fprintf(stderr, "ERROR: ght_get found %u, ght_get_many %u\n", i_found, i_found_many);
+	}
+      ght_finalize(p_many);
+    }
+  free(p_keys);
+  free(p_items);
+  free(pp_keys);
+  free(pp_items);
+  free(p_sizes);
+  free(pp_results);
+
+  return 0;
+}
+
+typedef struct
+{
+  const char *p_name;
+  ght_fn_hash_t fn_hash;
+} hash_t;
+
+static hash_t hashes[] =
+{
+  { "one-at-a-time", ght_one_at_a_time_hash },
+  { "rotating",      ght_rotating_hash },
+  { "crc",           ght_crc_hash },
+  { "xx",            ght_xx_hash },
+  { "wy",            ght_wy_hash },
+  { "crc32c",        ght_crc32c_hash },
+  { "aes",           ght_aes_hash },
+};
+#define N_HASHES (sizeof(hashes) / sizeof(hashes[0]))
+
+/* Keeps the compiler from dropping the hashing */
+static volatile ght_uint32_t hash_sink;
+
+/* The chi-square of the bucket counts divided by the degrees of
+ * freedom, which is about 1.0 for a random distribution. */
+static double chi_square(unsigned int *p_counts, unsigned int i_buckets, unsigned int n)
+{
+  double expected = (double)n / i_buckets;
+  double chi = 0;
+  unsigned int i;
+
+  for (i = 0; i < i_buckets; i++)
+    {
+      double d = p_counts[i] - expected;
+
+      chi += d * d / expected;
+    }
+
+  return chi / (i_buckets - 1);
+}
+
+/*
+ * Measure the time per key of the hash functions for different key
+ * sizes, and how evenly they distribute keys over 4096 buckets. The
+ * buckets are taken both from the low bits (like the chained engines)
+ * and from the high bits of the hash value. The key sets are
+ * sequential integers, short strings ("key1234") and 100-byte keys
+ * which only differ in two bytes in the middle.
+ */
+static int bench_hash(unsigned int i_keys)
+{
+  static const unsigned int sizes[] = { 4, 8, 16, 32, 100, 1000 };
+  const unsigned int i_buckets = 4096;
+  unsigned int counts[2][4096];
+  unsigned char buf[1000 + 64];
+  unsigned int h, i, j;
+
+  for (i = 0; i < sizeof(buf); i++)
+    {
+      buf[i] = (unsigned char)rand();
+    }
+
+  printf("%-14s", "ns/key");
+  for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++)
+    {
+      printf(" %7u", sizes[j]);
+    }
+  printf(" %10s\n", "GB/s@1000");
+  for (h = 0; h < N_HASHES; h++)
+    {
+      double t = 0;
+
+      printf("%-14s", hashes[h].p_name);
+      for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++)
+	{
+	  unsigned int n = i_keys / (sizes[j] / 4);
+	  ght_uint32_t i_sum = 0;
+	  ght_hash_key_t key;
+	  clock_t start;
+
+	  key.i_size = sizes[j];
+	  start = clock();
+	  for (i = 0; i < n; i++)
+	    {
+	      /* Slide over the buffer, so that the keys differ */
+	      key.p_key = buf + (i & 63);
+	      i_sum += hashes[h].fn_hash(&key);
+	    }
+	  t = ns_per_op(start, n);
+	  hash_sink = i_sum;
+	  printf(" %7.1f", t);
+	}
+      printf(" %10.2f\n", 1000 / t);
+    }
+
+  /* The same with ght_hash_many(), on 1024 keys at a time */
+  printf("\n%-14s", "ns/key (many)");
+  for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]) - 1; j++)
+    {
+      printf(" %7u", sizes[j]);
+    }
+  printf("\n");
+  for (h = 0; h < N_HASHES; h++)
+    {
+      printf("%-14s", hashes[h].p_name);
+      for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]) - 1; j++)
+	{
+	  unsigned int n = i_keys / (sizes[j] / 4) / 1024;
+	  unsigned char *p_keys;
+	  ght_uint32_t many[1024];
+	  clock_t start;
+
+	  if ( !(p_keys = (unsigned char*)malloc(1024 * sizes[j])) )
+	    {
+	      perror("malloc");
+	      return 1;
+	    }
+	  for (i = 0; i < 1024 * sizes[j]; i++)
+	    {
+	      p_keys[i] = (unsigned char)rand();
+	    }
+	  start = clock();
+	  for (i = 0; i < n; i++)
+	    {
+	      ght_hash_many(hashes[h].fn_hash, 1024, sizes[j], p_keys, many);
+	      hash_sink += many[i & 1023];
+	    }
+	  printf(" %7.1f", ns_per_op(start, n * 1024));
+	  free(p_keys);
+	}
+      printf("\n");
+    }
+
+  printf("\n%-14s %10s %10s %10s %10s %10s %10s\n", "chi2/df",
+	 "int-low", "int-high", "str-low", "str-high", "100b-low", "100b-high");
+  for (h = 0; h < N_HASHES; h++)
+    {
+      int k;
+
+      printf("%-14s", hashes[h].p_name);
+      for (k = 0; k < 3; k++)
+	{
+	  memset(counts, 0, sizeof(counts));
+	  for (i = 0; i < 16 * i_buckets; i++)
+	    {
+	      char str[16];
+	      unsigned char long_key[100];
+	      ght_hash_key_t key;
+	      ght_uint32_t l_hash;
+
+	      if (k == 0)
+		{
+		  key.i_size = sizeof(i);
+		  key.p_key = &i;
+		}
+	      else if (k == 1)
+		{
+		  key.i_size = sprintf(str, "key%u", i);
+		  key.p_key = str;
+		}
+	      else
+		{
+		  memset(long_key, 'x', sizeof(long_key));
+		  long_key[50] = (unsigned char)i;
+		  long_key[51] = (unsigned char)(i >> 8);
+		  key.i_size = sizeof(long_key);
+		  key.p_key = long_key;
+		}
+	      l_hash = hashes[h].fn_hash(&key);
+	      counts[0][l_hash & (i_buckets - 1)]++;
+	      counts[1][l_hash >> 20]++;
+	    }
+	  printf(" %10.2f %10.2f", chi_square(counts[0], i_buckets, 16 * i_buckets),
+		 chi_square(counts[1], i_buckets, 16 * i_buckets));
+	}
+      printf("\n");
+    }
+
+  return 0;
+}
+
+/*
+ * Measure the time to insert i_items entries, to remove and insert
+ * them again and to finalize the table, with and without the pool
+ * allocator. The keys are 16 bytes, so that they are not stored
+ * inline by the open addressing engines.
+ */
+static int bench_pool(unsigned int i_items)
+{
+  unsigned int e;
+  int b_pool;
+
+  printf("%-10s %5s %10s %10s %10s\n", "engine", "pool", "insert", "reinsert", "finalize");
+  for (e = 0; e < N_ENGINES; e++)
+    {
+      for (b_pool = 0; b_pool < 2; b_pool++)
+	{
+	  ght_hash_table_t *p_table;
+	  double t_insert, t_reinsert;
+	  unsigned int i;
+	  clock_t start;
+
+	  if ( !(p_table = ght_create_ex(i_items, engines[e].i_engine)) )
+	    {
+	      return 1;
+	    }
+	  ght_set_rehash(p_table, TRUE);
+	  if (b_pool && ght_set_pool(p_table, TRUE) < 0)
+	    {
+	      return 1;
+	    }
+
+	  start = clock();
+	  for (i = 0; i < i_items; i++)
+	    {
+	      unsigned int key[4] = { make_key(i), 0, 0, 0 };
+
+	      ght_insert(p_table, p_table, sizeof(key), key);
+	    }
+	  t_insert = ns_per_op(start, i_items);
+
+	  start = clock();
+	  for (i = 0; i < i_items; i += 2)
+	    {
+	      unsigned int key[4] = { make_key(i), 0, 0, 0 };
+
+	      ght_remove(p_table, sizeof(key), key);
+	    }
+	  for (i = 0; i < i_items; i += 2)
+	    {
+	      unsigned int key[4] = { make_key(i), 0, 0, 0 };
+
+	      ght_insert(p_table, p_table, sizeof(key), key);
+	    }
+	  t_reinsert = ns_per_op(start, i_items);
+
+	  start = clock();
+	  ght_finalize(p_table);
+	  printf("%-10s %5s %7.1f ns %7.1f ns %7.1f ns\n", engines[e].p_name,
+		 b_pool ? "yes" : "no", t_insert, t_reinsert, ns_per_op(start, i_items));
+	}
+    }
+
+  return 0;
+}
+
+/*
+ * Count i_tokens keys drawn from i_items different ones, like counting
+ * words, first with ght_get() and ght_insert() when the key is new and
+ * then with ght_get_or_insert(). The counts are in an array. The best
+ * of three runs is printed.
+ */
+static int bench_count(unsigned int i_items, unsigned int i_tokens)
+{
+  unsigned int *p_counts;
+  unsigned int e, i;
+
+  if ( !(p_counts = (unsigned int*)malloc(i_items * sizeof(unsigned int))) )
+    {
+      perror("malloc");
+      return 1;
+    }
+
+  printf("%-10s %12s %14s\n", "engine", "get+insert", "get_or_insert");
+  for (e = 0; e < N_ENGINES; e++)
+    {
+      double t[2] = { 1e9, 1e9 };
+      int i_run;
+
+      for (i_run = 0; i_run < 6; i_run++)
+	{
+	  int b_single = i_run & 1;
+	  ght_hash_table_t *p_table;
+	  unsigned int i_new = 0;
+	  double t_run;
+	  clock_t start;
+
+	  if ( !(p_table = ght_create_ex(i_items / 4, engines[e].i_engine)) )
+	    {
+	      return 1;
+	    }
+	  ght_set_rehash(p_table, TRUE);
+	  memset(p_counts, 0, i_items * sizeof(unsigned int));
+
+	  srand(1);
+	  start = clock();
+	  for (i = 0; i < i_tokens; i++)
+	    {
+	      unsigned int key = make_key(rand() % i_items);
+	      unsigned int *p_new = &p_counts[i_new];
+	      unsigned int *p_count;
+
+	      if (b_single)
+		{
+		  p_count = (unsigned int*)ght_get_or_insert(p_table, p_new, sizeof(key), &key);
+		}
+	      else if ( !(p_count = (unsigned int*)ght_get(p_table, sizeof(key), &key)) )
+		{
+		  ght_insert(p_table, p_new, sizeof(key), &key);
+		  p_count = p_new;
+		}
+	      if (p_count == p_new)
+		{
+		  i_new++;
+		}
+	      (*p_count)++;
+	    }
+	  t_run = ns_per_op(start, i_tokens);
+	  if (t_run < t[b_single])
+	    {
+	      t[b_single] = t_run;
+	    }
+	  ght_finalize(p_table);
+	}
+      printf("%-10s %9.1f ns %11.1f ns\n", engines[e].p_name, t[0], t[1]);
+    }
+  free(p_counts);
+
+  return 0;
+}
+
+/* Every third entry has expired */
+static int is_expired(void *p_ctx, void *p_data, const void *p_key, unsigned int i_key_size)
+{
+  (void)p_ctx;
+  (void)p_data;
+  (void)i_key_size;
+
+  return *(const unsigned int*)p_key % 3 == 0;
+}
+
+/*
+ * Remove the expired entries (a third of them) of a table with i_items
+ * entries, by iterating and calling ght_remove() with the key, and
+ * with ght_remove_if().
+ */
+static int bench_sweep(unsigned int i_items)
+{
+  unsigned int e, i;
+
+  printf("%-10s %12s %12s\n", "engine", "ght_remove", "remove_if");
+  for (e = 0; e < N_ENGINES; e++)
+    {
+      double t[2];
+      int b_remove_if;
+
+      for (b_remove_if = 0; b_remove_if < 2; b_remove_if++)
+	{
+	  ght_hash_table_t *p_table;
+	  ght_iterator_t iterator;
+	  const void *p_key;
+	  void *p_e;
+	  clock_t start;
+
+	  if ( !(p_table = ght_create_ex(i_items, engines[e].i_engine)) )
+	    {
+	      return 1;
+	    }
+	  ght_set_rehash(p_table, TRUE);
+	  for (i = 0; i < i_items; i++)
+	    {
+	      unsigned int key = make_key(i);
+
+	      ght_insert(p_table, p_table, sizeof(key), &key);
+	    }
+
+	  start = clock();
+	  if (b_remove_if)
+	    {
+	      ght_remove_if(p_table, is_expired, NULL);
+	    }
+	  else
+	    {
+	      for (p_e = ght_first(p_table, &iterator, &p_key); p_e;
+		   p_e = ght_next(p_table, &iterator, &p_key))
+		{
+		  if (is_expired(NULL, p_e, p_key, sizeof(unsigned int)))
+		    {
+		      unsigned int key = *(const unsigned int*)p_key;
+
+		      ght_remove(p_table, sizeof(key), &key);
+		    }
+		}
+	    }
+	  t[b_remove_if] = ns_per_op(start, i_items);
+	  ght_finalize(p_table);
+	}
+      printf("%-10s %9.1f ns %9.1f ns\n", engines[e].p_name, t[0], t[1]);
+    }
+
+  return 0;
+}
+
+/*
+ * Time ght_rehash_parallel() of a table with i_items entries to four
+ * times as many buckets, with 1 to 16 threads. The time is wall time,
+ * as clock() would add up the time of all threads.
+ */
+static int bench_rehash(unsigned int i_items)
+{
+  unsigned int i_threads, i;
+  double t1 = 0;
+
+  printf("%-8s %12s %8s\n", "threads", "rehash", "speedup");
+  for (i_threads = 1; i_threads <= 16; i_threads *= 2)
+    {
+      ght_hash_table_t *p_table;
+      double start, t;
+
+      if ( !(p_table = ght_create(i_items)) )
+	{
+	  return 1;
+	}
+      for (i = 0; i < i_items; i++)
+	{
+	  unsigned int key = make_key(i);
+
+	  ght_insert(p_table, p_table, sizeof(key), &key);
+	}
+
+      start = now_ns();
+      ght_rehash_parallel(p_table, 4 * i_items, i_threads);
+      t = (now_ns() - start) / 1e6;
+      ght_finalize(p_table);
+
+      if (i_threads == 1)
+	{
+	  t1 = t;
+	}
+      printf("%-8u %9.1f ms %7.2fx\n", i_threads, t, t1 / t);
+    }
+
+  return 0;
+}
+
+/*
+ * Time ght_insert_many_parallel() of i_items new entries into an
+ * empty table with 1 to 16 threads, in wall time. With one thread it
+ * is the same as ght_insert_many().
+ */
+static int bench_build(unsigned int i_items)
+{
+  unsigned int *p_keys, *p_sizes;
+  const void **pp_keys;
+  unsigned int i_threads, i;
+  double t1 = 0;
+
+  if ( !(p_keys = (unsigned int*)malloc(i_items * sizeof(unsigned int))) ||
+       !(p_sizes = (unsigned int*)malloc(i_items * sizeof(unsigned int))) ||
+       !(pp_keys = (const void**)malloc(i_items * sizeof(void*))) )
+    {
+      perror("malloc");
+      return 1;
+    }
+  for (i = 0; i < i_items; i++)
+    {
+      p_keys[i] = make_key(i);
+      p_sizes[i] = sizeof(unsigned int);
+      pp_keys[i] = &p_keys[i];
+    }
+
+  printf("%-8s %12s %8s\n", "threads", "build", "speedup");
+  for (i_threads = 1; i_threads <= 16; i_threads *= 2)
+    {
+      ght_hash_table_t *p_table;
+      double start, t;
+
+      if ( !(p_table = ght_create(i_items)) )
+	{
+	  return 1;
+	}
+      ght_set_rehash(p_table, TRUE);
+
+      start = now_ns();
+      ght_insert_many_parallel(p_table, i_items, (void *const *)pp_keys, p_sizes, pp_keys,
+			       NULL, i_threads);
+      t = (now_ns() - start) / 1e6;
+      ght_finalize(p_table);
+
+      if (i_threads == 1)
+	{
+	  t1 = t;
+	}
+      printf("%-8u %9.1f ms %7.2fx\n", i_threads, t, t1 / t);
+    }
+  free(pp_keys);
+  free(p_sizes);
+  free(p_keys);
+
+  return 0;
+}
+
+#ifndef _WIN32
+#define MAX_THREADS 64
+
+/* The table shared by the threads of bench_threads() and bench_reads() */
+typedef struct
+{
+  ght_hash_table_t *p_table;
+  ght_sharded_t *p_sharded;    /* Used instead of p_table if set */
+  pthread_mutex_t *p_mutex;    /* Held around every call, or NULL */
+  unsigned int i_keys;
+  unsigned int i_ops;
+  unsigned int i_reads;        /* Percentage of lookups */
+  int b_reader;                /* Use ght_reader_register() */
+  unsigned int i_seed;
+} threads_ctx_t;
+
+/* i_reads% lookups, the rest half inserts and half removals of random keys */
+static void *threads_worker(void *p_arg)
+{
+  threads_ctx_t *p_ctx = (threads_ctx_t*)p_arg;
+  unsigned int i_rand = p_ctx->i_seed;
+  unsigned int i_insert = p_ctx->i_reads + (100 - p_ctx->i_reads) / 2;
+  unsigned int i;
+
+  if (p_ctx->b_reader && ght_reader_register() < 0)
+    {
+      return NULL;
+    }
+  for (i = 0; i < p_ctx->i_ops; i++)
+    {
+      unsigned int r, key;
+
+      i_rand = i_rand * 1103515245 + 12345;
+      r = (i_rand >> 8) % 100;
+      key = make_key((i_rand >> 4) % p_ctx->i_keys);
+
+      if (p_ctx->p_mutex)
+	{
+	  pthread_mutex_lock(p_ctx->p_mutex);
+	}
+      if (p_ctx->p_sharded)
+	{
+	  if (r < p_ctx->i_reads)
+	    {
+	      ght_sharded_get(p_ctx->p_sharded, sizeof(key), &key);
+	    }
+	  else if (r < i_insert)
+	    {
+	      ght_sharded_insert(p_ctx->p_sharded, p_ctx, sizeof(key), &key);
+	    }
+	  else
+	    {
+	      ght_sharded_remove(p_ctx->p_sharded, sizeof(key), &key);
+	    }
+	}
+      else if (r < p_ctx->i_reads)
+	{
+	  ght_get(p_ctx->p_table, sizeof(key), &key);
+	}
+      else if (r < i_insert)
+	{
+	  ght_insert(p_ctx->p_table, p_ctx, sizeof(key), &key);
+	}
+      else
+	{
+	  ght_remove(p_ctx->p_table, sizeof(key), &key);
+	}
+      if (p_ctx->p_mutex)
+	{
+	  pthread_mutex_unlock(p_ctx->p_mutex);
+	}
+      if (p_ctx->b_reader && (i & 63) == 0)
+	{
+	  ght_quiescent();
+	}
+    }
+  if (p_ctx->b_reader)
+    {
+      ght_reader_unregister();
+    }
+
+  return NULL;
+}
+
+/*
+ * Run i_ops operations with i_reads% lookups in i_threads threads on
+ * a new table with i_items entries and return the throughput of all
+ * threads together in Mop/s. The mode is 0 for one mutex around
+ * every call, 1 for ght_set_concurrent(), 2 for lock-free lookups
+ * on top of that and 3 for ght_sharded_create(). Returns a negative
+ * value on failure.
+ */
+static double run_threads(unsigned int i_items, unsigned int i_ops, unsigned int i_reads,
+			  unsigned int i_threads, int i_mode)
+{
+  threads_ctx_t ctx[MAX_THREADS];
+  pthread_t threads[MAX_THREADS];
+  pthread_mutex_t mutex;
+  ght_hash_table_t *p_table = NULL;
+  ght_sharded_t *p_sharded = NULL;
+  unsigned int i;
+  double start, ret;
+
+  if (i_mode == 3)
+    {
+      if ( !(p_sharded = ght_sharded_create(4 * MAX_THREADS, i_items)) )
+	{
+	  return -1;
+	}
+    }
+  else
+    {
+      if ( !(p_table = ght_create(i_items)) )
+	{
+	  return -1;
+	}
+      ght_set_rehash(p_table, TRUE);
+      if ( (i_mode >= 1 && ght_set_concurrent(p_table, 4 * MAX_THREADS) < 0) ||
+	   (i_mode >= 2 && ght_set_lockfree_reads(p_table, TRUE) < 0) )
+	{
+	  ght_finalize(p_table);
+	  return -1;
+	}
+    }
+  /* Half of the keys are in the table */
+  for (i = 0; i < i_items; i++)
+    {
+      unsigned int key = make_key(i);
+
+      if (p_sharded)
+	{
+	  ght_sharded_insert(p_sharded, p_sharded, sizeof(key), &key);
+	}
+      else
+	{
+	  ght_insert(p_table, p_table, sizeof(key), &key);
+	}
+    }
+
+  pthread_mutex_init(&mutex, NULL);
+  start = now_ns();
+  for (i = 0; i < i_threads; i++)
+    {
+      ctx[i].p_table = p_table;
+      ctx[i].p_sharded = p_sharded;
+      ctx[i].p_mutex = i_mode == 0 ? &mutex : NULL;
+      ctx[i].i_keys = 2 * i_items;
+      ctx[i].i_ops = i_ops / i_threads;
+      ctx[i].i_reads = i_reads;
+      ctx[i].b_reader = i_mode == 2;
+      ctx[i].i_seed = i + 1;
+      if (pthread_create(&threads[i], NULL, threads_worker, &ctx[i]) != 0)
+	{
+	  fprintf(stderr, "pthread_create failed\n");
+	  i_threads = i;
+	  i_ops = 0;
+	  break;
+	}
+    }
+  for (i = 0; i < i_threads; i++)
+    {
+      pthread_join(threads[i], NULL);
+    }
+  ret = i_ops ? i_ops / ((now_ns() - start) / 1e3) : -1;
+  pthread_mutex_destroy(&mutex);
+  if (p_sharded)
+    {
+      ght_sharded_finalize(p_sharded);
+    }
+  else
+    {
+      ght_finalize(p_table);
+    }
+
+  return ret;
+}
+
+/*
+ * Run a mixed load with 90% lookups from 1 to 64 threads on a table
+ * with about i_items entries, which is locked with one mutex around
+ * every call, which uses ght_set_concurrent(), and on a sharded table.
+ */
+static int bench_threads(unsigned int i_items, unsigned int i_ops)
+{
+  unsigned int i_threads;
+
+  printf("%-8s %14s %14s %14s\n", "threads", "mutex", "striped", "sharded");
+  for (i_threads = 1; i_threads <= MAX_THREADS; i_threads *= 2)
+    {
+      double t[4];
+      int i_mode;
+
+      for (i_mode = 0; i_mode < 4; i_mode++)
+	{
+	  /* Lock-free reads are in bench_reads() */
+	  if (i_mode != 2 && (t[i_mode] = run_threads(i_items, i_ops, 90, i_threads, i_mode)) < 0)
+	    {
+	      return 1;
+	    }
+	}
+      printf("%-8u %8.2f Mop/s %8.2f Mop/s %8.2f Mop/s\n", i_threads, t[0], t[1], t[3]);
+    }
+
+  return 0;
+}
+
+/*
+ * The same with 99% lookups, also with ght_set_lockfree_reads(). The
+ * lock-free threads call ght_quiescent() every 64 operations.
+ */
+static int bench_reads(unsigned int i_items, unsigned int i_ops)
+{
+  unsigned int i_threads;
+
+  printf("%-8s %14s %14s %14s\n", "threads", "mutex", "striped", "lock-free");
+  for (i_threads = 1; i_threads <= MAX_THREADS; i_threads *= 2)
+    {
+      double t[3];
+      int i_mode;
+
+      for (i_mode = 0; i_mode < 3; i_mode++)
+	{
+	  if ( (t[i_mode] = run_threads(i_items, i_ops, 99, i_threads, i_mode)) < 0)
+	    {
+	      return 1;
+	    }
+	}
+      printf("%-8u %8.2f Mop/s %8.2f Mop/s %8.2f Mop/s\n", i_threads, t[0], t[1], t[2]);
+    }
+
+  return 0;
+}
+#endif /* _WIN32 */
+
+int main(int argc, char *argv[])
+{
+  unsigned int i_size = 1 << 20;
+
+  if (argc < 2)
+    {
+      printf("Usage: benchmark test [size]\n\n"
+	     "Tests:\n"
+	     "  load     Lookup times for the storage engines at load factors 0.5-0.9\n"
+	     "  chain    Lookup times for the chained engines at chain lengths 1-16\n"
+	     "  iterate  Time per entry for iterating over the whole table\n"
+	     "  latency  Distribution of single lookup times (ns) at load factor 0.9\n"
+	     "  pool     Insert, remove and finalize times with and without ght_set_pool()\n"
+	     "  hash     Speed and distribution of the hash functions\n"
+	     "  batch    ght_insert()/ght_get() vs ght_insert_many()/ght_get_many()\n"
+	     "  count    Counting keys with ght_get()+ght_insert() vs ght_get_or_insert()\n"
+	     "  sweep    Removing a third of the entries with ght_remove() vs ght_remove_if()\n"
+	     "  rehash   ght_rehash_parallel() to four times the size with 1-16 threads\n"
+	     "  build    ght_insert_many_parallel() into an empty table with 1-16 threads\n"
+	     "  threads  1-64 threads with one mutex, ght_set_concurrent() or ght_sharded_create()\n"
+	     "  reads    The same with 99%% lookups, also with ght_set_lockfree_reads()\n"
+	     "\n"
+	     "The size is the number of buckets or slots for the load and\n"
+	     "latency tests, and the number of entries for the others (default %u). For\n"
+	     "the hash test, it is the amount of data to hash in 4-byte words\n"
+	     "(default 10000000)\n", i_size);
+      return 0;
+    }
+  if (argc > 2)
+    {
+      i_size = (unsigned int)atoi(argv[2]);
+    }
+
+  srand(1000);
+  if (strcmp(argv[1], "load") == 0)
+    {
+      return bench_load(i_size, 4000000);
+    }
+  if (strcmp(argv[1], "chain") == 0)
+    {
+      return bench_chain(i_size, 4000000);
+    }
+  if (strcmp(argv[1], "iterate") == 0)
+    {
+      return bench_iterate(i_size, 10);
+    }
+  if (strcmp(argv[1], "latency") == 0)
+    {
+      return bench_latency(i_size, 2000000);
+    }
+  if (strcmp(argv[1], "batch") == 0)
+    {
+      return bench_batch(i_size, 4000000);
+    }
+  if (strcmp(argv[1], "count") == 0)
+    {
+      return bench_count(i_size, 2 * i_size);
+    }
+  if (strcmp(argv[1], "sweep") == 0)
+    {
+      return bench_sweep(i_size);
+    }
+  if (strcmp(argv[1], "rehash") == 0)
+    {
+      return bench_rehash(i_size);
+    }
+  if (strcmp(argv[1], "build") == 0)
+    {
+      return bench_build(i_size);
+    }
+#ifndef _WIN32
+  if (strcmp(argv[1], "threads") == 0)
+    {
+      return bench_threads(i_size, 8000000);
+    }
+  if (strcmp(argv[1], "reads") == 0)
+    {
+      return bench_reads(i_size, 8000000);
+    }
+#endif
+  if (strcmp(argv[1], "hash") == 0)
+    {
+      return bench_hash(argc > 2 ? i_size : 10000000);
+    }
+  if (strcmp(argv[1], "pool") == 0)
+    {
+      return bench_pool(i_size);
+    }
+
+  fprintf(stderr, "Unknown test %s\n", argv[1]);
+
+  return 1;
+}
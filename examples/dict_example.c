@@ -83,12 +83,13 @@ int main(int argc, char *argv[])
   /* Parse the arguments */
   if (argc < 3)
     {
-      printf("Usage: dict_example [-m|-t|-b] dictfile textfile\n\n"
+      printf("Usage: dict_example [-m|-t|-b|-i] dictfile textfile\n\n"
 	     "Reads words from `dictfile' and looks up these words in `textfile'.\n"
 	     "Options:\n"
 	     "  -m  Use move-to-front heuristics\n"
 	     "  -t  Use transpose heuristics\n"
 	     "  -b  Use bounded buckets (use the hash table as a cache)\n"
+	     "  -i  Use incremental rehashing\n"
 	     );
       return 0;
     }
@@ -104,6 +105,8 @@ int main(int argc, char *argv[])
 	  ght_set_rehash(p_table, FALSE);
 	  ght_set_bounded_buckets(p_table, 3, bucket_free_callback);
 	}
+      else if (strcmp(argv[1], "-i") == 0)
+	ght_set_incremental_rehash(p_table, TRUE);
       p_dict_name = argv[2];
       p_text_name = argv[3];
     }
@@ -29,6 +29,7 @@
 #include <time.h>   /* time */
 #include <errno.h>  /* errno */
 #include <stdio.h>  /* perror etc */
+#include <string.h> /* memcpy, memset */
 
 #include "ght_hash_table.h" /* Include the generic hash table */
 
@@ -37,12 +38,638 @@ void fn(void *data, const void *key)
   free(data);
 }
 
+/* The checks below are deterministic, they return -1 and tell which
+ * check failed as soon as one does */
+#define CHECK(expr) \
+  do \
+    { \
+      if (!(expr)) \
+	{ \
+	  printf("%s:%d: Check failed: %s\n", __FILE__, __LINE__, #expr); \
+	  return -1; \
+	} \
+    } while (0)
+
+/* Check that ght_hash_many() hashes like the hash functions, for the
+ * key sizes which have vectorized code and some which do not */
+static int check_hash_many(void)
+{
+  ght_fn_hash_t fns[] = { ght_one_at_a_time_hash, ght_rotating_hash, ght_crc_hash,
+			  ght_xx_hash, ght_wy_hash, ght_crc32c_hash, ght_aes_hash };
+  unsigned int sizes[] = { 1, 3, 4, 8, 12, 16, 24 };
+  unsigned int counts[] = { 0, 1, 7, 8, 9, 16, 17, 100 };
+  unsigned char keys[100 * 24];
+  ght_uint32_t hashes[101];
+  unsigned int f, s, c, i;
+
+  for (i = 0; i < sizeof(keys); i++)
+    {
+      keys[i] = (unsigned char)(i * 131 + 7);
+    }
+  for (f = 0; f < sizeof(fns) / sizeof(fns[0]); f++)
+    {
+      for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+	{
+	  for (c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+	    {
+	      unsigned int n = counts[c];
+
+	      /* The hash after the last one must not be written */
+	      hashes[n] = 0xdeadbeef;
+	      ght_hash_many(fns[f], n, sizes[s], keys, hashes);
+	      CHECK(hashes[n] == 0xdeadbeef);
+	      for (i = 0; i < n; i++)
+		{
+		  ght_hash_key_t key;
+
+		  key.i_size = sizes[s];
+		  key.p_key = keys + i * sizes[s];
+		  CHECK(hashes[i] == fns[f](&key));
+		}
+	    }
+	}
+    }
+
+  return 0;
+}
+
+/* The number of engines, and the number of keys in the tables of the
+ * checks below. The keys are i * KEY_STEP, with i from 0 to
+ * N_KEYS - 1, and the data of a key is &values[i]. */
+#define N_ENGINES (GHT_ENGINE_SLIM_UNORDERED + 1)
+#define N_KEYS    1000
+#define KEY_STEP  7
+static int values[N_KEYS];
+
+/* TRUE if the tables of the checks use the pool of ght_set_pool() */
+static int b_use_pool;
+
+/* Create a small table which is rehashed automatically, so that the
+ * checks grow it a few times */
+static ght_hash_table_t *create_table(int i_engine)
+{
+  ght_hash_table_t *p_table = ght_create_ex(8, i_engine);
+
+  if (p_table)
+    {
+      ght_set_rehash(p_table, TRUE);
+      if (b_use_pool && ght_set_pool(p_table, TRUE) < 0)
+	{
+	  ght_finalize(p_table);
+	  return NULL;
+	}
+    }
+
+  return p_table;
+}
+
+/* Insert the keys from i_first up to i_last - 1 one by one */
+static int fill_table(ght_hash_table_t *p_table, unsigned int i_first, unsigned int i_last)
+{
+  unsigned int i;
+
+  for (i = i_first; i < i_last; i++)
+    {
+      unsigned int i_key = i * KEY_STEP;
+
+      CHECK(ght_insert(p_table, &values[i], sizeof(i_key), &i_key) == 0);
+    }
+
+  return 0;
+}
+
+/* Check ght_get_many() and ght_get_many_hashed() against ght_get(),
+ * with keys which are in the table and keys which are not, duplicates
+ * and batches of all sizes, without and with heuristics */
+static int check_get_many(int i_engine)
+{
+  ght_hash_table_t *p_table;
+  unsigned int keys[3 * N_KEYS];
+  unsigned int sizes[3 * N_KEYS];
+  const void *pp_keys[3 * N_KEYS];
+  ght_uint32_t hashes[3 * N_KEYS];
+  void *results[3 * N_KEYS + 1];
+  void *results_hashed[3 * N_KEYS];
+  unsigned int n, i, i_found;
+  int i_heuristics;
+
+  CHECK( (p_table = create_table(i_engine)) );
+  CHECK(fill_table(p_table, 0, N_KEYS) == 0);
+
+  /* Every key of the table, one in between which is not, and every
+   * key again */
+  for (i = 0; i < 3 * N_KEYS; i++)
+    {
+      keys[i] = i < 2 * N_KEYS ? i * KEY_STEP / 2 : (i - 2 * N_KEYS) * KEY_STEP;
+      sizes[i] = sizeof(keys[i]);
+      pp_keys[i] = &keys[i];
+    }
+  ght_hash_many(p_table->fn_hash, 3 * N_KEYS, sizeof(keys[0]), keys, hashes);
+  for (i_heuristics = GHT_HEURISTICS_NONE; i_heuristics <= GHT_HEURISTICS_MOVE_TO_FRONT; i_heuristics++)
+    {
+      ght_set_heuristics(p_table, i_heuristics);
+      for (n = 0; n <= 3 * N_KEYS; n += n < 40 ? 1 : 740)
+	{
+	  results[n] = &results;
+	  i_found = ght_get_many(p_table, n, sizes, pp_keys, results);
+	  CHECK(results[n] == &results);
+	  CHECK(ght_get_many_hashed(p_table, n, sizes, pp_keys, hashes, results_hashed) == i_found);
+	  for (i = 0; i < n; i++)
+	    {
+	      void *p_data = ght_get(p_table, sizes[i], pp_keys[i]);
+
+	      CHECK(results[i] == p_data);
+	      CHECK(results_hashed[i] == p_data);
+	      if (p_data)
+		{
+		  CHECK(p_data == &values[keys[i] / KEY_STEP]);
+		  i_found--;
+		}
+	    }
+	  CHECK(i_found == 0);
+	}
+    }
+
+  /* Keys of other sizes are other keys */
+  sizes[0] = 2;
+  sizes[1] = 0;
+  CHECK(ght_get_many(p_table, 2, sizes, pp_keys, results) == 0);
+  CHECK(!results[0] && !results[1]);
+
+  ght_finalize(p_table);
+
+  return 0;
+}
+
+/* Check that ght_insert_many() does the same as ght_insert() for
+ * every entry: The same return values, duplicates in the batch and
+ * keys already in the table included, and the same entries. Then
+ * check ght_insert_many_hashed() against ght_insert_many(). */
+static int check_insert_many(int i_engine)
+{
+  ght_hash_table_t *p_table;
+  ght_hash_table_t *p_serial;
+  unsigned int keys[2 * N_KEYS];
+  unsigned int sizes[2 * N_KEYS];
+  const void *pp_keys[2 * N_KEYS];
+  void *pp_data[2 * N_KEYS];
+  ght_uint32_t hashes[2 * N_KEYS];
+  int results[2 * N_KEYS + 1];
+  int results_hashed[2 * N_KEYS];
+  unsigned int n, i, i_inserted;
+  int b_rehash;
+
+  /* Every key, then every other key again with other data. The
+   * batches start at key 100, as the keys below are inserted before. */
+  for (i = 0; i < 2 * N_KEYS; i++)
+    {
+      unsigned int i_key = i < N_KEYS ? i : 2 * (i - N_KEYS) % N_KEYS;
+
+      keys[i] = i_key * KEY_STEP;
+      sizes[i] = sizeof(keys[i]);
+      pp_keys[i] = &keys[i];
+      pp_data[i] = i < N_KEYS ? &values[i_key] : &values[(i_key + 1) % N_KEYS];
+    }
+
+  for (b_rehash = FALSE; b_rehash <= TRUE; b_rehash++)
+    {
+      for (n = 0; n <= 2 * N_KEYS - 100; n += n < 40 ? 1 : 380)
+	{
+	  CHECK( (p_table = create_table(i_engine)) );
+	  CHECK( (p_serial = create_table(i_engine)) );
+	  ght_set_rehash(p_table, b_rehash);
+	  ght_set_rehash(p_serial, b_rehash);
+
+	  /* Some keys are in the table already */
+	  CHECK(fill_table(p_table, 0, 100) == 0);
+	  CHECK(fill_table(p_serial, 0, 100) == 0);
+
+	  results[n] = 17;
+	  i_inserted = ght_insert_many(p_table, n, pp_data + 100, sizes + 100,
+				       pp_keys + 100, results);
+	  CHECK(results[n] == 17);
+	  for (i = 0; i < n; i++)
+	    {
+	      int ret = ght_insert(p_serial, pp_data[100 + i], sizes[100 + i], pp_keys[100 + i]);
+
+	      CHECK(results[i] == ret);
+	      if (ret == 0)
+		{
+		  i_inserted--;
+		}
+	    }
+	  CHECK(i_inserted == 0);
+
+	  CHECK(ght_size(p_table) == ght_size(p_serial));
+	  for (i = 0; i < N_KEYS; i++)
+	    {
+	      unsigned int i_key = i * KEY_STEP;
+
+	      CHECK(ght_get(p_table, sizeof(i_key), &i_key) ==
+		    ght_get(p_serial, sizeof(i_key), &i_key));
+	    }
+	  ght_finalize(p_table);
+	  ght_finalize(p_serial);
+	}
+    }
+
+  /* The results may be left out */
+  CHECK( (p_table = create_table(i_engine)) );
+  CHECK(ght_insert_many(p_table, 2 * N_KEYS, pp_data, sizes, pp_keys, NULL) == N_KEYS);
+  for (i = 0; i < N_KEYS; i++)
+    {
+      CHECK(ght_get(p_table, sizes[i], pp_keys[i]) == &values[i]);
+    }
+  ght_finalize(p_table);
+
+  CHECK( (p_table = create_table(i_engine)) );
+  CHECK( (p_serial = create_table(i_engine)) );
+  ght_hash_many(p_table->fn_hash, 2 * N_KEYS, sizeof(keys[0]), keys, hashes);
+  CHECK(ght_insert_many_hashed(p_table, 2 * N_KEYS, pp_data, sizes, pp_keys,
+			       hashes, results_hashed) == N_KEYS);
+  CHECK(ght_insert_many(p_serial, 2 * N_KEYS, pp_data, sizes, pp_keys, results) == N_KEYS);
+  for (i = 0; i < 2 * N_KEYS; i++)
+    {
+      CHECK(results_hashed[i] == results[i]);
+      CHECK(ght_get(p_table, sizes[i], pp_keys[i]) == ght_get(p_serial, sizes[i], pp_keys[i]));
+    }
+  ght_finalize(p_table);
+  ght_finalize(p_serial);
+
+  return 0;
+}
+
+/* Check the _hashed functions with hash values from ght_hash_key(),
+ * of this table and of a chained one, against the plain functions */
+static int check_hashed(int i_engine)
+{
+  ght_hash_table_t *p_table;
+  ght_hash_table_t *p_other;
+  unsigned int i;
+
+  CHECK( (p_table = create_table(i_engine)) );
+  CHECK( (p_other = create_table(GHT_ENGINE_CHAINED)) );
+  ght_set_heuristics(p_table, GHT_HEURISTICS_TRANSPOSE);
+
+  for (i = 0; i < N_KEYS; i++)
+    {
+      unsigned int i_key = i * KEY_STEP;
+      ght_hash_key_t key;
+      ght_uint32_t l_hash = ght_hash_key(i % 2 ? p_table : p_other, sizeof(i_key), &i_key);
+
+      key.i_size = sizeof(i_key);
+      key.p_key = &i_key;
+      CHECK(l_hash == p_table->fn_hash(&key));
+      CHECK(!ght_get_hashed(p_table, sizeof(i_key), &i_key, l_hash));
+      CHECK(ght_insert_hashed(p_table, &values[i], sizeof(i_key), &i_key, l_hash) == 0);
+      CHECK(ght_insert_hashed(p_table, &values[i], sizeof(i_key), &i_key, l_hash) == -1);
+      CHECK(!ght_replace_hashed(p_other, &values[i], sizeof(i_key), &i_key, l_hash));
+    }
+  CHECK(ght_size(p_table) == N_KEYS);
+
+  for (i = 0; i < N_KEYS; i++)
+    {
+      unsigned int i_key = i * KEY_STEP;
+      unsigned int i_missing = i_key + 1;
+      ght_uint32_t l_hash = ght_hash_key(p_table, sizeof(i_key), &i_key);
+
+      CHECK(ght_get(p_table, sizeof(i_key), &i_key) == &values[i]);
+      CHECK(ght_get_hashed(p_table, sizeof(i_key), &i_key, l_hash) == &values[i]);
+      CHECK(!ght_get_hashed(p_table, sizeof(i_missing), &i_missing,
+			    ght_hash_key(p_table, sizeof(i_missing), &i_missing)));
+      CHECK(ght_replace_hashed(p_table, &values[N_KEYS - 1 - i], sizeof(i_key), &i_key,
+			       l_hash) == &values[i]);
+      CHECK(ght_get(p_table, sizeof(i_key), &i_key) == &values[N_KEYS - 1 - i]);
+    }
+
+  for (i = 0; i < N_KEYS; i += 2)
+    {
+      unsigned int i_key = i * KEY_STEP;
+      ght_uint32_t l_hash = ght_hash_key(p_table, sizeof(i_key), &i_key);
+
+      CHECK(ght_remove_hashed(p_table, sizeof(i_key), &i_key, l_hash) == &values[N_KEYS - 1 - i]);
+      CHECK(!ght_remove_hashed(p_table, sizeof(i_key), &i_key, l_hash));
+    }
+  CHECK(ght_size(p_table) == N_KEYS / 2);
+  for (i = 0; i < N_KEYS; i++)
+    {
+      unsigned int i_key = i * KEY_STEP;
+
+      CHECK(ght_get(p_table, sizeof(i_key), &i_key) == (i % 2 ? &values[N_KEYS - 1 - i] : NULL));
+    }
+
+  ght_finalize(p_table);
+  ght_finalize(p_other);
+
+  return 0;
+}
+
+/* Check ght_get_or_insert() and ght_upsert() for keys which are in
+ * the table and keys which are not, and that replacing data does not
+ * change the iteration order */
+static int check_upsert(int i_engine)
+{
+  ght_hash_table_t *p_table;
+  ght_iterator_t iterator;
+  unsigned int order[N_KEYS];
+  const void *p_key;
+  void *p_old;
+  void *p_e;
+  unsigned int i;
+
+  CHECK( (p_table = create_table(i_engine)) );
+
+  for (i = 0; i < N_KEYS; i++)
+    {
+      unsigned int i_key = i * KEY_STEP;
+
+      if (i % 2)
+	{
+	  CHECK(ght_get_or_insert(p_table, &values[i], sizeof(i_key), &i_key) == &values[i]);
+	}
+      else
+	{
+	  p_old = &p_old;
+	  CHECK(ght_upsert(p_table, &values[i], sizeof(i_key), &i_key, &p_old) == 0);
+	  CHECK(p_old == NULL);
+	}
+      CHECK(ght_get_or_insert(p_table, &values[0], sizeof(i_key), &i_key) == &values[i]);
+      CHECK(ght_size(p_table) == i + 1);
+    }
+
+  for (i = 0, p_e = ght_first(p_table, &iterator, &p_key); p_e; p_e = ght_next(p_table, &iterator, &p_key))
+    {
+      memcpy(&order[i++], p_key, sizeof(order[0]));
+    }
+  CHECK(i == N_KEYS);
+
+  for (i = 0; i < N_KEYS; i++)
+    {
+      unsigned int i_key = i * KEY_STEP;
+
+      CHECK(ght_upsert(p_table, &values[N_KEYS - 1 - i], sizeof(i_key), &i_key, &p_old) == 1);
+      CHECK(p_old == &values[i]);
+      CHECK(ght_upsert(p_table, &values[N_KEYS - 1 - i], sizeof(i_key), &i_key, NULL) == 1);
+      CHECK(ght_get(p_table, sizeof(i_key), &i_key) == &values[N_KEYS - 1 - i]);
+    }
+  CHECK(ght_size(p_table) == N_KEYS);
+
+  for (i = 0, p_e = ght_first(p_table, &iterator, &p_key); p_e; p_e = ght_next(p_table, &iterator, &p_key))
+    {
+      CHECK(memcmp(p_key, &order[i], sizeof(order[0])) == 0);
+      CHECK(p_e == &values[N_KEYS - 1 - order[i] / KEY_STEP]);
+      i++;
+    }
+  CHECK(i == N_KEYS);
+
+  ght_finalize(p_table);
+
+  return 0;
+}
+
+/* Check ght_find() and the handle functions: The key and data of a
+ * handle, replacing the data through it, which keeps it valid, and
+ * removing the entry */
+static int check_handles(int i_engine)
+{
+  ght_hash_table_t *p_table;
+  ght_handle_t handle;
+  unsigned int i_size;
+  unsigned int i;
+
+  CHECK( (p_table = create_table(i_engine)) );
+  ght_set_heuristics(p_table, GHT_HEURISTICS_MOVE_TO_FRONT);
+  CHECK(fill_table(p_table, 0, N_KEYS) == 0);
+
+  for (i = 0; i < N_KEYS; i++)
+    {
+      unsigned int i_key = i * KEY_STEP;
+      unsigned int i_missing = i_key + 1;
+      ght_handle_t untouched;
+
+      memset(&untouched, 0xa5, sizeof(untouched));
+      memcpy(&handle, &untouched, sizeof(handle));
+      CHECK(!ght_find(p_table, sizeof(i_missing), &i_missing, &handle));
+      CHECK(memcmp(&handle, &untouched, sizeof(handle)) == 0);
+
+      CHECK(ght_find(p_table, sizeof(i_key), &i_key, &handle) == &values[i]);
+      CHECK(ght_handle_data(p_table, &handle) == &values[i]);
+      i_size = 0;
+      CHECK(memcmp(ght_handle_key(p_table, &handle, &i_size), &i_key, sizeof(i_key)) == 0);
+      CHECK(i_size == sizeof(i_key));
+      CHECK(ght_handle_key(p_table, &handle, NULL) == ght_handle_key(p_table, &handle, &i_size));
+
+      switch (i % 3)
+	{
+	case 0:
+	  CHECK(ght_handle_remove(p_table, &handle) == &values[i]);
+	  CHECK(!ght_find(p_table, sizeof(i_key), &i_key, &handle));
+	  break;
+	case 1:
+	  CHECK(ght_handle_replace(p_table, &handle, &values[0]) == &values[i]);
+	  CHECK(ght_handle_data(p_table, &handle) == &values[0]);
+	  CHECK(ght_handle_replace(p_table, &handle, &values[N_KEYS - 1 - i]) == &values[0]);
+	  CHECK(ght_handle_remove(p_table, &handle) == &values[N_KEYS - 1 - i]);
+	  CHECK(ght_insert(p_table, &values[N_KEYS - 1 - i], sizeof(i_key), &i_key) == 0);
+	  break;
+	default:
+	  break;
+	}
+    }
+
+  CHECK(ght_size(p_table) == N_KEYS - (N_KEYS + 2) / 3);
+  for (i = 0; i < N_KEYS; i++)
+    {
+      unsigned int i_key = i * KEY_STEP;
+      void *p_expected = i % 3 == 0 ? NULL : i % 3 == 1 ? &values[N_KEYS - 1 - i] : &values[i];
+
+      CHECK(ght_get(p_table, sizeof(i_key), &i_key) == p_expected);
+      CHECK(ght_find(p_table, sizeof(i_key), &i_key, &handle) == p_expected);
+    }
+
+  ght_finalize(p_table);
+
+  return 0;
+}
+
+/* The predicate of check_remove(), which removes the keys which are
+ * multiples of *p_ctx and counts the calls for every key in seen */
+static unsigned char seen[N_KEYS];
+
+static int remove_multiples(void *p_ctx, void *p_data, const void *p_key,
+			    unsigned int i_key_size)
+{
+  unsigned int i_key;
+
+  memcpy(&i_key, p_key, sizeof(i_key));
+  if (i_key_size != sizeof(i_key) || p_data != &values[i_key / KEY_STEP])
+    {
+      /* Counted twice, so that the check of seen fails */
+      seen[0] += 2;
+    }
+  seen[i_key / KEY_STEP]++;
+
+  return (i_key / KEY_STEP) % *(unsigned int*)p_ctx == 0;
+}
+
+/* Check ght_iterator_remove() and ght_remove_if(): Every entry is
+ * seen once, and exactly the ones which should be are removed */
+static int check_remove(int i_engine)
+{
+  ght_hash_table_t *p_table;
+  ght_iterator_t iterator;
+  const void *p_key;
+  unsigned int i_key;
+  unsigned int i_every;
+  void *p_e;
+  unsigned int i;
+
+  for (i_every = 1; i_every <= 3; i_every++)
+    {
+      CHECK( (p_table = create_table(i_engine)) );
+      CHECK(fill_table(p_table, 0, N_KEYS) == 0);
+
+      /* Remove the current entry for every i_every:th key, so all of
+       * them the first time */
+      memset(seen, 0, sizeof(seen));
+      for (p_e = ght_first(p_table, &iterator, &p_key); p_e; p_e = ght_next(p_table, &iterator, &p_key))
+	{
+	  memcpy(&i_key, p_key, sizeof(i_key));
+	  CHECK(p_e == &values[i_key / KEY_STEP]);
+	  seen[i_key / KEY_STEP]++;
+	  if ((i_key / KEY_STEP) % i_every == 0)
+	    {
+	      CHECK(ght_iterator_remove(p_table, &iterator) == p_e);
+	      CHECK(!ght_get(p_table, sizeof(i_key), &i_key));
+	    }
+	}
+      for (i = 0; i < N_KEYS; i++)
+	{
+	  i_key = i * KEY_STEP;
+	  CHECK(seen[i] == 1);
+	  CHECK(ght_get(p_table, sizeof(i_key), &i_key) == (i % i_every ? &values[i] : NULL));
+	}
+      CHECK(ght_size(p_table) == N_KEYS - (N_KEYS + i_every - 1) / i_every);
+
+      /* Put them back and remove them with ght_remove_if() */
+      for (i = 0; i < N_KEYS; i += i_every)
+	{
+	  CHECK(fill_table(p_table, i, i + 1) == 0);
+	}
+      memset(seen, 0, sizeof(seen));
+      CHECK(ght_remove_if(p_table, remove_multiples, &i_every) == (N_KEYS + i_every - 1) / i_every);
+      for (i = 0; i < N_KEYS; i++)
+	{
+	  i_key = i * KEY_STEP;
+	  CHECK(seen[i] == 1);
+	  CHECK(ght_get(p_table, sizeof(i_key), &i_key) == (i % i_every ? &values[i] : NULL));
+	}
+
+      /* Nothing is left to remove, and an empty table calls nothing */
+      memset(seen, 0, sizeof(seen));
+      CHECK(ght_remove_if(p_table, remove_multiples, &i_every) == 0);
+      if (i_every == 1)
+	{
+	  CHECK(ght_size(p_table) == 0);
+	  CHECK(!ght_first(p_table, &iterator, &p_key));
+	  for (i = 0; i < N_KEYS; i++)
+	    {
+	      CHECK(seen[i] == 0);
+	    }
+	}
+      ght_finalize(p_table);
+    }
+
+  return 0;
+}
+
+/* An allocator which counts the memory it has handed out */
+static void *counting_alloc(void *p_ctx, size_t size)
+{
+  *(size_t*)p_ctx += size;
+
+  return malloc(size);
+}
+
+static void counting_free(void *p_ctx, void *ptr, size_t size)
+{
+  *(size_t*)p_ctx -= size;
+  free(ptr);
+}
+
+static const ght_allocator_t counting_allocator = { counting_alloc, counting_free, NULL };
+
+/* Check that the pool can only be switched on and off while the table
+ * is empty, and that the table works after every switch, also when
+ * the pool is replaced by another allocator */
+static int check_pool(int i_engine)
+{
+  ght_hash_table_t *p_table;
+  size_t i_allocated = 0;
+  unsigned int i;
+  int i_switch;
+
+  CHECK( (p_table = create_table(i_engine)) );
+  for (i_switch = 0; i_switch < 5; i_switch++)
+    {
+      CHECK(ght_set_pool(p_table, i_switch % 2 == 0) == 0);
+      CHECK(ght_set_pool(p_table, i_switch % 2 == 0) == 0);
+      CHECK(fill_table(p_table, 0, N_KEYS) == 0);
+      CHECK(ght_set_pool(p_table, i_switch % 2 != 0) == -1);
+      for (i = 0; i < N_KEYS; i++)
+	{
+	  unsigned int i_key = i * KEY_STEP;
+
+	  CHECK(ght_get(p_table, sizeof(i_key), &i_key) == &values[i]);
+	  CHECK(ght_remove(p_table, sizeof(i_key), &i_key) == &values[i]);
+	}
+      CHECK(ght_size(p_table) == 0);
+    }
+
+  /* The table uses the pool now, which is released for the allocator.
+   * The chained entries are always allocated. */
+  CHECK(ght_set_allocator(p_table, &counting_allocator, &i_allocated) == 0);
+  CHECK(fill_table(p_table, 0, N_KEYS) == 0);
+  if (i_engine == GHT_ENGINE_CHAINED)
+    {
+      CHECK(i_allocated > 0);
+    }
+  CHECK(ght_set_pool(p_table, TRUE) == -1);
+  for (i = 0; i < N_KEYS; i += 2)
+    {
+      unsigned int i_key = i * KEY_STEP;
+
+      CHECK(ght_remove(p_table, sizeof(i_key), &i_key) == &values[i]);
+    }
+  ght_finalize(p_table);
+  CHECK(i_allocated == 0);
+
+  return 0;
+}
+
+/* Run the checks of the API on a table with an engine */
+static int check_engine(int i_engine)
+{
+  if (check_get_many(i_engine) < 0 ||
+      check_insert_many(i_engine) < 0 ||
+      check_hashed(i_engine) < 0 ||
+      check_upsert(i_engine) < 0 ||
+      check_handles(i_engine) < 0 ||
+      check_remove(i_engine) < 0)
+    {
+      return -1;
+    }
+
+  return 0;
+}
+
 int main(int argc, char *argv[])
 {
   ght_hash_table_t *p_table;
   ght_hash_table_t *p_table2;
   ght_iterator_t iterator;
   int i_loops = 100000;
+  int i_engine = GHT_ENGINE_CHAINED;
   int i_removed = 0;
   const void *p_key;
   void *p_e;
@@ -51,17 +678,48 @@ int main(int argc, char *argv[])
   /* Initialise the random seed */
   srand(1000);
 
+  /* The deterministic checks of the API */
+  if (check_hash_many() < 0)
+    {
+      return -1;
+    }
+  for (b_use_pool = FALSE; b_use_pool <= TRUE; b_use_pool++)
+    {
+      for (i = 0; i < N_ENGINES; i++)
+	{
+	  if (check_engine(i) < 0)
+	    {
+	      printf("Failed with engine %d%s\n", i, b_use_pool ? " and the pool" : "");
+	      return -1;
+	    }
+	}
+    }
+  for (i = 0; i < N_ENGINES; i++)
+    {
+      if (check_pool(i) < 0)
+	{
+	  printf("Failed with engine %d\n", i);
+	  return -1;
+	}
+    }
+  printf("API checks OK\n");
+
   if (argc > 1)
     {
+      /* Usage: hash_test [size [loops [engine]]], where engine is one
+       * of the GHT_ENGINE_* numbers (for example 4 for
+       * GHT_ENGINE_BLOCK_CHAINED). */
+      if (argc > 2)
+	i_loops = atoi(argv[2]);
+      if (argc > 3)
+	i_engine = atoi(argv[3]);
+
       /* Create two hash table with move to front heuristics, specifying the size for one. Both use automatic rehashing  */
-      p_table = ght_create(atoi(argv[1]));
+      p_table = ght_create_ex(atoi(argv[1]), i_engine);
       ght_set_rehash(p_table, TRUE);
       ght_set_heuristics(p_table, GHT_HEURISTICS_MOVE_TO_FRONT);
 
-      if (argc > 2)
-	i_loops = atoi(argv[2]);
-
-      p_table2 = ght_create(5000);
+      p_table2 = ght_create_ex(5000, i_engine);
 
       ght_set_rehash(p_table2, TRUE);
       ght_set_heuristics(p_table2, GHT_HEURISTICS_MOVE_TO_FRONT);
@@ -69,7 +727,7 @@ int main(int argc, char *argv[])
   else
     {
       /* Create two hash table with transpose heuristics, size
-	 5000. Hash function is one_at_a_time_hash (default with NULL).
+	 5000. Hash function is wy_hash (the default).
       */
       p_table = ght_create(5000);
       ght_set_rehash(p_table, FALSE);
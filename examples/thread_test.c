@@ -0,0 +1,727 @@
+/*********************************************************************
+ *
+ * Copyright (C) 2001-2005,  Simon Kagstrom
+ *
+ * Filename:      thread_test.c
+ * Description:   Checks of the tables which are used by several
+ *                threads, against the same work done by one thread.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ ********************************************************************/
+
+#include <stdlib.h> /* atoi */
+#include <string.h> /* memcmp */
+#include <stdio.h>  /* printf, perror */
+#ifndef _WIN32
+#include <pthread.h> /* pthread_create */
+#endif
+
+#include "ght_hash_table.h"
+
+#ifndef _WIN32
+
+/* The checks return -1 and tell which check failed as soon as one
+ * does */
+#define CHECK(expr) \
+  do \
+    { \
+      if (!(expr)) \
+	{ \
+	  printf("%s:%d: Check failed: %s\n", __FILE__, __LINE__, #expr); \
+	  return -1; \
+	} \
+    } while (0)
+
+/*
+ * Every thread has N_KEYS keys of its own, thread i the keys from
+ * i * N_KEYS up to (i + 1) * N_KEYS - 1. The keys from
+ * MAX_THREADS * N_KEYS up to N_ALL_KEYS - 1 are shared by all
+ * threads. The data of key k is &values[k].
+ */
+#define MAX_THREADS 16
+#define N_KEYS      4000
+#define N_SHARED    1000
+#define N_ALL_KEYS  (MAX_THREADS * N_KEYS + N_SHARED)
+static int values[N_ALL_KEYS];
+
+/* The context of a thread */
+typedef struct
+{
+  ght_hash_table_t *p_table;
+  ght_sharded_t *p_sharded;       /* The table of the sharded tests */
+  unsigned int i_thread;
+  int i_mode;                     /* What the thread does, see the tests */
+  void *shared[N_SHARED];         /* What the thread got for the shared keys */
+  unsigned int i_inserted;        /* How many of them it inserted */
+  int ret;                        /* 0, or -1 if a check failed */
+} thread_ctx_t;
+
+typedef int (*thread_fn_t)(thread_ctx_t *p_ctx);
+static thread_fn_t thread_fn;
+
+static void *thread_main(void *p_arg)
+{
+  thread_ctx_t *p_ctx = (thread_ctx_t*)p_arg;
+
+  p_ctx->ret = thread_fn(p_ctx);
+
+  return NULL;
+}
+
+/* Run fn in i_threads threads on p_table, and return -1 if any of
+ * them failed. The mode of thread i is fn_mode(i), or 0 without
+ * fn_mode. */
+static int run_threads(ght_hash_table_t *p_table, unsigned int i_threads,
+		       thread_fn_t fn, thread_ctx_t *p_ctx, int (*fn_mode)(unsigned int))
+{
+  pthread_t threads[MAX_THREADS];
+  unsigned int i_started;
+  unsigned int i;
+
+  thread_fn = fn;
+  for (i_started = 0; i_started < i_threads; i_started++)
+    {
+      thread_ctx_t *p_thread = &p_ctx[i_started];
+
+      p_thread->p_table = p_table;
+      p_thread->i_thread = i_started;
+      p_thread->i_mode = fn_mode ? fn_mode(i_started) : 0;
+      p_thread->i_inserted = 0;
+      p_thread->ret = 0;
+      if (pthread_create(&threads[i_started], NULL, thread_main, p_thread) != 0)
+	{
+	  perror("pthread_create");
+	  break;
+	}
+    }
+  for (i = 0; i < i_started; i++)
+    {
+      pthread_join(threads[i], NULL);
+    }
+  CHECK(i_started == i_threads);
+  for (i = 0; i < i_threads; i++)
+    {
+      CHECK(p_ctx[i].ret == 0);
+    }
+
+  return 0;
+}
+
+/* Check that two tables have the same entries in the same order */
+static int check_same(ght_hash_table_t *p_table, ght_hash_table_t *p_reference)
+{
+  ght_iterator_t iterator;
+  ght_iterator_t ref_iterator;
+  const void *p_key;
+  const void *p_ref_key;
+  void *p_e;
+  void *p_ref;
+
+  CHECK(ght_size(p_table) == ght_size(p_reference));
+  for (p_e = ght_first(p_table, &iterator, &p_key), p_ref = ght_first(p_reference, &ref_iterator, &p_ref_key);
+       p_e || p_ref;
+       p_e = ght_next(p_table, &iterator, &p_key), p_ref = ght_next(p_reference, &ref_iterator, &p_ref_key))
+    {
+      CHECK(p_e == p_ref);
+      CHECK(memcmp(p_key, p_ref_key, sizeof(unsigned int)) == 0);
+      CHECK(ght_get(p_table, sizeof(unsigned int), p_key) == p_e);
+    }
+
+  return 0;
+}
+
+/* Check that a table has exactly the entries of a reference table,
+ * in any order */
+static int check_same_entries(ght_hash_table_t *p_table, ght_hash_table_t *p_reference)
+{
+  ght_iterator_t iterator;
+  const void *p_key;
+  void *p_e;
+  unsigned int i_items = 0;
+
+  CHECK(ght_size(p_table) == ght_size(p_reference));
+  for (p_e = ght_first(p_table, &iterator, &p_key); p_e; p_e = ght_next(p_table, &iterator, &p_key))
+    {
+      CHECK(ght_get(p_reference, sizeof(unsigned int), p_key) == p_e);
+      i_items++;
+    }
+  CHECK(i_items == ght_size(p_reference));
+
+  return 0;
+}
+
+
+/*
+ * ght_set_concurrent(): The threads insert, look up, replace and
+ * remove their own keys, and look up the keys of the next thread,
+ * which are either missing or have the right data. The odd keys are
+ * left, as a reference table filled by one thread has them. Then all
+ * threads get or insert the shared keys, and every key must have been
+ * inserted by one thread and seen with the same data by all.
+ */
+static int concurrent_thread(thread_ctx_t *p_ctx)
+{
+  ght_hash_table_t *p_table = p_ctx->p_table;
+  unsigned int i_first = p_ctx->i_thread * N_KEYS;
+  unsigned int i_next = (p_ctx->i_thread + 1) % MAX_THREADS * N_KEYS;
+  unsigned int i_round, i;
+
+  for (i_round = 0; i_round < 3; i_round++)
+    {
+      for (i = 0; i < N_KEYS; i++)
+	{
+	  unsigned int i_key = i_first + i;
+	  unsigned int i_other = i_next + (i * 7) % N_KEYS;
+	  void *p_other;
+
+	  CHECK(ght_get_or_insert(p_table, &values[i_key], sizeof(i_key), &i_key) == &values[i_key]);
+	  p_other = ght_get(p_table, sizeof(i_other), &i_other);
+	  CHECK(!p_other || p_other == &values[i_other]);
+	}
+      for (i = 0; i < N_KEYS; i++)
+	{
+	  unsigned int i_key = i_first + i;
+	  void *p_old;
+
+	  CHECK(ght_get(p_table, sizeof(i_key), &i_key) == &values[i_key]);
+	  if (i % 2 == 0)
+	    {
+	      CHECK(ght_remove(p_table, sizeof(i_key), &i_key) == &values[i_key]);
+	      CHECK(!ght_get(p_table, sizeof(i_key), &i_key));
+	    }
+	  else if (i % 4 == 1)
+	    {
+	      CHECK(ght_replace(p_table, &values[i_key], sizeof(i_key), &i_key) == &values[i_key]);
+	    }
+	  else
+	    {
+	      CHECK(ght_upsert(p_table, &values[i_key], sizeof(i_key), &i_key, &p_old) == 1);
+	      CHECK(p_old == &values[i_key]);
+	    }
+	}
+    }
+
+  for (i = 0; i < N_SHARED; i++)
+    {
+      unsigned int i_shared = (i + p_ctx->i_thread * 97) % N_SHARED;
+      unsigned int i_key = MAX_THREADS * N_KEYS + i_shared;
+      void *p_data = &values[(p_ctx->i_thread * N_SHARED + i_shared) % (MAX_THREADS * N_KEYS)];
+
+      p_ctx->shared[i_shared] = ght_get_or_insert(p_table, p_data, sizeof(i_key), &i_key);
+      CHECK(p_ctx->shared[i_shared]);
+      if (p_ctx->shared[i_shared] == p_data)
+	{
+	  p_ctx->i_inserted++;
+	}
+    }
+
+  return 0;
+}
+
+static int test_concurrent(unsigned int i_threads)
+{
+  thread_ctx_t *p_ctx;
+  ght_hash_table_t *p_table;
+  ght_hash_table_t *p_reference;
+  int i_heuristics;
+  unsigned int i, j, i_inserted;
+
+  CHECK( (p_ctx = (thread_ctx_t*)malloc(i_threads * sizeof(thread_ctx_t))) );
+  for (i_heuristics = GHT_HEURISTICS_NONE; i_heuristics <= GHT_HEURISTICS_MOVE_TO_FRONT; i_heuristics++)
+    {
+      CHECK( (p_table = ght_create(16)) );
+      ght_set_rehash(p_table, TRUE);
+      ght_set_heuristics(p_table, i_heuristics);
+      CHECK(ght_set_concurrent(p_table, 32) == 0);
+      CHECK(run_threads(p_table, i_threads, concurrent_thread, p_ctx, NULL) == 0);
+
+      /* The shared keys */
+      for (i = 0, i_inserted = 0; i < i_threads; i++)
+	{
+	  for (j = 0; j < N_SHARED; j++)
+	    {
+	      unsigned int i_key = MAX_THREADS * N_KEYS + j;
+
+	      CHECK(p_ctx[i].shared[j] == p_ctx[0].shared[j]);
+	      CHECK(ght_remove(p_table, sizeof(i_key), &i_key) == (i == 0 ? p_ctx[0].shared[j] : NULL));
+	    }
+	  i_inserted += p_ctx[i].i_inserted;
+	}
+      CHECK(i_inserted == N_SHARED);
+
+      /* The odd keys of every thread are left */
+      CHECK( (p_reference = ght_create(16)) );
+      for (i = 0; i < i_threads * N_KEYS; i += 2)
+	{
+	  unsigned int i_key = i + 1;
+
+	  CHECK(ght_insert(p_reference, &values[i_key], sizeof(i_key), &i_key) == 0);
+	}
+      CHECK(check_same_entries(p_table, p_reference) == 0);
+
+      ght_finalize(p_reference);
+      ght_finalize(p_table);
+    }
+  free(p_ctx);
+
+  return 0;
+}
+
+
+/*
+ * ght_set_lockfree_reads(): The even threads are registered readers,
+ * which keep looking up a set of keys which is never changed, and the
+ * keys of the odd threads, while the odd threads insert and remove
+ * their keys so that the table is rehashed under the readers. A reader
+ * must find every stable key, and the other keys either missing or
+ * with the right data.
+ */
+#define N_STABLE N_SHARED
+
+static int lockfree_mode(unsigned int i_thread)
+{
+  return i_thread % 2 == 0;
+}
+
+static int lockfree_thread(thread_ctx_t *p_ctx)
+{
+  ght_hash_table_t *p_table = p_ctx->p_table;
+  unsigned int i_first = p_ctx->i_thread * N_KEYS;
+  unsigned int i_round, i;
+
+  if (p_ctx->i_mode)
+    {
+      unsigned int i_next = (p_ctx->i_thread + 1) * N_KEYS;
+
+      CHECK(ght_reader_register() == 0);
+      for (i_round = 0; i_round < 20; i_round++)
+	{
+	  for (i = 0; i < N_STABLE; i++)
+	    {
+	      unsigned int i_key = MAX_THREADS * N_KEYS + i;
+	      unsigned int i_other = i_next + (i * 7 + i_round) % N_KEYS;
+	      void *p_other;
+
+	      CHECK(ght_get(p_table, sizeof(i_key), &i_key) == &values[i_key]);
+	      p_other = ght_get(p_table, sizeof(i_other), &i_other);
+	      CHECK(!p_other || p_other == &values[i_other]);
+	      if (i % 64 == 0)
+		{
+		  ght_quiescent();
+		}
+	    }
+	}
+      ght_reader_unregister();
+
+      return 0;
+    }
+
+  for (i_round = 0; i_round < 3; i_round++)
+    {
+      for (i = 0; i < N_KEYS; i++)
+	{
+	  unsigned int i_key = i_first + i;
+
+	  CHECK(ght_insert(p_table, &values[i_key], sizeof(i_key), &i_key) == (i_round > 0 && i % 2 ? -1 : 0));
+	}
+      for (i = 0; i < N_KEYS; i += 2)
+	{
+	  unsigned int i_key = i_first + i;
+
+	  CHECK(ght_remove(p_table, sizeof(i_key), &i_key) == &values[i_key]);
+	}
+      if (p_ctx->i_thread == 1)
+	{
+	  /* Grow the table with all stripes locked as well */
+	  ght_rehash(p_table, 2 * ght_table_size(p_table));
+	}
+    }
+
+  return 0;
+}
+
+static int test_lockfree(unsigned int i_threads)
+{
+  thread_ctx_t *p_ctx;
+  ght_hash_table_t *p_table;
+  ght_hash_table_t *p_reference;
+  unsigned int i;
+
+  if (i_threads < 2)
+    {
+      i_threads = 2;
+    }
+  CHECK( (p_ctx = (thread_ctx_t*)malloc(i_threads * sizeof(thread_ctx_t))) );
+  CHECK( (p_table = ght_create(16)) );
+  CHECK( (p_reference = ght_create(16)) );
+  ght_set_rehash(p_table, TRUE);
+  CHECK(ght_set_concurrent(p_table, 16) == 0);
+  CHECK(ght_set_lockfree_reads(p_table, TRUE) == 0);
+  for (i = MAX_THREADS * N_KEYS; i < N_ALL_KEYS; i++)
+    {
+      CHECK(ght_insert(p_table, &values[i], sizeof(i), &i) == 0);
+      CHECK(ght_insert(p_reference, &values[i], sizeof(i), &i) == 0);
+    }
+
+  CHECK(run_threads(p_table, i_threads, lockfree_thread, p_ctx, lockfree_mode) == 0);
+
+  /* The odd keys of the writers are left */
+  for (i = 1; i < i_threads; i += 2)
+    {
+      unsigned int j;
+
+      for (j = 1; j < N_KEYS; j += 2)
+	{
+	  unsigned int i_key = i * N_KEYS + j;
+
+	  CHECK(ght_insert(p_reference, &values[i_key], sizeof(i_key), &i_key) == 0);
+	}
+    }
+  CHECK(check_same_entries(p_table, p_reference) == 0);
+
+  ght_finalize(p_reference);
+  ght_finalize(p_table);
+  free(p_ctx);
+
+  return 0;
+}
+
+
+/*
+ * ght_sharded_create(): The threads insert their keys into a sharded
+ * table while looking up the keys of the next thread, and then remove
+ * every other key. After each step the size, the number of buckets
+ * and the entries must be those of a sharded table which one thread
+ * has done the same to. The shards only grow on inserts, so their
+ * sizes do not depend on the order of the inserts.
+ */
+static int sharded_insert_thread(thread_ctx_t *p_ctx)
+{
+  ght_sharded_t *p_sh = p_ctx->p_sharded;
+  unsigned int i_first = p_ctx->i_thread * N_KEYS;
+  unsigned int i_next = (p_ctx->i_thread + 1) % MAX_THREADS * N_KEYS;
+  unsigned int i;
+
+  for (i = 0; i < N_KEYS; i++)
+    {
+      unsigned int i_key = i_first + i;
+      unsigned int i_other = i_next + (i * 7) % N_KEYS;
+      void *p_other;
+
+      CHECK(ght_sharded_insert(p_sh, &values[i_key], sizeof(i_key), &i_key) == 0);
+      CHECK(ght_sharded_insert(p_sh, &values[0], sizeof(i_key), &i_key) == -1);
+      CHECK(ght_sharded_get(p_sh, sizeof(i_key), &i_key) == &values[i_key]);
+      p_other = ght_sharded_get(p_sh, sizeof(i_other), &i_other);
+      CHECK(!p_other || p_other == &values[i_other]);
+    }
+
+  return 0;
+}
+
+static int sharded_remove_thread(thread_ctx_t *p_ctx)
+{
+  ght_sharded_t *p_sh = p_ctx->p_sharded;
+  unsigned int i_first = p_ctx->i_thread * N_KEYS;
+  unsigned int i;
+
+  for (i = 0; i < N_KEYS; i++)
+    {
+      unsigned int i_key = i_first + i;
+
+      if (i % 2 == 0)
+	{
+	  CHECK(ght_sharded_remove(p_sh, sizeof(i_key), &i_key) == &values[i_key]);
+	  CHECK(!ght_sharded_remove(p_sh, sizeof(i_key), &i_key));
+	  CHECK(!ght_sharded_get(p_sh, sizeof(i_key), &i_key));
+	}
+      else
+	{
+	  CHECK(ght_sharded_get(p_sh, sizeof(i_key), &i_key) == &values[i_key]);
+	}
+    }
+
+  return 0;
+}
+
+/* Check that a sharded table has the entries and the number of buckets
+ * of a reference */
+static int check_same_sharded(ght_sharded_t *p_sh, ght_sharded_t *p_reference)
+{
+  ght_sharded_iterator_t iterator;
+  const void *p_key;
+  unsigned int i_size;
+  unsigned int i_items = 0;
+  void *p_e;
+
+  CHECK(ght_sharded_size(p_sh) == ght_sharded_size(p_reference));
+  CHECK(ght_sharded_table_size(p_sh) == ght_sharded_table_size(p_reference));
+  for (p_e = ght_sharded_first(p_sh, &iterator, &p_key, &i_size); p_e;
+       p_e = ght_sharded_next(p_sh, &iterator, &p_key, &i_size))
+    {
+      CHECK(i_size == sizeof(unsigned int));
+      CHECK(ght_sharded_get(p_reference, i_size, p_key) == p_e);
+      i_items++;
+    }
+  CHECK(i_items == ght_sharded_size(p_reference));
+
+  return 0;
+}
+
+static int test_sharded(unsigned int i_threads)
+{
+  thread_ctx_t *p_ctx;
+  ght_sharded_t *p_sh;
+  ght_sharded_t *p_reference;
+  unsigned int i;
+
+  CHECK( (p_ctx = (thread_ctx_t*)malloc(i_threads * sizeof(thread_ctx_t))) );
+  CHECK( (p_sh = ght_sharded_create(8, 64)) );
+  CHECK( (p_reference = ght_sharded_create(8, 64)) );
+  for (i = 0; i < i_threads; i++)
+    {
+      p_ctx[i].p_sharded = p_sh;
+    }
+
+  CHECK(run_threads(NULL, i_threads, sharded_insert_thread, p_ctx, NULL) == 0);
+  for (i = 0; i < i_threads * N_KEYS; i++)
+    {
+      CHECK(ght_sharded_insert(p_reference, &values[i], sizeof(i), &i) == 0);
+    }
+  CHECK(ght_sharded_size(p_sh) == i_threads * N_KEYS);
+  CHECK(check_same_sharded(p_sh, p_reference) == 0);
+
+  CHECK(run_threads(NULL, i_threads, sharded_remove_thread, p_ctx, NULL) == 0);
+  for (i = 0; i < i_threads * N_KEYS; i += 2)
+    {
+      CHECK(ght_sharded_remove(p_reference, sizeof(i), &i) == &values[i]);
+    }
+  CHECK(ght_sharded_size(p_sh) == i_threads * N_KEYS / 2);
+  CHECK(check_same_sharded(p_sh, p_reference) == 0);
+
+  ght_sharded_finalize(p_reference);
+  ght_sharded_finalize(p_sh);
+  free(p_ctx);
+
+  return 0;
+}
+
+
+/* Fill a table with keys in a scattered order, removing some of them */
+static int fill_scattered(ght_hash_table_t *p_table, unsigned int n)
+{
+  unsigned int i;
+
+  for (i = 0; i < n; i++)
+    {
+      unsigned int i_key = (i * 40503u) % (MAX_THREADS * N_KEYS);
+
+      CHECK(ght_insert(p_table, &values[i_key], sizeof(i_key), &i_key) == 0);
+      if (i % 5 == 4)
+	{
+	  i_key = ((i - 2) * 40503u) % (MAX_THREADS * N_KEYS);
+	  CHECK(ght_remove(p_table, sizeof(i_key), &i_key) == &values[i_key]);
+	}
+    }
+
+  return 0;
+}
+
+/*
+ * ght_rehash_parallel(): The same table is rehashed with ght_rehash()
+ * and ght_rehash_parallel() to larger and smaller sizes, on every
+ * engine, also while an incremental rehash is going on, and the tables
+ * must stay the same. The tables are large enough to be split among
+ * the threads.
+ */
+static int test_rehash_parallel(unsigned int i_threads)
+{
+  unsigned int sizes[] = { 2 * 65536, 16384, 65536, 1000, 4 * 65536 };
+  int i_engine;
+  int b_incremental;
+  unsigned int i;
+
+  for (i_engine = GHT_ENGINE_CHAINED; i_engine <= GHT_ENGINE_SLIM_UNORDERED; i_engine++)
+    {
+      for (b_incremental = FALSE; b_incremental <= (i_engine == GHT_ENGINE_CHAINED); b_incremental++)
+	{
+	  ght_hash_table_t *p_table = ght_create_ex(1024, i_engine);
+	  ght_hash_table_t *p_serial = ght_create_ex(1024, i_engine);
+
+	  CHECK(p_table && p_serial);
+	  ght_set_rehash(p_table, TRUE);
+	  ght_set_rehash(p_serial, TRUE);
+	  ght_set_incremental_rehash(p_table, b_incremental);
+	  ght_set_incremental_rehash(p_serial, b_incremental);
+	  CHECK(fill_scattered(p_table, MAX_THREADS * N_KEYS) == 0);
+	  CHECK(fill_scattered(p_serial, MAX_THREADS * N_KEYS) == 0);
+
+	  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	    {
+	      ght_rehash(p_serial, sizes[i]);
+	      ght_rehash_parallel(p_table, sizes[i], i_threads);
+	      CHECK(ght_table_size(p_table) == ght_table_size(p_serial));
+	      CHECK(check_same(p_table, p_serial) == 0);
+	    }
+	  ght_finalize(p_table);
+	  ght_finalize(p_serial);
+	}
+    }
+
+  return 0;
+}
+
+
+/*
+ * ght_insert_many_parallel(): Batches are inserted with
+ * ght_insert_many() and with ght_insert_many_parallel() into tables
+ * which already have some of the keys. The batches also have keys
+ * more than once, and the return values and the tables must be the
+ * same.
+ */
+static int test_insert_many_parallel(unsigned int i_threads)
+{
+  unsigned int counts[] = { 0, 1, 100, 8192, MAX_THREADS * N_KEYS, 2 * MAX_THREADS * N_KEYS };
+  unsigned int *p_keys;
+  unsigned int *p_sizes;
+  const void **pp_keys;
+  void **pp_data;
+  int *p_results;
+  int *p_serial_results;
+  int b_rehash;
+  unsigned int c, i;
+
+  CHECK( (p_keys = (unsigned int*)malloc(2 * MAX_THREADS * N_KEYS * sizeof(unsigned int))) );
+  CHECK( (p_sizes = (unsigned int*)malloc(2 * MAX_THREADS * N_KEYS * sizeof(unsigned int))) );
+  CHECK( (pp_keys = (const void**)malloc(2 * MAX_THREADS * N_KEYS * sizeof(void*))) );
+  CHECK( (pp_data = (void**)malloc(2 * MAX_THREADS * N_KEYS * sizeof(void*))) );
+  CHECK( (p_results = (int*)malloc(2 * MAX_THREADS * N_KEYS * sizeof(int))) );
+  CHECK( (p_serial_results = (int*)malloc(2 * MAX_THREADS * N_KEYS * sizeof(int))) );
+
+  /* Every third entry repeats a key from earlier in the batch, with
+   * other data */
+  for (i = 0; i < 2 * MAX_THREADS * N_KEYS; i++)
+    {
+      p_keys[i] = i % 3 == 2 ? p_keys[i / 2] : (i * 40503u) % (MAX_THREADS * N_KEYS);
+      p_sizes[i] = sizeof(p_keys[i]);
+      pp_keys[i] = &p_keys[i];
+      pp_data[i] = &values[i % 3 == 2 ? N_ALL_KEYS - 1 - i % N_SHARED : p_keys[i]];
+    }
+
+  for (b_rehash = FALSE; b_rehash <= TRUE; b_rehash++)
+    {
+      for (c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+	{
+	  /* A table which is not rehashed starts large enough */
+	  ght_hash_table_t *p_table = ght_create(b_rehash ? 64 : 65536);
+	  ght_hash_table_t *p_serial = ght_create(b_rehash ? 64 : 65536);
+	  unsigned int n = counts[c];
+
+	  CHECK(p_table && p_serial);
+	  ght_set_rehash(p_table, b_rehash);
+	  ght_set_rehash(p_serial, b_rehash);
+	  for (i = 0; i < 1000; i++)
+	    {
+	      unsigned int i_key = i * 3;
+
+	      CHECK(ght_insert(p_table, &values[i_key], sizeof(i_key), &i_key) == 0);
+	      CHECK(ght_insert(p_serial, &values[i_key], sizeof(i_key), &i_key) == 0);
+	    }
+
+	  CHECK(ght_insert_many_parallel(p_table, n, pp_data, p_sizes, pp_keys, p_results, i_threads) ==
+		ght_insert_many(p_serial, n, pp_data, p_sizes, pp_keys, p_serial_results));
+	  CHECK(memcmp(p_results, p_serial_results, n * sizeof(int)) == 0);
+	  CHECK(ght_table_size(p_table) == ght_table_size(p_serial));
+	  CHECK(check_same(p_table, p_serial) == 0);
+
+	  /* The results may be left out */
+	  CHECK(ght_insert_many_parallel(p_table, n, pp_data, p_sizes, pp_keys, NULL, i_threads) == 0);
+	  CHECK(check_same(p_table, p_serial) == 0);
+
+	  ght_finalize(p_table);
+	  ght_finalize(p_serial);
+	}
+    }
+
+  free(p_keys);
+  free(p_sizes);
+  free(pp_keys);
+  free(pp_data);
+  free(p_results);
+  free(p_serial_results);
+
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  unsigned int i_threads = 4;
+
+  /* Usage: thread_test [threads] */
+  if (argc > 1)
+    {
+      i_threads = atoi(argv[1]);
+    }
+  if (i_threads < 1 || i_threads > MAX_THREADS)
+    {
+      printf("The number of threads must be from 1 to %d\n", MAX_THREADS);
+      return 1;
+    }
+
+  if (test_concurrent(i_threads) < 0)
+    {
+      printf("ght_set_concurrent() failed\n");
+      return 1;
+    }
+  printf("Concurrent table with %u threads OK\n", i_threads);
+  if (test_lockfree(i_threads) < 0)
+    {
+      printf("ght_set_lockfree_reads() failed\n");
+      return 1;
+    }
+  printf("Lock-free reads with %u threads OK\n", i_threads);
+  if (test_sharded(i_threads) < 0)
+    {
+      printf("ght_sharded_create() failed\n");
+      return 1;
+    }
+  printf("Sharded table with %u threads OK\n", i_threads);
+  if (test_rehash_parallel(i_threads) < 0)
+    {
+      printf("ght_rehash_parallel() failed\n");
+      return 1;
+    }
+  printf("Parallel rehash with %u threads OK\n", i_threads);
+  if (test_insert_many_parallel(i_threads) < 0)
+    {
+      printf("ght_insert_many_parallel() failed\n");
+      return 1;
+    }
+  printf("Parallel insert with %u threads OK\n", i_threads);
+
+  return 0;
+}
+
+#else /* _WIN32 */
+
+int main(int argc, char *argv[])
+{
+  printf("The thread tests need pthreads\n");
+
+  return 0;
+}
+
+#endif /* _WIN32 */
@@ -0,0 +1,727 @@
+/*********************************************************************
+ *
+ * Copyright (C) 2001-2005,  Simon Kagstrom
+ *
+ * Filename:      hash_block_chained.c
+ * Description:   Chained storage engine where the chains are made of
+ *                cache line sized blocks of entry pointers.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ ********************************************************************/
+
+#include <stdlib.h> /* malloc */
+#include <stdio.h>  /* perror */
+#include <string.h> /* memmove */
+#include <assert.h> /* assert */
+
+#include "ght_hash_table.h"
+#include "hash_engine.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/*
+ * The entries are the same as for GHT_ENGINE_CHAINED, but instead of
+ * linking the entries themselves, every bucket points to a chain of
+ * BLOCK_SIZE byte blocks. A block holds BLOCK_SLOTS entry pointers
+ * together with one byte of the hash value of each entry (the "tag"),
+ * so a lookup only touches the entries whose tag matches.
+ *
+ * The chain keeps the order of the entries exactly as a linked chain
+ * would: new entries are placed first, all blocks but the last are
+ * full and a removal shifts the following entries one slot towards
+ * the head. The heuristics swap the entry pointers instead of
+ * relinking entries.
+ *
+ * The blocks are allocated BLOCK_SIZE aligned from slabs of
+ * SLAB_BLOCKS blocks, and unused blocks are kept in a free list until
+ * the table is finalized.
+ */
+#define BLOCK_SIZE  64
+#define BLOCK_SLOTS ((BLOCK_SIZE - sizeof(void*) - 1) / (sizeof(void*) + 1))
+#define SLAB_BLOCKS 64          /* The first block of a slab is its header */
+
+#define TAG(l_hash) ((unsigned char)((l_hash) >> 24))
+
+typedef struct s_block
+{
+  ght_hash_entry_t *p_entries[BLOCK_SLOTS];
+  struct s_block *p_next;
+  unsigned char tags[BLOCK_SLOTS];
+  unsigned char i_used;
+} block_t;
+
+/* Fails to compile if a block does not fit in BLOCK_SIZE bytes */
+typedef char block_size_check_t[sizeof(block_t) <= BLOCK_SIZE ? 1 : -1];
+
+typedef struct s_slab
+{
+  struct s_slab *p_next;
+  void *p_mem;                  /* What malloc returned */
+} slab_t;
+
+typedef struct
+{
+  block_t **pp_buckets;
+  block_t *p_free;              /* Unused blocks, linked by p_next */
+  unsigned int i_free;
+  slab_t *p_slabs;
+} block_table_t;
+
+#define TABLE(p_ht) ((block_table_t*)(p_ht)->p_engine_data)
+
+/* Allocate another slab of blocks and put them in the free list */
+static int alloc_slab(block_table_t *p_t)
+{
+  void *p_mem;
+  block_t *p_blocks;
+  slab_t *p_slab;
+  int i;
+
+  if ( !(p_mem = malloc(SLAB_BLOCKS * BLOCK_SIZE + BLOCK_SIZE - 1)) )
+    {
+      perror("malloc");
+      return -1;
+    }
+  p_blocks = (block_t*)(((size_t)p_mem + BLOCK_SIZE - 1) & ~(size_t)(BLOCK_SIZE - 1));
+
+  p_slab = (slab_t*)p_blocks;
+  p_slab->p_mem = p_mem;
+  p_slab->p_next = p_t->p_slabs;
+  p_t->p_slabs = p_slab;
+
+  for (i = 1; i < SLAB_BLOCKS; i++)
+    {
+      block_t *p_b = (block_t*)((char*)p_blocks + i * BLOCK_SIZE);
+
+      p_b->p_next = p_t->p_free;
+      p_t->p_free = p_b;
+    }
+  p_t->i_free += SLAB_BLOCKS - 1;
+
+  return 0;
+}
+
+/* Make sure that there are at least n blocks in the free list */
+static int reserve_blocks(block_table_t *p_t, unsigned int n)
+{
+  while (p_t->i_free < n)
+    {
+      if (alloc_slab(p_t) < 0)
+	{
+	  return -1;
+	}
+    }
+  return 0;
+}
+
+static block_t *block_get(block_table_t *p_t)
+{
+  block_t *p_b;
+
+  if (reserve_blocks(p_t, 1) < 0)
+    {
+      return NULL;
+    }
+  p_b = p_t->p_free;
+  p_t->p_free = p_b->p_next;
+  p_t->i_free--;
+
+  p_b->p_next = NULL;
+  p_b->i_used = 0;
+
+  return p_b;
+}
+
+static void block_put(block_table_t *p_t, block_t *p_b)
+{
+  p_b->p_next = p_t->p_free;
+  p_t->p_free = p_b;
+  p_t->i_free++;
+}
+
+/* Allocate an empty bucket array with (at least) i_size buckets */
+static block_t **alloc_buckets(unsigned int i_size, unsigned int *p_size)
+{
+  block_t **pp_buckets;
+  unsigned int i_real_size = 1;
+
+  while (i_real_size < i_size && i_real_size < (1u << 31))
+    {
+      i_real_size <<= 1;
+    }
+
+  if ( !(pp_buckets = (block_t**)malloc(i_real_size * sizeof(block_t*))) )
+    {
+      perror("malloc");
+      return NULL;
+    }
+  memset(pp_buckets, 0, i_real_size * sizeof(block_t*));
+  *p_size = i_real_size;
+
+  return pp_buckets;
+}
+
+/* Find a key in a chain. Returns the block of the entry and sets
+ * *p_slot and *pp_prev (the block before it), or returns NULL. */
+static inline block_t *search_chain(block_t *p_b, ght_hash_key_t *p_key, ght_uint32_t l_hash,
+				    int *p_slot, block_t **pp_prev)
+{
+  unsigned char tag = TAG(l_hash);
+  block_t *p_prev = NULL;
+
+  for (; p_b; p_prev = p_b, p_b = p_b->p_next)
+    {
+      int i;
+
+      for (i = 0; i < p_b->i_used; i++)
+	{
+	  ght_hash_entry_t *p_e;
+
+	  if (p_b->tags[i] != tag)
+	    {
+	      continue;
+	    }
+	  p_e = p_b->p_entries[i];
+	  if (p_e->i_hash == l_hash &&
+	      p_e->key.i_size == p_key->i_size &&
+	      memcmp(p_e->key.p_key, p_key->p_key, p_key->i_size) == 0)
+	    {
+	      *p_slot = i;
+	      *pp_prev = p_prev;
+	      return p_b;
+	    }
+	}
+    }
+
+  return NULL;
+}
+
+static inline void swap_slots(block_t *p_a, int i_a, block_t *p_b, int i_b)
+{
+  ght_hash_entry_t *p_e = p_a->p_entries[i_a];
+  unsigned char tag = p_a->tags[i_a];
+
+  p_a->p_entries[i_a] = p_b->p_entries[i_b];
+  p_a->tags[i_a] = p_b->tags[i_b];
+  p_b->p_entries[i_b] = p_e;
+  p_b->tags[i_b] = tag;
+}
+
+/* Apply the heuristics to the entry found in slot i of p_b */
+static inline void apply_heuristics(ght_hash_table_t *p_ht, block_t **pp_head,
+				    block_t *p_b, int i, block_t *p_prev)
+{
+  switch (p_ht->i_heuristics)
+    {
+    case GHT_HEURISTICS_MOVE_TO_FRONT:
+      /* Swap places with the first entry */
+      swap_slots(p_b, i, *pp_head, 0);
+      break;
+    case GHT_HEURISTICS_TRANSPOSE:
+      /* Swap places with the entry before, which might be last in the
+       * previous block */
+      if (i > 0)
+	{
+	  swap_slots(p_b, i, p_b, i - 1);
+	}
+      else if (p_prev)
+	{
+	  swap_slots(p_b, 0, p_prev, BLOCK_SLOTS - 1);
+	}
+      break;
+    default:
+      break;
+    }
+}
+
+/* Place an entry first in a chain, moving the others one slot towards
+ * the tail. Returns -1 if a new block was needed and could not be
+ * allocated, in which case the chain is unchanged. */
+static int chain_prepend(block_table_t *p_t, block_t **pp_head,
+			 ght_hash_entry_t *p_e, unsigned char tag)
+{
+  block_t *p_tail = NULL;
+  block_t *p_b;
+
+  for (p_b = *pp_head; p_b; p_b = p_b->p_next)
+    {
+      p_tail = p_b;
+    }
+  if (!p_tail || p_tail->i_used == BLOCK_SLOTS)
+    {
+      block_t *p_new;
+
+      if ( !(p_new = block_get(p_t)) )
+	{
+	  return -1;
+	}
+      if (p_tail)
+	p_tail->p_next = p_new;
+      else
+	*pp_head = p_new;
+    }
+
+  for (p_b = *pp_head; p_b; p_b = p_b->p_next)
+    {
+      ght_hash_entry_t *p_last = p_b->p_entries[BLOCK_SLOTS - 1];
+      unsigned char last_tag = p_b->tags[BLOCK_SLOTS - 1];
+      int n = p_b->i_used < BLOCK_SLOTS ? p_b->i_used : BLOCK_SLOTS - 1;
+
+      memmove(&p_b->p_entries[1], &p_b->p_entries[0], n * sizeof(ght_hash_entry_t*));
+      memmove(&p_b->tags[1], &p_b->tags[0], n);
+      p_b->p_entries[0] = p_e;
+      p_b->tags[0] = tag;
+      if (p_b->i_used < BLOCK_SLOTS)
+	{
+	  p_b->i_used++;
+	  return 0;
+	}
+
+      /* Carry the last entry over to the next block */
+      p_e = p_last;
+      tag = last_tag;
+    }
+
+  assert(!"chain_prepend: No room at the tail");
+
+  return -1;
+}
+
+/* Remove the entry in slot i of p_b (p_prev is the block before p_b),
+ * moving the following entries one slot towards the head */
+static void chain_remove(block_table_t *p_t, block_t **pp_head,
+			 block_t *p_b, int i, block_t *p_prev)
+{
+  for (;;)
+    {
+      block_t *p_next = p_b->p_next;
+      int n = p_b->i_used;
+
+      memmove(&p_b->p_entries[i], &p_b->p_entries[i + 1], (n - i - 1) * sizeof(ght_hash_entry_t*));
+      memmove(&p_b->tags[i], &p_b->tags[i + 1], n - i - 1);
+      if (!p_next)
+	{
+	  break;
+	}
+
+      /* Only the last block can be partially filled */
+      assert(n == BLOCK_SLOTS);
+      p_b->p_entries[n - 1] = p_next->p_entries[0];
+      p_b->tags[n - 1] = p_next->tags[0];
+      p_prev = p_b;
+      p_b = p_next;
+      i = 0;
+    }
+
+  if (--p_b->i_used == 0)
+    {
+      if (p_prev)
+	p_prev->p_next = NULL;
+      else
+	*pp_head = NULL;
+      block_put(p_t, p_b);
+    }
+}
+
+/* Move all entries to a new bucket array of (at least) i_size buckets.
+ * The table is unchanged if this fails. */
+static int resize(ght_hash_table_t *p_ht, unsigned int i_size)
+{
+  block_table_t *p_t = TABLE(p_ht);
+  block_t **pp_buckets;
+  block_t **pp_tails;
+  unsigned int *p_count;
+  unsigned int i_new_size;
+  unsigned int i_needed = 0;
+  ght_hash_entry_t *p_e;
+  unsigned int i;
+
+  if ( !(pp_buckets = alloc_buckets(i_size, &i_new_size)) )
+    {
+      return -1;
+    }
+  if ( !(pp_tails = (block_t**)malloc(i_new_size * sizeof(block_t*))) ||
+       !(p_count = (unsigned int*)malloc(i_new_size * sizeof(unsigned int))) )
+    {
+      perror("malloc");
+      free(pp_tails);
+      free(pp_buckets);
+      return -1;
+    }
+  memset(pp_tails, 0, i_new_size * sizeof(block_t*));
+  memset(p_count, 0, i_new_size * sizeof(unsigned int));
+
+  /* Get all the blocks needed before touching the old chains */
+  for (p_e = p_ht->p_oldest; p_e; p_e = p_e->p_newer)
+    {
+      p_count[p_e->i_hash & (i_new_size - 1)]++;
+    }
+  for (i = 0; i < i_new_size; i++)
+    {
+      i_needed += (p_count[i] + BLOCK_SLOTS - 1) / BLOCK_SLOTS;
+    }
+  free(p_count);
+  if (reserve_blocks(p_t, i_needed) < 0)
+    {
+      free(pp_tails);
+      free(pp_buckets);
+      return -1;
+    }
+
+  /*
+   * Append the entries of each old chain to the new chains, releasing
+   * the old blocks on the way. The old buckets are taken from the last
+   * one, which gives the same order as relinking the entries of
+   * GHT_ENGINE_CHAINED would.
+   */
+  for (i = p_ht->i_size; i-- > 0; )
+    {
+      block_t *p_old = p_t->pp_buckets[i];
+
+      while (p_old)
+	{
+	  block_t *p_next = p_old->p_next;
+	  int j;
+
+	  for (j = 0; j < p_old->i_used; j++)
+	    {
+	      ght_uint32_t l_key = p_old->p_entries[j]->i_hash & (i_new_size - 1);
+	      block_t *p_b = pp_tails[l_key];
+
+	      if (!p_b || p_b->i_used == BLOCK_SLOTS)
+		{
+		  block_t *p_new = block_get(p_t);
+
+		  assert(p_new);
+		  if (p_b)
+		    p_b->p_next = p_new;
+		  else
+		    pp_buckets[l_key] = p_new;
+		  pp_tails[l_key] = p_b = p_new;
+		}
+	      p_b->p_entries[p_b->i_used] = p_old->p_entries[j];
+	      p_b->tags[p_b->i_used] = p_old->tags[j];
+	      p_b->i_used++;
+	    }
+	  block_put(p_t, p_old);
+	  p_old = p_next;
+	}
+    }
+  free(pp_tails);
+  free(p_t->pp_buckets);
+  p_t->pp_buckets = pp_buckets;
+  p_ht->i_size = i_new_size;
+  p_ht->i_size_mask = i_new_size - 1;
+
+  return 0;
+}
+
+static int bc_create(ght_hash_table_t *p_ht, unsigned int i_size)
+{
+  block_table_t *p_t;
+
+  if ( !(p_t = (block_table_t*)malloc(sizeof(block_table_t))) )
+    {
+      perror("malloc");
+      return -1;
+    }
+  if ( !(p_t->pp_buckets = alloc_buckets(i_size, &p_ht->i_size)) )
+    {
+      free(p_t);
+      return -1;
+    }
+  p_ht->i_size_mask = p_ht->i_size - 1;
+  p_t->p_free = NULL;
+  p_t->i_free = 0;
+  p_t->p_slabs = NULL;
+  p_ht->p_engine_data = p_t;
+
+  return 0;
+}
+
+static void bc_finalize(ght_hash_table_t *p_ht)
+{
+  block_table_t *p_t = TABLE(p_ht);
+  ght_hash_entry_t *p_e = p_ht->p_oldest;
+  slab_t *p_slab = p_t->p_slabs;
+
+  while (p_e && !entries_released_at_once(p_ht))
+    {
+      ght_hash_entry_t *p_next = p_e->p_newer;
+
+      he_finalize(p_ht, p_e);
+      p_e = p_next;
+    }
+  p_ht->p_oldest = p_ht->p_newest = NULL;
+
+  while (p_slab)
+    {
+      slab_t *p_next = p_slab->p_next;
+
+      free(p_slab->p_mem);
+      p_slab = p_next;
+    }
+  free(p_t->pp_buckets);
+  free(p_t);
+  p_ht->p_engine_data = NULL;
+}
+
+static int bc_upsert(ght_hash_table_t *p_ht, void *p_entry_data,
+		     ght_hash_key_t *p_key, ght_uint32_t l_hash,
+		     int b_replace, void **pp_data)
+{
+  block_table_t *p_t = TABLE(p_ht);
+  block_t **pp_head = &p_t->pp_buckets[l_hash & p_ht->i_size_mask];
+  ght_hash_entry_t *p_entry;
+  unsigned int i_nr = 0;
+  block_t *p_b;
+  block_t *p_prev;
+  int i;
+
+  if ( (p_b = search_chain(*pp_head, p_key, l_hash, &i, &p_prev)) )
+    {
+      return upsert_found(&p_b->p_entries[i]->p_data, p_entry_data, b_replace, pp_data);
+    }
+  if (!(p_entry = he_create(p_ht, p_entry_data,
+			    p_key->i_size, p_key->p_key, l_hash)))
+    {
+      return -2;
+    }
+
+  /* Rehash if the number of items inserted is too high. */
+  if (p_ht->i_automatic_rehash && p_ht->i_items > 2*p_ht->i_size)
+    {
+      resize(p_ht, 2*p_ht->i_size);
+      pp_head = &p_t->pp_buckets[l_hash & p_ht->i_size_mask];
+    }
+
+  for (p_b = *pp_head; p_b; p_b = p_b->p_next)
+    {
+      i_nr += p_b->i_used;
+    }
+  if (chain_prepend(p_t, pp_head, p_entry, TAG(l_hash)) < 0)
+    {
+      he_finalize(p_ht, p_entry);
+      return -2;
+    }
+  order_append(p_ht, p_entry);
+
+  /* If this is a limited bucket hash table, remove the last item */
+  if (p_ht->bucket_limit != 0 && i_nr >= p_ht->bucket_limit)
+    {
+      ght_hash_entry_t *p_last;
+
+      for (p_prev = NULL, p_b = *pp_head; p_b->p_next; p_prev = p_b, p_b = p_b->p_next)
+	;
+      p_last = p_b->p_entries[p_b->i_used - 1];
+      chain_remove(p_t, pp_head, p_b, p_b->i_used - 1, p_prev);
+      order_remove(p_ht, p_last); /* To allow it to be reinserted in fn_bucket_free */
+
+      p_ht->fn_bucket_free(p_last->p_data, p_last->key.p_key);
+      he_finalize(p_ht, p_last);
+    }
+  else
+    {
+      p_ht->i_items++;
+    }
+
+  return 0;
+}
+
+static inline ght_hash_entry_t *lookup(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  block_t **pp_head = &TABLE(p_ht)->pp_buckets[l_hash & p_ht->i_size_mask];
+  ght_hash_entry_t *p_e;
+  block_t *p_prev;
+  block_t *p_b;
+  int i;
+
+  if ( !(p_b = search_chain(*pp_head, p_key, l_hash, &i, &p_prev)) )
+    {
+      return NULL;
+    }
+  p_e = p_b->p_entries[i];
+  apply_heuristics(p_ht, pp_head, p_b, i, p_prev);
+
+  return p_e;
+}
+
+static void *bc_get(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  ght_hash_entry_t *p_e = lookup(p_ht, p_key, l_hash);
+
+  return p_e ? p_e->p_data : NULL;
+}
+
+static void *bc_replace(ght_hash_table_t *p_ht, void *p_entry_data,
+			ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  ght_hash_entry_t *p_e = lookup(p_ht, p_key, l_hash);
+  void *p_old;
+
+  if (!p_e)
+    {
+      return NULL;
+    }
+  p_old = p_e->p_data;
+  p_e->p_data = p_entry_data;
+
+  return p_old;
+}
+
+/* Remove entry i of block p_b (found by search_chain()) in the chain
+ * of l_hash, and return its data */
+static void *remove_entry(ght_hash_table_t *p_ht, ght_uint32_t l_hash,
+			  block_t *p_b, int i, block_t *p_prev)
+{
+  block_table_t *p_t = TABLE(p_ht);
+  block_t **pp_head = &p_t->pp_buckets[l_hash & p_ht->i_size_mask];
+  ght_hash_entry_t *p_e = p_b->p_entries[i];
+  void *p_ret;
+
+  chain_remove(p_t, pp_head, p_b, i, p_prev);
+  order_remove(p_ht, p_e);
+  p_ht->i_items--;
+
+  p_ret = p_e->p_data;
+  he_finalize(p_ht, p_e);
+
+  return p_ret;
+}
+
+static void *bc_remove(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  block_t *p_prev;
+  block_t *p_b;
+  int i;
+
+  if ( !(p_b = search_chain(TABLE(p_ht)->pp_buckets[l_hash & p_ht->i_size_mask],
+			    p_key, l_hash, &i, &p_prev)) )
+    {
+      return NULL;
+    }
+
+  return remove_entry(p_ht, l_hash, p_b, i, p_prev);
+}
+
+/* hash_table.c iterates over the insertion order list, so the current
+ * entry is p_iterator->p_entry. Its block is found by comparing the
+ * entry pointers in its chain. */
+static void *bc_iterator_remove(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator)
+{
+  ght_hash_entry_t *p_e = p_iterator->p_entry;
+  block_t *p_prev = NULL;
+  block_t *p_b;
+  int i;
+
+  for (p_b = TABLE(p_ht)->pp_buckets[p_e->i_hash & p_ht->i_size_mask]; p_b;
+       p_prev = p_b, p_b = p_b->p_next)
+    {
+      for (i = 0; i < p_b->i_used; i++)
+	{
+	  if (p_b->p_entries[i] == p_e)
+	    {
+	      return remove_entry(p_ht, p_e->i_hash, p_b, i, p_prev);
+	    }
+	}
+    }
+  assert(!"bc_iterator_remove: The entry is not in its chain");
+
+  return NULL;
+}
+
+static int bc_find(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash,
+		   ght_handle_t *p_handle)
+{
+  ght_hash_entry_t *p_e;
+  block_t *p_prev;
+  block_t *p_b;
+  int i;
+
+  if ( !(p_b = search_chain(TABLE(p_ht)->pp_buckets[l_hash & p_ht->i_size_mask],
+			    p_key, l_hash, &i, &p_prev)) )
+    {
+      return -1;
+    }
+  p_e = p_b->p_entries[i];
+  handle_fill(p_handle, &p_e->p_data, p_e->key.p_key, p_e->key.i_size);
+  p_handle->p_pos = p_b;
+  p_handle->p_pos_prev = p_prev;
+  p_handle->i_pos = i;
+
+  return 0;
+}
+
+static void *bc_remove_handle(ght_hash_table_t *p_ht, ght_handle_t *p_handle)
+{
+  block_t *p_b = (block_t*)p_handle->p_pos;
+
+  return remove_entry(p_ht, p_b->p_entries[p_handle->i_pos]->i_hash, p_b,
+		      p_handle->i_pos, (block_t*)p_handle->p_pos_prev);
+}
+
+static void bc_rehash(ght_hash_table_t *p_ht, unsigned int i_size)
+{
+  if (resize(p_ht, i_size) < 0)
+    {
+      fprintf(stderr, "hash_block_chained.c ERROR: Out of memory when rehashing\n");
+    }
+}
+
+/* The entries are iterated in insertion order by hash_table.c */
+static void bc_prefetch(ght_hash_table_t *p_ht, ght_uint32_t l_hash, int i_stage)
+{
+  block_t **pp_head = &TABLE(p_ht)->pp_buckets[l_hash & p_ht->i_size_mask];
+
+  if (i_stage == 0)
+    {
+      PREFETCH(pp_head);
+    }
+  else
+    {
+      PREFETCH(*pp_head);
+    }
+}
+
+/* Only grows a table which would grow anyway, like bc_upsert() */
+static void bc_reserve(ght_hash_table_t *p_ht, unsigned int i_items)
+{
+  if (p_ht->i_automatic_rehash && i_items > 2*p_ht->i_size)
+    {
+      resize(p_ht, i_items / 2);
+    }
+}
+
+const ght_engine_t ght_block_chained_engine =
+{
+  bc_create,
+  bc_finalize,
+  bc_upsert,
+  bc_get,
+  bc_replace,
+  bc_remove,
+  NULL,
+  NULL,
+  bc_rehash,
+  bc_prefetch,
+  bc_reserve,
+  bc_find,
+  bc_remove_handle,
+  bc_iterator_remove,
+};
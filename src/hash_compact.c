@@ -0,0 +1,408 @@
+/*********************************************************************
+ *
+ * Copyright (C) 2001-2005,  Simon Kagstrom
+ *
+ * Filename:      hash_compact.c
+ * Description:   Storage engine with the entries in a dense array in
+ *                insertion order and an open addressing index.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ ********************************************************************/
+
+#include <stdlib.h> /* malloc */
+#include <stdio.h>  /* perror */
+#include <string.h> /* memset */
+#include <assert.h> /* assert */
+
+#include "ght_hash_table.h"
+#include "hash_engine.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/*
+ * The entries are appended to a dense array, so the array is always in
+ * insertion order and iterating is a sequential scan. The hash table
+ * itself (the "index", with i_size slots) only holds the positions of
+ * the entries in the array, and is probed linearly.
+ *
+ * A removal marks the entry as removed and its index slot as DUMMY,
+ * which keeps the probe sequences of the other keys intact. The holes
+ * are only compacted when the array is full, by moving the remaining
+ * entries to a new array (of the same size if enough entries have
+ * been removed) and rebuilding the index.
+ */
+#define INDEX_EMPTY  0xffffffff
+#define INDEX_DUMMY  0xfffffffe
+#define MIN_SIZE     8
+
+/* The key size of removed entries */
+#define REMOVED      ((unsigned int)-1)
+
+/* The number of entries for an index of i_size slots, 2/3 */
+#define CAPACITY(i_size) ((i_size) - (i_size) / 3)
+
+typedef struct
+{
+  ght_slot_t *p_entries;        /* CAPACITY(i_size) entries in insertion order */
+  ght_uint32_t *p_index;        /* i_size positions in p_entries */
+  unsigned int i_next;          /* The number of used entries, including removed ones */
+} compact_table_t;
+
+#define TABLE(p_ht) ((compact_table_t*)(p_ht)->p_engine_data)
+
+/* Put the position of an entry in the first empty slot of the index */
+static inline void index_put(ght_uint32_t *p_index, ght_uint32_t i_mask,
+			     ght_uint32_t l_hash, ght_uint32_t i_pos)
+{
+  ght_uint32_t i = l_hash & i_mask;
+
+  while (p_index[i] != INDEX_EMPTY)
+    {
+      i = (i + 1) & i_mask;
+    }
+  p_index[i] = i_pos;
+}
+
+/* Find the index slot for a key, or -1 if the key is not in the table */
+static inline int find_index(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  compact_table_t *p_t = TABLE(p_ht);
+  ght_uint32_t i = l_hash & p_ht->i_size_mask;
+  ght_uint32_t i_pos;
+
+  while ( (i_pos = p_t->p_index[i]) != INDEX_EMPTY )
+    {
+      if (i_pos != INDEX_DUMMY)
+	{
+	  ght_slot_t *p_e = &p_t->p_entries[i_pos];
+
+	  if (p_e->i_hash == l_hash && slot_key_equals(p_e, p_key))
+	    {
+	      return (int)i;
+	    }
+	}
+      i = (i + 1) & p_ht->i_size_mask;
+    }
+
+  return -1;
+}
+
+/* Move the entries which are not removed to new arrays for an index
+ * of (at least) i_size slots. The table is unchanged if this fails. */
+static int resize(ght_hash_table_t *p_ht, unsigned int i_size)
+{
+  compact_table_t *p_t = TABLE(p_ht);
+  ght_slot_t *p_entries;
+  ght_uint32_t *p_index;
+  unsigned int i_real_size = MIN_SIZE;
+  unsigned int i, j;
+
+  /* Leave room for at least one more entry */
+  while ( (i_real_size < i_size || CAPACITY(i_real_size) <= p_ht->i_items) &&
+	  i_real_size < (1u << 31) )
+    {
+      i_real_size <<= 1;
+    }
+
+  if ( !(p_entries = (ght_slot_t*)malloc(CAPACITY(i_real_size) * sizeof(ght_slot_t))) )
+    {
+      perror("malloc");
+      return -1;
+    }
+  if ( !(p_index = (ght_uint32_t*)malloc(i_real_size * sizeof(ght_uint32_t))) )
+    {
+      perror("malloc");
+      free(p_entries);
+      return -1;
+    }
+  memset(p_index, 0xff, i_real_size * sizeof(ght_uint32_t));
+
+  for (i = 0, j = 0; i < p_t->i_next; i++)
+    {
+      if (p_t->p_entries[i].i_key_size != REMOVED)
+	{
+	  p_entries[j] = p_t->p_entries[i];
+	  index_put(p_index, i_real_size - 1, p_entries[j].i_hash, j);
+	  j++;
+	}
+    }
+  assert(j == p_ht->i_items);
+
+  free(p_t->p_entries);
+  free(p_t->p_index);
+  p_t->p_entries = p_entries;
+  p_t->p_index = p_index;
+  p_t->i_next = j;
+  p_ht->i_size = i_real_size;
+  p_ht->i_size_mask = i_real_size - 1;
+
+  return 0;
+}
+
+static int cp_create(ght_hash_table_t *p_ht, unsigned int i_size)
+{
+  compact_table_t *p_t;
+
+  if ( !(p_t = (compact_table_t*)malloc(sizeof(compact_table_t))) )
+    {
+      perror("malloc");
+      return -1;
+    }
+  p_t->p_entries = NULL;
+  p_t->p_index = NULL;
+  p_t->i_next = 0;
+  p_ht->p_engine_data = p_t;
+
+  if (resize(p_ht, i_size) < 0)
+    {
+      free(p_t);
+      p_ht->p_engine_data = NULL;
+      return -1;
+    }
+
+  return 0;
+}
+
+static void cp_finalize(ght_hash_table_t *p_ht)
+{
+  compact_table_t *p_t = TABLE(p_ht);
+  unsigned int i;
+
+  for (i = 0; i < p_t->i_next && !entries_released_at_once(p_ht); i++)
+    {
+      if (p_t->p_entries[i].i_key_size != REMOVED)
+	{
+	  slot_free_key(p_ht, &p_t->p_entries[i]);
+	}
+    }
+  free(p_t->p_entries);
+  free(p_t->p_index);
+  free(p_t);
+  p_ht->p_engine_data = NULL;
+}
+
+static int cp_upsert(ght_hash_table_t *p_ht, void *p_entry_data,
+		     ght_hash_key_t *p_key, ght_uint32_t l_hash,
+		     int b_replace, void **pp_data)
+{
+  compact_table_t *p_t = TABLE(p_ht);
+  int i;
+
+  if ( (i = find_index(p_ht, p_key, l_hash)) >= 0)
+    {
+      return upsert_found(&p_t->p_entries[p_t->p_index[i]].p_data, p_entry_data,
+			  b_replace, pp_data);
+    }
+
+  if (p_t->i_next == CAPACITY(p_ht->i_size))
+    {
+      /* Mostly removed entries: Compact them without growing */
+      unsigned int i_size = p_ht->i_items < CAPACITY(p_ht->i_size) / 2 ?
+	p_ht->i_size : 2 * p_ht->i_size;
+
+      if (resize(p_ht, i_size) < 0)
+	{
+	  return -2;
+	}
+    }
+
+  if (slot_fill(p_ht, &p_t->p_entries[p_t->i_next], p_entry_data, p_key, l_hash) < 0)
+    {
+      return -2;
+    }
+  index_put(p_t->p_index, p_ht->i_size_mask, l_hash, p_t->i_next);
+  p_t->i_next++;
+  p_ht->i_items++;
+
+  return 0;
+}
+
+static void *cp_get(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  compact_table_t *p_t = TABLE(p_ht);
+  int i = find_index(p_ht, p_key, l_hash);
+
+  return i < 0 ? NULL : p_t->p_entries[p_t->p_index[i]].p_data;
+}
+
+static void *cp_replace(ght_hash_table_t *p_ht, void *p_entry_data,
+			ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  compact_table_t *p_t = TABLE(p_ht);
+  int i = find_index(p_ht, p_key, l_hash);
+  ght_slot_t *p_e;
+  void *p_old;
+
+  if (i < 0)
+    {
+      return NULL;
+    }
+  p_e = &p_t->p_entries[p_t->p_index[i]];
+  p_old = p_e->p_data;
+  p_e->p_data = p_entry_data;
+
+  return p_old;
+}
+
+/* Remove the entry of index slot i and return its data */
+static void *remove_index(ght_hash_table_t *p_ht, int i)
+{
+  compact_table_t *p_t = TABLE(p_ht);
+  ght_slot_t *p_e;
+
+  p_e = &p_t->p_entries[p_t->p_index[i]];
+  slot_free_key(p_ht, p_e);
+  p_e->i_key_size = REMOVED;
+  p_t->p_index[i] = INDEX_DUMMY;
+  p_ht->i_items--;
+
+  return p_e->p_data;
+}
+
+static void *cp_remove(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  int i = find_index(p_ht, p_key, l_hash);
+
+  return i < 0 ? NULL : remove_index(p_ht, i);
+}
+
+static int cp_find(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash,
+		   ght_handle_t *p_handle)
+{
+  compact_table_t *p_t = TABLE(p_ht);
+  int i = find_index(p_ht, p_key, l_hash);
+
+  if (i < 0)
+    {
+      return -1;
+    }
+  handle_fill_slot(p_handle, &p_t->p_entries[p_t->p_index[i]]);
+  p_handle->i_pos = i;
+
+  return 0;
+}
+
+static void *cp_remove_handle(ght_hash_table_t *p_ht, ght_handle_t *p_handle)
+{
+  return remove_index(p_ht, p_handle->i_pos);
+}
+
+/* Iteration is in insertion order. Nothing is moved by a removal. */
+static void *cp_next(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator,
+		     const void **pp_key, unsigned int *size)
+{
+  compact_table_t *p_t = TABLE(p_ht);
+
+  while (p_iterator->i_pos < p_t->i_next)
+    {
+      ght_slot_t *p_e = &p_t->p_entries[p_iterator->i_pos++];
+
+      if (p_e->i_key_size != REMOVED)
+	{
+	  *pp_key = slot_key(p_e);
+	  if (size != NULL)
+	    *size = p_e->i_key_size;
+
+	  return p_e->p_data;
+	}
+    }
+
+  *pp_key = NULL;
+  if (size != NULL)
+    *size = 0;
+
+  return NULL;
+}
+
+/* The index slot of the current entry is found by its position, the
+ * keys need not be compared */
+static void *cp_iterator_remove(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator)
+{
+  compact_table_t *p_t = TABLE(p_ht);
+  ght_uint32_t i_pos = p_iterator->i_pos - 1;
+  ght_uint32_t i = p_t->p_entries[i_pos].i_hash & p_ht->i_size_mask;
+
+  while (p_t->p_index[i] != i_pos)
+    {
+      i = (i + 1) & p_ht->i_size_mask;
+    }
+
+  return remove_index(p_ht, (int)i);
+}
+
+static void *cp_first(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator,
+		      const void **pp_key, unsigned int *size)
+{
+  p_iterator->p_entry = NULL;
+  p_iterator->p_next = NULL;
+  p_iterator->i_pos = 0;
+  p_iterator->i_left = 0;
+
+  return cp_next(p_ht, p_iterator, pp_key, size);
+}
+
+static void cp_rehash(ght_hash_table_t *p_ht, unsigned int i_size)
+{
+  if (resize(p_ht, i_size) < 0)
+    {
+      fprintf(stderr, "hash_compact.c ERROR: Out of memory when rehashing\n");
+    }
+}
+
+/* The index slot, then the entry it points to */
+static void cp_prefetch(ght_hash_table_t *p_ht, ght_uint32_t l_hash, int i_stage)
+{
+  compact_table_t *p_t = TABLE(p_ht);
+  ght_uint32_t *p_index = &p_t->p_index[l_hash & p_ht->i_size_mask];
+
+  if (i_stage == 0)
+    {
+      PREFETCH(p_index);
+    }
+  else if (*p_index < INDEX_DUMMY)
+    {
+      PREFETCH(&p_t->p_entries[*p_index]);
+    }
+}
+
+static void cp_reserve(ght_hash_table_t *p_ht, unsigned int i_items)
+{
+  if (i_items >= CAPACITY(p_ht->i_size))
+    {
+      resize(p_ht, i_items + i_items / 2 + 2);
+    }
+}
+
+const ght_engine_t ght_compact_engine =
+{
+  cp_create,
+  cp_finalize,
+  cp_upsert,
+  cp_get,
+  cp_replace,
+  cp_remove,
+  cp_first,
+  cp_next,
+  cp_rehash,
+  cp_prefetch,
+  cp_reserve,
+  cp_find,
+  cp_remove_handle,
+  cp_iterator_remove,
+};
@@ -0,0 +1,659 @@
+/*********************************************************************
+ *
+ * Copyright (C) 2001-2005,  Simon Kagstrom
+ *
+ * Filename:      hash_cuckoo.c
+ * Description:   Bucketized cuckoo hashing storage engine.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ ********************************************************************/
+
+#include <stdlib.h> /* malloc */
+#include <stdio.h>  /* perror */
+#include <string.h> /* memset */
+#include <assert.h> /* assert */
+
+#include "ght_hash_table.h"
+#include "hash_engine.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/*
+ * Every key can be in one of two buckets of BUCKET_SLOTS slots, or in
+ * a small stash. A lookup therefore looks at no more than two buckets
+ * (and the stash, which is normally empty) regardless of how the keys
+ * are distributed.
+ *
+ * Every bucket is a BUCKET_SIZE byte header, aligned to BUCKET_SIZE,
+ * with the hash values, key sizes and data of its slots. The keys
+ * (inline or pointers, like in ght_slot_t) are kept apart: two
+ * buckets make a group of two headers followed by the keys of both,
+ * so that the keys are in the next cache line or the one after it. A
+ * miss thus reads one cache line per bucket, and a hit in the first
+ * bucket reads its header and its keys, two cache lines, plus the key
+ * itself if it is not inline.
+ *
+ * The first bucket is given by the hash value and the second by a
+ * scrambled version of it, so both can be found from the hash value
+ * stored in the slot. When both buckets are full, an entry is kicked
+ * out to its other bucket, possibly kicking out another one, and so
+ * on. If no free slot is found within MAX_KICKS moves, the moves are
+ * undone and the new entry goes into the stash, which is one more
+ * bucket after the others. When the stash is full as well, the table
+ * is rebuilt with the same number of buckets, which moves the stashed
+ * entries back into the buckets if they fit there now. The table only
+ * grows when it is full enough that this is the likely reason the
+ * entry did not fit (GROW_ITEMS), or when it reaches MAX_ITEMS.
+ *
+ * The slots are numbered BUCKET_SLOTS per bucket, so the stash has
+ * the numbers from the size of the table up. CK_USED takes the top
+ * bit of the stored hash value, so keys whose hash values differ only
+ * in that bit are in the same buckets.
+ */
+#define CK_USED      0x80000000       /* Set in the stored hash of used slots */
+#define BUCKET_SIZE  64
+#define GROUP_SIZE   (3 * BUCKET_SIZE)
+#define BUCKET_SLOTS 4
+#define MAX_KICKS    64
+#define MIN_BUCKETS  2
+
+/* The maximum number of entries before the table grows, 15/16 */
+#define MAX_ITEMS(i_slots) ((i_slots) - (i_slots) / 16)
+
+/* Grow instead of failing if an entry does not fit at this load, 1/2 */
+#define GROW_ITEMS(i_slots) ((i_slots) / 2)
+
+typedef struct
+{
+  ght_uint32_t hashes[BUCKET_SLOTS];    /* With CK_USED, 0 for free slots */
+  unsigned int key_sizes[BUCKET_SLOTS];
+  void *p_data[BUCKET_SLOTS];
+} bucket_t;
+
+/* Fails to compile if a bucket does not fit in BUCKET_SIZE bytes */
+typedef char bucket_size_check_t[sizeof(bucket_t) <= BUCKET_SIZE ? 1 : -1];
+
+typedef union
+{
+  void *p_key;                          /* Keys longer than GHT_INLINE_KEY_SIZE */
+  unsigned char data[GHT_INLINE_KEY_SIZE];
+} bucket_key_t;
+
+/* Fails to compile if the keys of two buckets do not fit in BUCKET_SIZE bytes */
+typedef char bucket_keys_check_t[2 * BUCKET_SLOTS * sizeof(bucket_key_t) <= BUCKET_SIZE ? 1 : -1];
+
+typedef struct
+{
+  char *p_groups;               /* The buckets and the stash, two per group */
+  void *p_mem;                  /* What malloc returned */
+  unsigned int i_stash;         /* The number of used stash slots */
+  ght_uint32_t i_random;        /* State for choosing entries to kick out */
+  unsigned int i_bucket_mask;
+} cuckoo_table_t;
+
+#define TABLE(p_ht) ((cuckoo_table_t*)(p_ht)->p_engine_data)
+
+/* The bucket and the key of slot number i, and the stash */
+#define GROUP(p_t, i)  ((p_t)->p_groups + (size_t)((i) / (2 * BUCKET_SLOTS)) * GROUP_SIZE)
+#define BUCKET(p_t, i) ((bucket_t*)(GROUP(p_t, i) + ((i) / BUCKET_SLOTS % 2) * BUCKET_SIZE))
+#define KEY(p_t, i)    ((bucket_key_t*)(GROUP(p_t, i) + 2 * BUCKET_SIZE) + (i) % (2 * BUCKET_SLOTS))
+#define STASH(p_t)     (((p_t)->i_bucket_mask + 1) * BUCKET_SLOTS)
+
+/* Scramble the bits of the hash value for the second bucket (the
+ * finalizer of MurmurHash3) */
+static inline ght_uint32_t mix(ght_uint32_t h)
+{
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+
+  return h;
+}
+
+static inline ght_uint32_t bucket1(cuckoo_table_t *p_t, ght_uint32_t l_hash)
+{
+  return l_hash & p_t->i_bucket_mask;
+}
+
+static inline ght_uint32_t bucket2(cuckoo_table_t *p_t, ght_uint32_t l_hash)
+{
+  ght_uint32_t b1 = l_hash & p_t->i_bucket_mask;
+  ght_uint32_t b2 = mix(l_hash) & p_t->i_bucket_mask;
+
+  /* Always use two different buckets */
+  return b2 == b1 ? b1 ^ 1 : b2;
+}
+
+/* The other bucket of an entry currently in bucket b */
+static inline ght_uint32_t other_bucket(cuckoo_table_t *p_t, ght_uint32_t b, ght_uint32_t l_hash)
+{
+  ght_uint32_t b1 = bucket1(p_t, l_hash);
+
+  return b == b1 ? bucket2(p_t, l_hash) : b1;
+}
+
+static inline ght_uint32_t next_random(cuckoo_table_t *p_t)
+{
+  /* xorshift32 */
+  p_t->i_random ^= p_t->i_random << 13;
+  p_t->i_random ^= p_t->i_random >> 17;
+  p_t->i_random ^= p_t->i_random << 5;
+
+  return p_t->i_random;
+}
+
+/* The parts of slot number i */
+static inline ght_uint32_t *slot_hash(cuckoo_table_t *p_t, unsigned int i)
+{
+  return &BUCKET(p_t, i)->hashes[i % BUCKET_SLOTS];
+}
+
+static inline void **slot_data(cuckoo_table_t *p_t, unsigned int i)
+{
+  return &BUCKET(p_t, i)->p_data[i % BUCKET_SLOTS];
+}
+
+static inline unsigned int slot_key_size(cuckoo_table_t *p_t, unsigned int i)
+{
+  return BUCKET(p_t, i)->key_sizes[i % BUCKET_SLOTS];
+}
+
+static inline const void *key_at(cuckoo_table_t *p_t, unsigned int i)
+{
+  bucket_key_t *p_k = KEY(p_t, i);
+
+  return slot_key_size(p_t, i) <= GHT_INLINE_KEY_SIZE ? (const void*)p_k->data : p_k->p_key;
+}
+
+/* Copy slot number i out to a ght_slot_t and back */
+static inline void get_slot(cuckoo_table_t *p_t, unsigned int i, ght_slot_t *p_s)
+{
+  bucket_t *p_b = BUCKET(p_t, i);
+
+  p_s->i_hash = p_b->hashes[i % BUCKET_SLOTS];
+  p_s->i_key_size = p_b->key_sizes[i % BUCKET_SLOTS];
+  p_s->p_data = p_b->p_data[i % BUCKET_SLOTS];
+  memcpy(&p_s->key, KEY(p_t, i), sizeof(p_s->key));
+}
+
+static inline void set_slot(cuckoo_table_t *p_t, unsigned int i, const ght_slot_t *p_s)
+{
+  bucket_t *p_b = BUCKET(p_t, i);
+
+  p_b->hashes[i % BUCKET_SLOTS] = p_s->i_hash;
+  p_b->key_sizes[i % BUCKET_SLOTS] = p_s->i_key_size;
+  p_b->p_data[i % BUCKET_SLOTS] = p_s->p_data;
+  memcpy(KEY(p_t, i), &p_s->key, sizeof(p_s->key));
+}
+
+/* Find a key in the bucket with slot number i, only reading the keys
+ * whose hash value and size match. Returns the slot number or -1. */
+static inline int search_bucket(cuckoo_table_t *p_t, unsigned int i,
+				ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  bucket_t *p_b = BUCKET(p_t, i);
+  int j;
+
+  i -= i % BUCKET_SLOTS;
+  for (j = 0; j < BUCKET_SLOTS; j++)
+    {
+      if (p_b->hashes[j] == l_hash && p_b->key_sizes[j] == p_key->i_size &&
+	  memcmp(key_at(p_t, i + j), p_key->p_key, p_key->i_size) == 0)
+	{
+	  return i + j;
+	}
+    }
+  return -1;
+}
+
+/* Find the slot for a key (l_hash has CK_USED set), or -1 */
+static inline int find_slot(cuckoo_table_t *p_t, ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  int i;
+
+  if ( (i = search_bucket(p_t, bucket1(p_t, l_hash) * BUCKET_SLOTS, p_key, l_hash)) >= 0 ||
+       (i = search_bucket(p_t, bucket2(p_t, l_hash) * BUCKET_SLOTS, p_key, l_hash)) >= 0 )
+    {
+      return i;
+    }
+  if (p_t->i_stash > 0)
+    {
+      return search_bucket(p_t, STASH(p_t), p_key, l_hash);
+    }
+
+  return -1;
+}
+
+/* A free slot in the bucket with slot number i, or -1 */
+static inline int free_slot_in_bucket(cuckoo_table_t *p_t, unsigned int i)
+{
+  bucket_t *p_b = BUCKET(p_t, i);
+  int j;
+
+  for (j = 0; j < BUCKET_SLOTS; j++)
+    {
+      if (!p_b->hashes[j])
+	{
+	  return i - i % BUCKET_SLOTS + j;
+	}
+    }
+  return -1;
+}
+
+/* Place an entry in the table, kicking out other entries if needed.
+ * Returns 0 on success and -1 if there was no room (in which case the
+ * table is unchanged). */
+static int place_slot(cuckoo_table_t *p_t, ght_slot_t *p_new)
+{
+  unsigned int path[MAX_KICKS];
+  ght_slot_t hand = *p_new;
+  ght_uint32_t b;
+  int i;
+  int n;
+
+  if ( (i = free_slot_in_bucket(p_t, bucket1(p_t, hand.i_hash) * BUCKET_SLOTS)) >= 0 ||
+       (i = free_slot_in_bucket(p_t, bucket2(p_t, hand.i_hash) * BUCKET_SLOTS)) >= 0 )
+    {
+      set_slot(p_t, i, &hand);
+      return 0;
+    }
+
+  /* Kick out a random entry, and move that one to its other bucket */
+  b = bucket1(p_t, hand.i_hash);
+  for (n = 0; n < MAX_KICKS; n++)
+    {
+      ght_slot_t tmp;
+
+      path[n] = b * BUCKET_SLOTS + next_random(p_t) % BUCKET_SLOTS;
+      get_slot(p_t, path[n], &tmp);
+      set_slot(p_t, path[n], &hand);
+      hand = tmp;
+
+      b = other_bucket(p_t, b, hand.i_hash);
+      if ( (i = free_slot_in_bucket(p_t, b * BUCKET_SLOTS)) >= 0 )
+	{
+	  set_slot(p_t, i, &hand);
+	  return 0;
+	}
+    }
+
+  /* Undo the moves */
+  while (n-- > 0)
+    {
+      ght_slot_t tmp;
+
+      get_slot(p_t, path[n], &tmp);
+      set_slot(p_t, path[n], &hand);
+      hand = tmp;
+    }
+  assert(hand.i_hash == p_new->i_hash && hand.p_data == p_new->p_data);
+
+  /* Use the stash as a last resort */
+  if ( (i = free_slot_in_bucket(p_t, STASH(p_t))) >= 0 )
+    {
+      set_slot(p_t, i, &hand);
+      p_t->i_stash++;
+      return 0;
+    }
+
+  return -1;
+}
+
+/* Allocate the buckets and the stash, aligned to BUCKET_SIZE */
+static int alloc_buckets(cuckoo_table_t *p_t, unsigned int i_buckets, unsigned int *p_size)
+{
+  unsigned int i_real_buckets = MIN_BUCKETS;
+  size_t i_groups;
+
+  while (i_real_buckets < i_buckets && i_real_buckets < (1u << 28))
+    {
+      i_real_buckets <<= 1;
+    }
+
+  i_groups = (size_t)i_real_buckets / 2 + 1;
+  if ( !(p_t->p_mem = malloc(i_groups * GROUP_SIZE + BUCKET_SIZE - 1)) )
+    {
+      perror("malloc");
+      return -1;
+    }
+  p_t->p_groups = (char*)(((size_t)p_t->p_mem + BUCKET_SIZE - 1) & ~(size_t)(BUCKET_SIZE - 1));
+  memset(p_t->p_groups, 0, i_groups * GROUP_SIZE);
+  p_t->i_stash = 0;
+  p_t->i_bucket_mask = i_real_buckets - 1;
+  *p_size = i_real_buckets * BUCKET_SLOTS;
+
+  return 0;
+}
+
+/* Rebuild the table with (at least) i_slots slots, also placing p_extra
+ * if it is non-NULL. The table is unchanged if this fails. */
+static int rebuild(ght_hash_table_t *p_ht, unsigned int i_slots, ght_slot_t *p_extra)
+{
+  cuckoo_table_t *p_old = TABLE(p_ht);
+  cuckoo_table_t new_table = *p_old;
+  unsigned int i_size;
+  unsigned int i;
+  int err = 0;
+
+  if (i_slots < MIN_BUCKETS * BUCKET_SLOTS)
+    {
+      i_slots = MIN_BUCKETS * BUCKET_SLOTS;
+    }
+  while (MAX_ITEMS(i_slots) <= p_ht->i_items + 1)
+    {
+      i_slots *= 2;
+    }
+
+  if (alloc_buckets(&new_table, i_slots / BUCKET_SLOTS, &i_size) < 0)
+    {
+      return -1;
+    }
+  /* The old stash is placed last, as it comes after the buckets */
+  for (i = 0; i < STASH(p_old) + BUCKET_SLOTS && !err; i++)
+    {
+      if (*slot_hash(p_old, i))
+	{
+	  ght_slot_t slot;
+
+	  get_slot(p_old, i, &slot);
+	  err = place_slot(&new_table, &slot);
+	}
+    }
+  if (!err && p_extra)
+    {
+      err = place_slot(&new_table, p_extra);
+    }
+
+  if (err)
+    {
+      free(new_table.p_mem);
+      return -1;
+    }
+  free(p_old->p_mem);
+  *p_old = new_table;
+  p_ht->i_size = i_size;
+  p_ht->i_size_mask = i_size - 1;
+
+  return 0;
+}
+
+static int ck_create(ght_hash_table_t *p_ht, unsigned int i_size)
+{
+  cuckoo_table_t *p_t;
+
+  if ( !(p_t = (cuckoo_table_t*)malloc(sizeof(cuckoo_table_t))) )
+    {
+      perror("malloc");
+      return -1;
+    }
+  if (alloc_buckets(p_t, (i_size + BUCKET_SLOTS - 1) / BUCKET_SLOTS, &p_ht->i_size) < 0)
+    {
+      free(p_t);
+      return -1;
+    }
+  p_ht->i_size_mask = p_ht->i_size - 1;
+  p_t->i_random = 2463534242u;
+  p_ht->p_engine_data = p_t;
+
+  return 0;
+}
+
+/* Free the key of slot number i, if it is not stored inline */
+static void free_key(ght_hash_table_t *p_ht, unsigned int i)
+{
+  cuckoo_table_t *p_t = TABLE(p_ht);
+  unsigned int i_key_size = slot_key_size(p_t, i);
+
+  if (i_key_size > GHT_INLINE_KEY_SIZE)
+    {
+      mem_free(p_ht, KEY(p_t, i)->p_key, i_key_size);
+    }
+}
+
+static void ck_finalize(ght_hash_table_t *p_ht)
+{
+  cuckoo_table_t *p_t = TABLE(p_ht);
+  unsigned int i;
+
+  for (i = 0; i < STASH(p_t) + BUCKET_SLOTS && !entries_released_at_once(p_ht); i++)
+    {
+      if (*slot_hash(p_t, i))
+	{
+	  free_key(p_ht, i);
+	}
+    }
+  free(p_t->p_mem);
+  free(p_t);
+  p_ht->p_engine_data = NULL;
+}
+
+static int ck_upsert(ght_hash_table_t *p_ht, void *p_entry_data,
+		     ght_hash_key_t *p_key, ght_uint32_t l_hash,
+		     int b_replace, void **pp_data)
+{
+  cuckoo_table_t *p_t = TABLE(p_ht);
+  ght_slot_t slot;
+  int err = 0;
+  int i;
+
+  l_hash |= CK_USED;
+  if ( (i = find_slot(p_t, p_key, l_hash)) >= 0 )
+    {
+      return upsert_found(slot_data(p_t, i), p_entry_data, b_replace, pp_data);
+    }
+  if (slot_fill(p_ht, &slot, p_entry_data, p_key, l_hash) < 0)
+    {
+      return -2;
+    }
+
+  if (p_ht->i_items >= MAX_ITEMS(p_ht->i_size))
+    {
+      err = rebuild(p_ht, 2 * p_ht->i_size, &slot);
+    }
+  else if (place_slot(p_t, &slot) < 0)
+    {
+      /* Empty the stash into the buckets first, and only grow if the
+       * table is full enough for the load to be the problem */
+      if ( (err = rebuild(p_ht, p_ht->i_size, &slot)) < 0 &&
+	   p_ht->i_items >= GROW_ITEMS(p_ht->i_size) )
+	{
+	  err = rebuild(p_ht, 2 * p_ht->i_size, &slot);
+	}
+    }
+  if (err < 0)
+    {
+      /* Out of memory, or too many keys with the same hash value */
+      slot_free_key(p_ht, &slot);
+      return -2;
+    }
+  p_ht->i_items++;
+
+  return 0;
+}
+
+static void *ck_get(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  cuckoo_table_t *p_t = TABLE(p_ht);
+  int i = find_slot(p_t, p_key, l_hash | CK_USED);
+
+  return i >= 0 ? *slot_data(p_t, i) : NULL;
+}
+
+static void *ck_replace(ght_hash_table_t *p_ht, void *p_entry_data,
+			ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  cuckoo_table_t *p_t = TABLE(p_ht);
+  int i = find_slot(p_t, p_key, l_hash | CK_USED);
+  void *p_old;
+
+  if (i < 0)
+    {
+      return NULL;
+    }
+  p_old = *slot_data(p_t, i);
+  *slot_data(p_t, i) = p_entry_data;
+
+  return p_old;
+}
+
+/* Remove the entry in slot number i and return its data */
+static void *remove_slot(ght_hash_table_t *p_ht, unsigned int i)
+{
+  cuckoo_table_t *p_t = TABLE(p_ht);
+  void *p_ret;
+
+  if (i >= STASH(p_t))
+    {
+      p_t->i_stash--;
+    }
+
+  p_ret = *slot_data(p_t, i);
+  free_key(p_ht, i);
+  *slot_hash(p_t, i) = 0;
+  p_ht->i_items--;
+
+  return p_ret;
+}
+
+static void *ck_remove(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  int i = find_slot(TABLE(p_ht), p_key, l_hash | CK_USED);
+
+  return i >= 0 ? remove_slot(p_ht, i) : NULL;
+}
+
+static int ck_find(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash,
+		   ght_handle_t *p_handle)
+{
+  cuckoo_table_t *p_t = TABLE(p_ht);
+  int i = find_slot(p_t, p_key, l_hash | CK_USED);
+
+  if (i < 0)
+    {
+      return -1;
+    }
+  handle_fill(p_handle, slot_data(p_t, i), key_at(p_t, i), slot_key_size(p_t, i));
+  p_handle->i_pos = i;
+
+  return 0;
+}
+
+static void *ck_remove_handle(ght_hash_table_t *p_ht, ght_handle_t *p_handle)
+{
+  return remove_slot(p_ht, p_handle->i_pos);
+}
+
+/* Iteration is over the slot numbers, the stash included. Nothing is
+ * moved by a removal. */
+static void *ck_next(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator,
+		     const void **pp_key, unsigned int *size)
+{
+  cuckoo_table_t *p_t = TABLE(p_ht);
+
+  while (p_iterator->i_pos < STASH(p_t) + BUCKET_SLOTS)
+    {
+      ght_uint32_t i = p_iterator->i_pos++;
+
+      if (*slot_hash(p_t, i))
+	{
+	  *pp_key = key_at(p_t, i);
+	  if (size != NULL)
+	    *size = slot_key_size(p_t, i);
+
+	  return *slot_data(p_t, i);
+	}
+    }
+
+  *pp_key = NULL;
+  if (size != NULL)
+    *size = 0;
+
+  return NULL;
+}
+
+static void *ck_iterator_remove(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator)
+{
+  return remove_slot(p_ht, p_iterator->i_pos - 1);
+}
+
+static void *ck_first(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator,
+		      const void **pp_key, unsigned int *size)
+{
+  p_iterator->p_entry = NULL;
+  p_iterator->p_next = NULL;
+  p_iterator->i_pos = 0;
+  p_iterator->i_left = 0;
+
+  return ck_next(p_ht, p_iterator, pp_key, size);
+}
+
+static void ck_rehash(ght_hash_table_t *p_ht, unsigned int i_size)
+{
+  /* A size too small for the keys which collide is grown once */
+  if (rebuild(p_ht, i_size, NULL) < 0 &&
+      rebuild(p_ht, 2 * i_size, NULL) < 0)
+    {
+      fprintf(stderr, "hash_cuckoo.c ERROR: Could not rehash the table\n");
+    }
+}
+
+/* The headers of both buckets at once, a miss has to read them both
+ * anyway. Then the keys of the first bucket, where most keys are. */
+static void ck_prefetch(ght_hash_table_t *p_ht, ght_uint32_t l_hash, int i_stage)
+{
+  cuckoo_table_t *p_t = TABLE(p_ht);
+
+  if (i_stage == 0)
+    {
+      PREFETCH(BUCKET(p_t, bucket1(p_t, l_hash) * BUCKET_SLOTS));
+      PREFETCH(BUCKET(p_t, bucket2(p_t, l_hash) * BUCKET_SLOTS));
+    }
+  else
+    {
+      PREFETCH(KEY(p_t, bucket1(p_t, l_hash) * BUCKET_SLOTS));
+    }
+}
+
+static void ck_reserve(ght_hash_table_t *p_ht, unsigned int i_items)
+{
+  if (i_items >= MAX_ITEMS(p_ht->i_size))
+    {
+      rebuild(p_ht, i_items + i_items / 15 + 2, NULL);
+    }
+}
+
+const ght_engine_t ght_cuckoo_engine =
+{
+  ck_create,
+  ck_finalize,
+  ck_upsert,
+  ck_get,
+  ck_replace,
+  ck_remove,
+  ck_first,
+  ck_next,
+  ck_rehash,
+  ck_prefetch,
+  ck_reserve,
+  ck_find,
+  ck_remove_handle,
+  ck_iterator_remove,
+};
@@ -0,0 +1,348 @@
+/*********************************************************************
+ *
+ * Copyright (C) 2001-2005,  Simon Kagstrom
+ *
+ * Filename:      hash_engine.h
+ * Description:   The interface between the hash table front-end and
+ *                the alternative storage engines.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ ********************************************************************/
+#ifndef GHT_HASH_ENGINE_H
+#define GHT_HASH_ENGINE_H
+
+#include <stdio.h>  /* fprintf */
+#include <string.h> /* memcmp */
+#include <assert.h> /* assert */
+
+#include "ght_hash_table.h"
+#include "hash_lock.h"
+
+#if defined(__GNUC__)
+# define PREFETCH(p) __builtin_prefetch(p)
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+# include <xmmintrin.h> /* _mm_prefetch */
+# define PREFETCH(p) _mm_prefetch((const char*)(p), _MM_HINT_T0)
+#else
+# define PREFETCH(p)
+#endif
+
+/*
+ * A storage engine implements the table operations for one memory
+ * layout. The exported functions in hash_table.c calculate the hash
+ * value of the key and then call the engine of the table, or use the
+ * chained buckets directly if p_ht->p_engine is NULL.
+ *
+ * The engine keeps p_ht->i_items and p_ht->i_size up to date, and
+ * stores its own data in p_ht->p_engine_data.
+ */
+typedef struct s_ght_engine
+{
+  /* Set up an empty table with room for about i_size entries. Returns
+   * 0 on success, -1 otherwise. */
+  int (*fn_create)(ght_hash_table_t *p_ht, unsigned int i_size);
+  /* Free all entries and the engine data (but not p_ht) */
+  void (*fn_finalize)(ght_hash_table_t *p_ht);
+
+  /* Insert an entry like ght_insert(). If the key is already present,
+   * its data is stored in *pp_data (and replaced with p_entry_data if
+   * b_replace is set) and 1 is returned, see upsert_found(). */
+  int (*fn_upsert)(ght_hash_table_t *p_ht, void *p_entry_data,
+		   ght_hash_key_t *p_key, ght_uint32_t l_hash,
+		   int b_replace, void **pp_data);
+  void *(*fn_get)(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash);
+  void *(*fn_replace)(ght_hash_table_t *p_ht, void *p_entry_data,
+		      ght_hash_key_t *p_key, ght_uint32_t l_hash);
+  void *(*fn_remove)(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash);
+
+  /* NULL if the engine keeps its ght_hash_entry_t entries in the
+   * insertion order list (p_oldest/p_newest), which is then used */
+  void *(*fn_first)(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator,
+		    const void **pp_key, unsigned int *size);
+  void *(*fn_next)(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator,
+		   const void **pp_key, unsigned int *size);
+
+  void (*fn_rehash)(ght_hash_table_t *p_ht, unsigned int i_size);
+
+  /* Prefetch what a lookup of l_hash reads first, for ght_get_many().
+   * Stage 0 is the bucket or slot, stage 1 (called a while after stage
+   * 0 for the same hash) is what it points to. */
+  void (*fn_prefetch)(ght_hash_table_t *p_ht, ght_uint32_t l_hash, int i_stage);
+
+  /* Grow the table once so that i_items entries fit without further
+   * rehashing, for ght_insert_many(). Failing to grow is not an error,
+   * the table then grows while inserting as usual. */
+  void (*fn_reserve)(ght_hash_table_t *p_ht, unsigned int i_items);
+
+  /* Find a key without applying any heuristics and fill in
+   * *p_handle with handle_fill() and the position of the entry (in
+   * p_pos, p_pos_prev and i_pos as the engine likes). Returns 0 if the
+   * key was found, -1 otherwise. */
+  int (*fn_find)(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash,
+		 ght_handle_t *p_handle);
+  /* Remove the entry of a handle from fn_find and return its data */
+  void *(*fn_remove_handle)(ght_hash_table_t *p_ht, ght_handle_t *p_handle);
+
+  /* Remove the entry last returned by fn_first/fn_next (p_entry of
+   * the iterator for the engines without fn_first), so that the
+   * iteration can continue, and return its data */
+  void *(*fn_iterator_remove)(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator);
+} ght_engine_t;
+
+/* The pool allocator of ght_set_pool() (hash_pool.c). The context
+ * pointer of ght_pool_allocator is the pool, and fn_release destroys
+ * it. */
+typedef struct s_ght_pool ght_pool_t;
+
+ght_pool_t *ght_pool_create(void);
+extern const ght_allocator_t ght_pool_allocator;
+
+/* The key of fn_upsert() is already present, with its data at
+ * *pp_entry_data */
+static inline int upsert_found(void **pp_entry_data, void *p_new_data,
+			       int b_replace, void **pp_data)
+{
+  *pp_data = *pp_entry_data;
+  if (b_replace)
+    {
+      /* Published for lock-free readers, see get_lockfree() */
+      atomic_set_ptr(pp_entry_data, p_new_data);
+    }
+
+  return 1;
+}
+
+/* Fill in the parts of a handle which are the same for all engines */
+static inline void handle_fill(ght_handle_t *p_handle, void **pp_data,
+			       const void *p_key, unsigned int i_key_size)
+{
+  p_handle->pp_data = pp_data;
+  p_handle->p_key = p_key;
+  p_handle->i_key_size = i_key_size;
+}
+
+/* Allocate memory for an entry or a key */
+static inline void *mem_alloc(ght_hash_table_t *p_ht, size_t size)
+{
+  if (p_ht->allocator.fn_alloc)
+    {
+      return p_ht->allocator.fn_alloc(p_ht->p_alloc_ctx, size);
+    }
+  return p_ht->fn_alloc(size);
+}
+
+/* Free memory from mem_alloc(), size is the size it was allocated with */
+static inline void mem_free(ght_hash_table_t *p_ht, void *p, size_t size)
+{
+  if (p_ht->allocator.fn_alloc)
+    {
+      p_ht->allocator.fn_free(p_ht->p_alloc_ctx, p, size);
+      return;
+    }
+  p_ht->fn_free(p);
+}
+
+/* TRUE if ght_finalize() releases all entries at once, so the engines
+ * need not free them one by one */
+static inline int entries_released_at_once(ght_hash_table_t *p_ht)
+{
+  return p_ht->allocator.fn_release != NULL;
+}
+
+/*
+ * The slot used by the open addressing engines. Keys up to
+ * GHT_INLINE_KEY_SIZE bytes are stored in the slot itself, longer keys
+ * are allocated with fn_alloc.
+ */
+#define GHT_INLINE_KEY_SIZE sizeof(void*)
+
+typedef struct
+{
+  void *p_data;
+  union
+  {
+    void *p_key;                        /* Keys longer than GHT_INLINE_KEY_SIZE */
+    unsigned char data[GHT_INLINE_KEY_SIZE];
+  } key;
+  ght_uint32_t i_hash;                  /* The hash value (possibly with flags) */
+  unsigned int i_key_size;
+} ght_slot_t;
+
+static inline const void *slot_key(ght_slot_t *p_s)
+{
+  if (p_s->i_key_size <= GHT_INLINE_KEY_SIZE)
+    {
+      return p_s->key.data;
+    }
+  return p_s->key.p_key;
+}
+
+static inline int slot_key_equals(ght_slot_t *p_s, ght_hash_key_t *p_key)
+{
+  return p_s->i_key_size == p_key->i_size &&
+    memcmp(slot_key(p_s), p_key->p_key, p_key->i_size) == 0;
+}
+
+/* Fill in a slot, copying the key. Returns 0 on success, -2 if the key
+ * could not be allocated. */
+static inline int slot_fill(ght_hash_table_t *p_ht, ght_slot_t *p_s, void *p_data,
+			    ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  p_s->p_data = p_data;
+  p_s->i_hash = l_hash;
+  p_s->i_key_size = p_key->i_size;
+  if (p_key->i_size <= GHT_INLINE_KEY_SIZE)
+    {
+      memcpy(p_s->key.data, p_key->p_key, p_key->i_size);
+    }
+  else
+    {
+      if ( !(p_s->key.p_key = mem_alloc(p_ht, p_key->i_size)) )
+	{
+	  fprintf(stderr, "fn_alloc failed!\n");
+	  return -2;
+	}
+      memcpy(p_s->key.p_key, p_key->p_key, p_key->i_size);
+    }
+
+  return 0;
+}
+
+static inline void handle_fill_slot(ght_handle_t *p_handle, ght_slot_t *p_s)
+{
+  handle_fill(p_handle, &p_s->p_data, slot_key(p_s), p_s->i_key_size);
+}
+
+/* Free the key of a slot, if it is not stored inline */
+static inline void slot_free_key(ght_hash_table_t *p_ht, ght_slot_t *p_s)
+{
+  if (p_s->i_key_size > GHT_INLINE_KEY_SIZE)
+    {
+      mem_free(p_ht, p_s->key.p_key, p_s->i_key_size);
+    }
+}
+
+/*
+ * The entries used by the chained engines. The key data is stored
+ * right after the entry.
+ */
+/* Create an hash entry */
+static inline ght_hash_entry_t *he_create(ght_hash_table_t *p_ht, void *p_data,
+					  unsigned int i_key_size, const void *p_key_data,
+					  ght_uint32_t l_hash)
+{
+  ght_hash_entry_t *p_he;
+
+  /*
+   * An element like the following is allocated:
+   *        elem->p_key
+   *       /   elem->p_key->p_key_data
+   *  ____|___/________
+   * |elem|key|key data|
+   * |____|___|________|
+   *
+   * That is, the key and the key data is stored "inline" within the
+   * hash entry.
+   *
+   * This saves space since malloc only is called once and thus avoids
+   * some fragmentation. Thanks to Dru Lemley for this idea.
+   */
+  if ( !(p_he = (ght_hash_entry_t*)mem_alloc(p_ht, sizeof(ght_hash_entry_t)+i_key_size)) )
+    {
+      fprintf(stderr, "fn_alloc failed!\n");
+      return NULL;
+    }
+
+  p_he->p_data = p_data;
+  p_he->p_next = NULL;
+  p_he->p_prev = NULL;
+  p_he->p_older = NULL;
+  p_he->p_newer = NULL;
+  p_he->i_hash = l_hash;
+
+  /* Create the key */
+  p_he->key.i_size = i_key_size;
+  memcpy(p_he+1, p_key_data, i_key_size);
+  p_he->key.p_key = (void*)(p_he+1);
+
+  return p_he;
+}
+
+/* Finalize (free) a hash entry */
+static inline void he_finalize(ght_hash_table_t *p_ht, ght_hash_entry_t *p_he)
+{
+  assert(p_he);
+
+#if !defined(NDEBUG)
+  p_he->p_next = NULL;
+  p_he->p_prev = NULL;
+  p_he->p_older = NULL;
+  p_he->p_newer = NULL;
+#endif /* NDEBUG */
+
+  /* Free the entry */
+  mem_free(p_ht, p_he, sizeof(ght_hash_entry_t)+p_he->key.i_size);
+}
+
+/* Link an entry last in the insertion order list */
+static inline void order_append(ght_hash_table_t *p_ht, ght_hash_entry_t *p_e)
+{
+  if (p_ht->p_oldest == NULL)
+    {
+      p_ht->p_oldest = p_e;
+    }
+  p_e->p_older = p_ht->p_newest;
+
+  if (p_ht->p_newest != NULL)
+    {
+      p_ht->p_newest->p_newer = p_e;
+    }
+
+  p_ht->p_newest = p_e;
+}
+
+/* Link an entry out of the insertion order list */
+static inline void order_remove(ght_hash_table_t *p_ht, ght_hash_entry_t *p_e)
+{
+  if (p_e->p_older)
+    {
+      p_e->p_older->p_newer = p_e->p_newer;
+    }
+  else /* oldest */
+    {
+      p_ht->p_oldest = p_e->p_newer;
+    }
+  if (p_e->p_newer)
+    {
+      p_e->p_newer->p_older = p_e->p_older;
+    }
+  else /* newest */
+    {
+      p_ht->p_newest = p_e->p_older;
+    }
+}
+
+/* The available engines (GHT_ENGINE_CHAINED is built into hash_table.c) */
+extern const ght_engine_t ght_robin_hood_engine;
+extern const ght_engine_t ght_swiss_engine;
+extern const ght_engine_t ght_cuckoo_engine;
+extern const ght_engine_t ght_block_chained_engine;
+extern const ght_engine_t ght_compact_engine;
+extern const ght_engine_t ght_slim_engine;
+extern const ght_engine_t ght_slim_unordered_engine;
+
+#endif /* GHT_HASH_ENGINE_H */
@@ -0,0 +1,142 @@
+/*********************************************************************
+ *
+ * Copyright (C) 2001-2005,  Simon Kagstrom
+ *
+ * Filename:      hash_epoch.c
+ * Description:   Quiescent state based reclamation for the lock-free
+ *                reads of concurrent tables.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ ********************************************************************/
+
+#include <stdlib.h> /* malloc */
+#include <stdio.h>  /* perror */
+
+#include "ght_hash_table.h"
+#include "hash_lock.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/*
+ * Every registered thread has a reader, which holds the epoch of its
+ * last quiescent state. The readers are written by their own thread
+ * only, so they are kept on separate cache lines. Lock-free reads
+ * store nothing at all; the epoch is only written by ght_quiescent()
+ * (and by the writers of the tables, which are quiescent as well).
+ */
+typedef struct s_ght_reader
+{
+  unsigned int i_epoch;
+  struct s_ght_reader *p_next;
+  char pad[64];
+} ght_reader_t;
+
+/* The current epoch, which only the writers increase */
+static unsigned int i_global_epoch = 1;
+
+/* All readers, the lock is only taken for writing to add and remove */
+static ght_reader_t *p_readers = NULL;
+static ght_rwlock_t readers_lock = RWLOCK_INITIALIZER;
+
+static THREAD_LOCAL ght_reader_t *p_self = NULL;
+
+/* Register the calling thread for lock-free reads */
+int ght_reader_register(void)
+{
+#if defined(GHT_NO_THREADS)
+  return -1;
+#else
+  if (p_self)
+    {
+      return 0;
+    }
+  if ( !(p_self = (ght_reader_t*)malloc(sizeof(ght_reader_t))) )
+    {
+      perror("malloc");
+      return -1;
+    }
+  p_self->i_epoch = atomic_get_uint(&i_global_epoch);
+
+  rwlock_wrlock(&readers_lock);
+  p_self->p_next = p_readers;
+  p_readers = p_self;
+  rwlock_wrunlock(&readers_lock);
+
+  return 0;
+#endif
+}
+
+/* Unregister the calling thread */
+void ght_reader_unregister(void)
+{
+  ght_reader_t **pp;
+
+  if (!p_self)
+    {
+      return;
+    }
+
+  rwlock_wrlock(&readers_lock);
+  for (pp = &p_readers; *pp != p_self; pp = &(*pp)->p_next);
+  *pp = p_self->p_next;
+  rwlock_wrunlock(&readers_lock);
+
+  free(p_self);
+  p_self = NULL;
+}
+
+/* Note that the calling thread holds no entries of lock-free tables */
+void ght_quiescent(void)
+{
+  if (p_self)
+    {
+      atomic_set_uint(&p_self->i_epoch, atomic_get_uint(&i_global_epoch));
+    }
+}
+
+unsigned int ght_epoch_new(void)
+{
+  unsigned int i_epoch = atomic_inc_uint(&i_global_epoch);
+
+  /* The writer holds no entries from lock-free reads either */
+  ght_quiescent();
+
+  return i_epoch;
+}
+
+int ght_epoch_passed(unsigned int i_epoch)
+{
+  ght_reader_t *p;
+  int b_passed = TRUE;
+
+  rwlock_rdlock(&readers_lock);
+  for (p = p_readers; p && b_passed; p = p->p_next)
+    {
+      /* Compared like this to handle wrapping */
+      b_passed = (int)(atomic_get_uint(&p->i_epoch) - i_epoch) >= 0;
+    }
+  rwlock_rdunlock(&readers_lock);
+
+  return b_passed;
+}
+
+int ght_epoch_reader(void)
+{
+  return p_self != NULL;
+}
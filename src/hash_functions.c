@@ -24,8 +24,13 @@
  *
  ********************************************************************/
 #include <assert.h>
+#include <string.h> /* memcpy */
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>   /* _umul128 */
+#endif
 
 #include "ght_hash_table.h"
+#include "hash_lock.h"
 
 static ght_uint32_t crc32_table[256] =
 {
@@ -63,8 +68,8 @@ static ght_uint32_t crc32_table[256] =
   0xafb010b1,0xab710d06,0xa6322bdf,0xa2f33668,0xbcb4666d,0xb8757bda,0xb5365d03,0xb1f740b4
 };
 
-/* One-at-a-time hash (found in a web article from ddj), this is the
- * standard hash function.
+/* One-at-a-time hash (found in a web article from ddj), this was the
+ * standard hash function before ght_wy_hash().
  *
  * See http://burtleburtle.net/bob/hash/doobs.html
  * for the hash functions used here.
@@ -123,3 +128,917 @@ ght_uint32_t ght_rotating_hash(ght_hash_key_t *p_key)
 
   return i_hash;
 }
+
+/*
+ * The hash functions below read the key eight bytes at a time into a
+ * 64-bit state. The loads are done with memcpy(), which compilers turn
+ * into single (unaligned) loads, and in the byte order of the machine,
+ * so the hash values differ between little- and big-endian machines.
+ */
+typedef unsigned long long u64_t;
+
+static inline u64_t read64(const unsigned char *p)
+{
+  u64_t v;
+
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline u64_t read32(const unsigned char *p)
+{
+  ght_uint32_t v;
+
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline u64_t rotl64(u64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+#define XX_PRIME1 0x9E3779B185EBCA87ULL
+#define XX_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define XX_PRIME3 0x165667B19E3779F9ULL
+#define XX_PRIME4 0x85EBCA77C2B2AE63ULL
+#define XX_PRIME5 0x27D4EB2F165667C5ULL
+
+static inline u64_t xx_round(u64_t acc, u64_t input)
+{
+  acc += input * XX_PRIME2;
+  acc = rotl64(acc, 31);
+  return acc * XX_PRIME1;
+}
+
+static inline u64_t xx_merge_round(u64_t acc, u64_t val)
+{
+  acc ^= xx_round(0, val);
+  return acc * XX_PRIME1 + XX_PRIME4;
+}
+
+/* xxHash64 (seed 0) by Yann Collet, see https://github.com/Cyan4973/xxHash */
+ght_uint32_t ght_xx_hash(ght_hash_key_t *p_key)
+{
+  const unsigned char *p;
+  const unsigned char *p_end;
+  u64_t h;
+
+  assert(p_key);
+
+  p = (const unsigned char*)p_key->p_key;
+  p_end = p + p_key->i_size;
+
+  if (p_key->i_size >= 32)
+    {
+      const unsigned char *p_limit = p_end - 32;
+      u64_t v1 = XX_PRIME1 + XX_PRIME2;
+      u64_t v2 = XX_PRIME2;
+      u64_t v3 = 0;
+      u64_t v4 = 0 - XX_PRIME1;
+
+      do
+	{
+	  v1 = xx_round(v1, read64(p));
+	  v2 = xx_round(v2, read64(p + 8));
+	  v3 = xx_round(v3, read64(p + 16));
+	  v4 = xx_round(v4, read64(p + 24));
+	  p += 32;
+	} while (p <= p_limit);
+
+      h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+      h = xx_merge_round(h, v1);
+      h = xx_merge_round(h, v2);
+      h = xx_merge_round(h, v3);
+      h = xx_merge_round(h, v4);
+    }
+  else
+    {
+      h = XX_PRIME5;
+    }
+  h += (u64_t)p_key->i_size;
+
+  while (p + 8 <= p_end)
+    {
+      h ^= xx_round(0, read64(p));
+      h = rotl64(h, 27) * XX_PRIME1 + XX_PRIME4;
+      p += 8;
+    }
+  if (p + 4 <= p_end)
+    {
+      h ^= read32(p) * XX_PRIME1;
+      h = rotl64(h, 23) * XX_PRIME2 + XX_PRIME3;
+      p += 4;
+    }
+  while (p < p_end)
+    {
+      h ^= (*p++) * XX_PRIME5;
+      h = rotl64(h, 11) * XX_PRIME1;
+    }
+
+  h ^= h >> 33;
+  h *= XX_PRIME2;
+  h ^= h >> 29;
+  h *= XX_PRIME3;
+  h ^= h >> 32;
+
+  return (ght_uint32_t)h;
+}
+
+/* The 128-bit product of a and b, the low half in *p_a and the high
+ * half in *p_b */
+static inline void wy_mum(u64_t *p_a, u64_t *p_b)
+{
+#if defined(__SIZEOF_INT128__)
+  unsigned __int128 r = *p_a;
+
+  r *= *p_b;
+  *p_a = (u64_t)r;
+  *p_b = (u64_t)(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+  *p_a = _umul128(*p_a, *p_b, p_b);
+#else
+  u64_t ha = *p_a >> 32, hb = *p_b >> 32;
+  u64_t la = (ght_uint32_t)*p_a, lb = (ght_uint32_t)*p_b;
+  u64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  u64_t t = rl + (rm0 << 32);
+  u64_t c = t < rl;
+  u64_t lo = t + (rm1 << 32);
+
+  c += lo < t;
+  *p_a = lo;
+  *p_b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline u64_t wy_mix(u64_t a, u64_t b)
+{
+  wy_mum(&a, &b);
+  return a ^ b;
+}
+
+static const u64_t wy_secret[4] =
+{
+  0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+  0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL
+};
+
+/* wyhash (final version 4, seed 0) by Wang Yi, see
+ * https://github.com/wangyi-fudan/wyhash */
+static inline ght_uint32_t wy_hash(const unsigned char *p, size_t i_len)
+{
+  u64_t seed;
+  u64_t a, b;
+
+  seed = wy_mix(wy_secret[0], wy_secret[1]);
+  if (i_len <= 16)
+    {
+      if (i_len >= 4)
+	{
+	  a = (read32(p) << 32) | read32(p + ((i_len >> 3) << 2));
+	  b = (read32(p + i_len - 4) << 32) | read32(p + i_len - 4 - ((i_len >> 3) << 2));
+	}
+      else if (i_len > 0)
+	{
+	  a = ((u64_t)p[0] << 16) | ((u64_t)p[i_len >> 1] << 8) | p[i_len - 1];
+	  b = 0;
+	}
+      else
+	{
+	  a = b = 0;
+	}
+    }
+  else
+    {
+      size_t i = i_len;
+
+      if (i >= 48)
+	{
+	  u64_t see1 = seed, see2 = seed;
+
+	  do
+	    {
+	      seed = wy_mix(read64(p) ^ wy_secret[1], read64(p + 8) ^ seed);
+	      see1 = wy_mix(read64(p + 16) ^ wy_secret[2], read64(p + 24) ^ see1);
+	      see2 = wy_mix(read64(p + 32) ^ wy_secret[3], read64(p + 40) ^ see2);
+	      p += 48;
+	      i -= 48;
+	    } while (i >= 48);
+	  seed ^= see1 ^ see2;
+	}
+      while (i > 16)
+	{
+	  seed = wy_mix(read64(p) ^ wy_secret[1], read64(p + 8) ^ seed);
+	  i -= 16;
+	  p += 16;
+	}
+      a = read64(p + i - 16);
+      b = read64(p + i - 8);
+    }
+
+  a ^= wy_secret[1];
+  b ^= seed;
+  wy_mum(&a, &b);
+  a = wy_mix(a ^ wy_secret[0] ^ i_len, b ^ wy_secret[1]);
+
+  return (ght_uint32_t)(a ^ (a >> 32));
+}
+
+/* This is the standard hash function */
+ght_uint32_t ght_wy_hash(ght_hash_key_t *p_key)
+{
+  assert(p_key);
+
+  return wy_hash((const unsigned char*)p_key->p_key, (size_t)p_key->i_size);
+}
+
+/*
+ * CRC32C and the AES-based hash use the SSE4.2 crc32 instruction and
+ * AES-NI when the CPU has them. This is checked with cpuid on the
+ * first call, which then replaces the function pointer below with the
+ * best implementation. The portable versions give the same hash
+ * values, so the choice never changes the result.
+ */
+#if (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) && \
+     (defined(__x86_64__) || defined(__i386__))) || \
+    (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+# define USE_X86_HW 1
+# include <nmmintrin.h> /* _mm_crc32_* */
+# include <wmmintrin.h> /* _mm_aesenc_si128 */
+# if defined(_MSC_VER)
+#  include <intrin.h>   /* __cpuid */
+#  define TARGET(x)
+# else
+#  include <cpuid.h>    /* __get_cpuid */
+#  define TARGET(x) __attribute__((target(x)))
+# endif
+
+# include <immintrin.h> /* AVX2, AVX-512 */
+
+#define CPU_SSE42    1
+#define CPU_AES      2
+#define CPU_AVX2     4
+#define CPU_AVX512   8
+#define CPU_CHECKED  0x80
+
+/* The features of the CPU (CPU_*), from cpuid. The AVX ones also need
+ * the OS to save the wider registers, which xgetbv tells. */
+static unsigned int cpu_features(void)
+{
+  static unsigned int i_features;
+  unsigned int regs1[4] = { 0, 0, 0, 0 };
+  unsigned int regs7[4] = { 0, 0, 0, 0 };
+  unsigned int i_xcr0 = 0;
+  unsigned int i = CPU_CHECKED;
+
+  if ( (i = atomic_get_uint(&i_features)) )
+    {
+      return i;
+    }
+  i = CPU_CHECKED;
+
+# if defined(_MSC_VER)
+  __cpuid((int*)regs1, 0);
+  if (regs1[0] >= 7)
+    {
+      __cpuidex((int*)regs7, 7, 0);
+    }
+  __cpuid((int*)regs1, 1);
+  if (regs1[2] & (1 << 27))
+    {
+      i_xcr0 = (unsigned int)_xgetbv(0);
+    }
+# else
+  if (__get_cpuid_max(0, NULL) >= 7)
+    {
+      __cpuid_count(7, 0, regs7[0], regs7[1], regs7[2], regs7[3]);
+    }
+  __get_cpuid(1, &regs1[0], &regs1[1], &regs1[2], &regs1[3]);
+  if (regs1[2] & (1 << 27))
+    {
+      unsigned int edx;
+
+      /* xgetbv, in bytes for assemblers which do not know it */
+      __asm__ (".byte 0x0f, 0x01, 0xd0" : "=a"(i_xcr0), "=d"(edx) : "c"(0));
+    }
+# endif
+
+  if (regs1[2] & (1 << 20))
+    i |= CPU_SSE42;
+  if ((regs1[2] & (1 << 25)) && (regs1[2] & (1 << 20)))
+    i |= CPU_AES;
+  /* The OS saves the YMM (and for AVX-512, the ZMM and mask) registers */
+  if ((i_xcr0 & 0x06) == 0x06 && (regs7[1] & (1 << 5)))
+    i |= CPU_AVX2;
+  if ((i_xcr0 & 0xe6) == 0xe6 && (regs7[1] & (1 << 16)))
+    i |= CPU_AVX512;
+
+  atomic_set_uint(&i_features, i);
+
+  return i;
+}
+#endif /* USE_X86_HW */
+
+/* CRC32C (Castagnoli) of a key, the polynomial of the SSE4.2 crc32
+ * instruction, reflected (0x82f63b78). The table is constant rather
+ * than built on first use, as the hash functions may be called by
+ * several threads at once. */
+static const ght_uint32_t crc32c_table[256] =
+{
+  0x00000000,0xf26b8303,0xe13b70f7,0x1350f3f4,0xc79a971f,0x35f1141c,0x26a1e7e8,0xd4ca64eb,
+  0x8ad958cf,0x78b2dbcc,0x6be22838,0x9989ab3b,0x4d43cfd0,0xbf284cd3,0xac78bf27,0x5e133c24,
+  0x105ec76f,0xe235446c,0xf165b798,0x030e349b,0xd7c45070,0x25afd373,0x36ff2087,0xc494a384,
+  0x9a879fa0,0x68ec1ca3,0x7bbcef57,0x89d76c54,0x5d1d08bf,0xaf768bbc,0xbc267848,0x4e4dfb4b,
+  0x20bd8ede,0xd2d60ddd,0xc186fe29,0x33ed7d2a,0xe72719c1,0x154c9ac2,0x061c6936,0xf477ea35,
+  0xaa64d611,0x580f5512,0x4b5fa6e6,0xb93425e5,0x6dfe410e,0x9f95c20d,0x8cc531f9,0x7eaeb2fa,
+  0x30e349b1,0xc288cab2,0xd1d83946,0x23b3ba45,0xf779deae,0x05125dad,0x1642ae59,0xe4292d5a,
+  0xba3a117e,0x4851927d,0x5b016189,0xa96ae28a,0x7da08661,0x8fcb0562,0x9c9bf696,0x6ef07595,
+  0x417b1dbc,0xb3109ebf,0xa0406d4b,0x522bee48,0x86e18aa3,0x748a09a0,0x67dafa54,0x95b17957,
+  0xcba24573,0x39c9c670,0x2a993584,0xd8f2b687,0x0c38d26c,0xfe53516f,0xed03a29b,0x1f682198,
+  0x5125dad3,0xa34e59d0,0xb01eaa24,0x42752927,0x96bf4dcc,0x64d4cecf,0x77843d3b,0x85efbe38,
+  0xdbfc821c,0x2997011f,0x3ac7f2eb,0xc8ac71e8,0x1c661503,0xee0d9600,0xfd5d65f4,0x0f36e6f7,
+  0x61c69362,0x93ad1061,0x80fde395,0x72966096,0xa65c047d,0x5437877e,0x4767748a,0xb50cf789,
+  0xeb1fcbad,0x197448ae,0x0a24bb5a,0xf84f3859,0x2c855cb2,0xdeeedfb1,0xcdbe2c45,0x3fd5af46,
+  0x7198540d,0x83f3d70e,0x90a324fa,0x62c8a7f9,0xb602c312,0x44694011,0x5739b3e5,0xa55230e6,
+  0xfb410cc2,0x092a8fc1,0x1a7a7c35,0xe811ff36,0x3cdb9bdd,0xceb018de,0xdde0eb2a,0x2f8b6829,
+  0x82f63b78,0x709db87b,0x63cd4b8f,0x91a6c88c,0x456cac67,0xb7072f64,0xa457dc90,0x563c5f93,
+  0x082f63b7,0xfa44e0b4,0xe9141340,0x1b7f9043,0xcfb5f4a8,0x3dde77ab,0x2e8e845f,0xdce5075c,
+  0x92a8fc17,0x60c37f14,0x73938ce0,0x81f80fe3,0x55326b08,0xa759e80b,0xb4091bff,0x466298fc,
+  0x1871a4d8,0xea1a27db,0xf94ad42f,0x0b21572c,0xdfeb33c7,0x2d80b0c4,0x3ed04330,0xccbbc033,
+  0xa24bb5a6,0x502036a5,0x4370c551,0xb11b4652,0x65d122b9,0x97baa1ba,0x84ea524e,0x7681d14d,
+  0x2892ed69,0xdaf96e6a,0xc9a99d9e,0x3bc21e9d,0xef087a76,0x1d63f975,0x0e330a81,0xfc588982,
+  0xb21572c9,0x407ef1ca,0x532e023e,0xa145813d,0x758fe5d6,0x87e466d5,0x94b49521,0x66df1622,
+  0x38cc2a06,0xcaa7a905,0xd9f75af1,0x2b9cd9f2,0xff56bd19,0x0d3d3e1a,0x1e6dcdee,0xec064eed,
+  0xc38d26c4,0x31e6a5c7,0x22b65633,0xd0ddd530,0x0417b1db,0xf67c32d8,0xe52cc12c,0x1747422f,
+  0x49547e0b,0xbb3ffd08,0xa86f0efc,0x5a048dff,0x8ecee914,0x7ca56a17,0x6ff599e3,0x9d9e1ae0,
+  0xd3d3e1ab,0x21b862a8,0x32e8915c,0xc083125f,0x144976b4,0xe622f5b7,0xf5720643,0x07198540,
+  0x590ab964,0xab613a67,0xb831c993,0x4a5a4a90,0x9e902e7b,0x6cfbad78,0x7fab5e8c,0x8dc0dd8f,
+  0xe330a81a,0x115b2b19,0x020bd8ed,0xf0605bee,0x24aa3f05,0xd6c1bc06,0xc5914ff2,0x37faccf1,
+  0x69e9f0d5,0x9b8273d6,0x88d28022,0x7ab90321,0xae7367ca,0x5c18e4c9,0x4f48173d,0xbd23943e,
+  0xf36e6f75,0x0105ec76,0x12551f82,0xe03e9c81,0x34f4f86a,0xc69f7b69,0xd5cf889d,0x27a40b9e,
+  0x79b737ba,0x8bdcb4b9,0x988c474d,0x6ae7c44e,0xbe2da0a5,0x4c4623a6,0x5f16d052,0xad7d5351
+};
+
+static ght_uint32_t crc32c_soft(const unsigned char *p, size_t i_len)
+{
+  ght_uint32_t crc = 0xffffffff;
+
+  while (i_len--)
+    {
+      crc = (crc >> 8) ^ crc32c_table[(crc ^ *p++) & 0xff];
+    }
+
+  return ~crc;
+}
+
+#ifdef USE_X86_HW
+TARGET("sse4.2")
+static ght_uint32_t crc32c_hw(const unsigned char *p, size_t i_len)
+{
+# if defined(__x86_64__) || defined(_M_X64)
+  u64_t crc = 0xffffffff;
+
+  for (; i_len >= 8; i_len -= 8, p += 8)
+    {
+      crc = _mm_crc32_u64(crc, read64(p));
+    }
+# else
+  ght_uint32_t crc = 0xffffffff;
+# endif
+  for (; i_len >= 4; i_len -= 4, p += 4)
+    {
+      crc = _mm_crc32_u32((ght_uint32_t)crc, (ght_uint32_t)read32(p));
+    }
+  while (i_len--)
+    {
+      crc = _mm_crc32_u8((ght_uint32_t)crc, *p++);
+    }
+
+  return ~(ght_uint32_t)crc;
+}
+#endif /* USE_X86_HW */
+
+/*
+ * The implementations of CRC32C and the AES hash are selected on the
+ * first call. Other threads may call through the pointers while they
+ * are set, so they are read and written with atomic_get_ptr() and
+ * atomic_set_ptr(). Every thread selects the same one.
+ */
+typedef ght_uint32_t (*hash_impl_t)(const unsigned char *p, size_t i_len);
+
+static ght_uint32_t crc32c_select(const unsigned char *p, size_t i_len);
+static hash_impl_t crc32c_impl = crc32c_select;
+
+static ght_uint32_t crc32c_select(const unsigned char *p, size_t i_len)
+{
+  hash_impl_t fn = crc32c_soft;
+
+#ifdef USE_X86_HW
+  if (cpu_features() & CPU_SSE42)
+    {
+      fn = crc32c_hw;
+    }
+#endif
+  atomic_set_ptr(&crc32c_impl, fn);
+
+  return fn(p, i_len);
+}
+
+/* CRC32C hash. The CRC is linear, so the result is mixed once more to
+ * spread the bits of short keys over the whole hash value. */
+ght_uint32_t ght_crc32c_hash(ght_hash_key_t *p_key)
+{
+  ght_uint32_t i_hash;
+
+  assert(p_key);
+
+  i_hash = ((hash_impl_t)atomic_get_ptr(&crc32c_impl))((const unsigned char*)p_key->p_key,
+							(size_t)p_key->i_size);
+  i_hash ^= i_hash >> 16;
+  i_hash *= 0x85ebca6b;
+  i_hash ^= i_hash >> 13;
+
+  return i_hash;
+}
+
+/*
+ * The AES hash runs one AES encryption round (ShiftRows, SubBytes,
+ * MixColumns and a round key) per 16-byte block of the key on two
+ * 128-bit lanes, so 32 bytes are handled per iteration. The lanes
+ * start from the key length, and the last block overlaps the one
+ * before it. Keys shorter than 16 bytes are made into one block from
+ * (overlapping) loads of their first and last bytes, like in wyhash.
+ * Three more rounds mix the lanes together at the end. This is not a
+ * cryptographic hash.
+ */
+typedef struct
+{
+  unsigned char b[16];
+} aes_block_t;
+
+static const unsigned char aes_keys[4][16] =
+{
+  { 0xa5,0x78,0x6c,0xaa,0xcc,0x8d,0x35,0x2d,0xc9,0xac,0x2e,0x96,0x93,0x4b,0xb8,0x8b },
+  { 0xa3,0xd4,0x33,0xd4,0x2e,0xa6,0x33,0x4b,0x47,0xaa,0xe1,0x1d,0xa5,0x2d,0x5a,0x4d },
+  { 0x87,0xca,0xeb,0x85,0xb1,0x79,0x37,0x9e,0x4f,0xeb,0xd4,0x27,0x3d,0xae,0xb2,0xc2 },
+  { 0xf9,0x79,0x37,0x9e,0xb1,0x67,0x56,0x16,0x63,0xae,0xb2,0xc2,0x77,0xca,0xeb,0x85 },
+};
+
+static const unsigned char aes_sbox[256] =
+{
+  0x63,0x7c,0x77,0x7b,0xf2,0x6b,0x6f,0xc5,0x30,0x01,0x67,0x2b,0xfe,0xd7,0xab,0x76,
+  0xca,0x82,0xc9,0x7d,0xfa,0x59,0x47,0xf0,0xad,0xd4,0xa2,0xaf,0x9c,0xa4,0x72,0xc0,
+  0xb7,0xfd,0x93,0x26,0x36,0x3f,0xf7,0xcc,0x34,0xa5,0xe5,0xf1,0x71,0xd8,0x31,0x15,
+  0x04,0xc7,0x23,0xc3,0x18,0x96,0x05,0x9a,0x07,0x12,0x80,0xe2,0xeb,0x27,0xb2,0x75,
+  0x09,0x83,0x2c,0x1a,0x1b,0x6e,0x5a,0xa0,0x52,0x3b,0xd6,0xb3,0x29,0xe3,0x2f,0x84,
+  0x53,0xd1,0x00,0xed,0x20,0xfc,0xb1,0x5b,0x6a,0xcb,0xbe,0x39,0x4a,0x4c,0x58,0xcf,
+  0xd0,0xef,0xaa,0xfb,0x43,0x4d,0x33,0x85,0x45,0xf9,0x02,0x7f,0x50,0x3c,0x9f,0xa8,
+  0x51,0xa3,0x40,0x8f,0x92,0x9d,0x38,0xf5,0xbc,0xb6,0xda,0x21,0x10,0xff,0xf3,0xd2,
+  0xcd,0x0c,0x13,0xec,0x5f,0x97,0x44,0x17,0xc4,0xa7,0x7e,0x3d,0x64,0x5d,0x19,0x73,
+  0x60,0x81,0x4f,0xdc,0x22,0x2a,0x90,0x88,0x46,0xee,0xb8,0x14,0xde,0x5e,0x0b,0xdb,
+  0xe0,0x32,0x3a,0x0a,0x49,0x06,0x24,0x5c,0xc2,0xd3,0xac,0x62,0x91,0x95,0xe4,0x79,
+  0xe7,0xc8,0x37,0x6d,0x8d,0xd5,0x4e,0xa9,0x6c,0x56,0xf4,0xea,0x65,0x7a,0xae,0x08,
+  0xba,0x78,0x25,0x2e,0x1c,0xa6,0xb4,0xc6,0xe8,0xdd,0x74,0x1f,0x4b,0xbd,0x8b,0x8a,
+  0x70,0x3e,0xb5,0x66,0x48,0x03,0xf6,0x0e,0x61,0x35,0x57,0xb9,0x86,0xc1,0x1d,0x9e,
+  0xe1,0xf8,0x98,0x11,0x69,0xd9,0x8e,0x94,0x9b,0x1e,0x87,0xe9,0xce,0x55,0x28,0xdf,
+  0x8c,0xa1,0x89,0x0d,0xbf,0xe6,0x42,0x68,0x41,0x99,0x2d,0x0f,0xb0,0x54,0xbb,0x16
+};
+
+/* One AES encryption round, the same as _mm_aesenc_si128(*p_s, *p_k) */
+static inline void aes_round_soft(aes_block_t *p_s, const unsigned char *p_k)
+{
+  unsigned char t[16];
+  int c, r;
+
+  /* SubBytes and ShiftRows, the state is in columns of four bytes */
+  for (c = 0; c < 4; c++)
+    {
+      for (r = 0; r < 4; r++)
+	{
+	  t[4 * c + r] = aes_sbox[p_s->b[4 * ((c + r) & 3) + r]];
+	}
+    }
+  /* MixColumns and AddRoundKey */
+  for (c = 0; c < 4; c++)
+    {
+      unsigned char *p = &t[4 * c];
+      unsigned char a = p[0] ^ p[1] ^ p[2] ^ p[3];
+
+      for (r = 0; r < 4; r++)
+	{
+	  unsigned char x = p[r] ^ p[(r + 1) & 3];
+
+	  x = (unsigned char)((x << 1) ^ ((x >> 7) * 0x1b));
+	  p_s->b[4 * c + r] = p[r] ^ a ^ x ^ p_k[4 * c + r];
+	}
+    }
+}
+
+static inline void aes_xor(aes_block_t *p_s, const unsigned char *p)
+{
+  int i;
+
+  for (i = 0; i < 16; i++)
+    {
+      p_s->b[i] ^= p[i];
+    }
+}
+
+/* The block of a key shorter than 16 bytes, as two 64-bit halves */
+static inline void aes_short_block(const unsigned char *p, size_t i_len,
+				   u64_t *p_lo, u64_t *p_hi)
+{
+  if (i_len >= 8)
+    {
+      *p_lo = read64(p);
+      *p_hi = read64(p + i_len - 8);
+    }
+  else if (i_len >= 4)
+    {
+      *p_lo = read32(p);
+      *p_hi = read32(p + i_len - 4);
+    }
+  else if (i_len > 0)
+    {
+      *p_lo = ((u64_t)p[0] << 16) | ((u64_t)p[i_len >> 1] << 8) | p[i_len - 1];
+      *p_hi = 0;
+    }
+  else
+    {
+      *p_lo = *p_hi = 0;
+    }
+}
+
+static ght_uint32_t aes_hash_soft(const unsigned char *p, size_t i_len)
+{
+  aes_block_t s0, s1;
+  u64_t half[2];
+  ght_uint32_t i_hash;
+
+  memcpy(s0.b, aes_keys[0], 16);
+  memcpy(s1.b, aes_keys[1], 16);
+  half[0] = 0;
+  half[1] = (u64_t)i_len;
+  aes_xor(&s0, (const unsigned char*)half);
+  if (i_len < 16)
+    {
+      aes_short_block(p, i_len, &half[0], &half[1]);
+      aes_xor(&s0, (const unsigned char*)half);
+      aes_round_soft(&s0, aes_keys[2]);
+    }
+  else
+    {
+      const unsigned char *p_last = p + i_len - 16;
+      size_t i_left = i_len;
+
+      for (; i_left > 32; i_left -= 32, p += 32)
+	{
+	  aes_xor(&s0, p);
+	  aes_round_soft(&s0, aes_keys[2]);
+	  aes_xor(&s1, p + 16);
+	  aes_round_soft(&s1, aes_keys[3]);
+	}
+      if (i_left > 16)
+	{
+	  aes_xor(&s1, p);
+	  aes_round_soft(&s1, aes_keys[3]);
+	}
+      aes_xor(&s0, p_last);
+      aes_round_soft(&s0, aes_keys[2]);
+    }
+  aes_xor(&s0, s1.b);
+  aes_round_soft(&s0, aes_keys[0]);
+  aes_round_soft(&s0, aes_keys[1]);
+  aes_round_soft(&s0, aes_keys[2]);
+  memcpy(&i_hash, s0.b, sizeof(i_hash));
+
+  return i_hash;
+}
+
+#ifdef USE_X86_HW
+TARGET("aes,sse4.2")
+static ght_uint32_t aes_hash_hw(const unsigned char *p, size_t i_len)
+{
+  __m128i k0 = _mm_loadu_si128((const __m128i*)aes_keys[0]);
+  __m128i k1 = _mm_loadu_si128((const __m128i*)aes_keys[1]);
+  __m128i k2 = _mm_loadu_si128((const __m128i*)aes_keys[2]);
+  __m128i k3 = _mm_loadu_si128((const __m128i*)aes_keys[3]);
+  __m128i s0 = _mm_xor_si128(k0, _mm_set_epi64x((long long)i_len, 0));
+  __m128i s1 = k1;
+
+  if (i_len < 16)
+    {
+      u64_t lo, hi;
+
+      aes_short_block(p, i_len, &lo, &hi);
+      s0 = _mm_aesenc_si128(_mm_xor_si128(s0, _mm_set_epi64x((long long)hi, (long long)lo)), k2);
+    }
+  else
+    {
+      const unsigned char *p_last = p + i_len - 16;
+      size_t i_left = i_len;
+
+      for (; i_left > 32; i_left -= 32, p += 32)
+	{
+	  s0 = _mm_aesenc_si128(_mm_xor_si128(s0, _mm_loadu_si128((const __m128i*)p)), k2);
+	  s1 = _mm_aesenc_si128(_mm_xor_si128(s1, _mm_loadu_si128((const __m128i*)(p + 16))), k3);
+	}
+      if (i_left > 16)
+	{
+	  s1 = _mm_aesenc_si128(_mm_xor_si128(s1, _mm_loadu_si128((const __m128i*)p)), k3);
+	}
+      s0 = _mm_aesenc_si128(_mm_xor_si128(s0, _mm_loadu_si128((const __m128i*)p_last)), k2);
+    }
+  s0 = _mm_xor_si128(s0, s1);
+  s0 = _mm_aesenc_si128(s0, k0);
+  s0 = _mm_aesenc_si128(s0, k1);
+  s0 = _mm_aesenc_si128(s0, k2);
+
+  return (ght_uint32_t)_mm_cvtsi128_si32(s0);
+}
+#endif /* USE_X86_HW */
+
+static ght_uint32_t aes_hash_select(const unsigned char *p, size_t i_len);
+static hash_impl_t aes_hash_impl = aes_hash_select;
+
+static ght_uint32_t aes_hash_select(const unsigned char *p, size_t i_len)
+{
+  hash_impl_t fn = aes_hash_soft;
+
+#ifdef USE_X86_HW
+  if (cpu_features() & CPU_AES)
+    {
+      fn = aes_hash_hw;
+    }
+#endif
+  atomic_set_ptr(&aes_hash_impl, fn);
+
+  return fn(p, i_len);
+}
+
+ght_uint32_t ght_aes_hash(ght_hash_key_t *p_key)
+{
+  assert(p_key);
+
+  return ((hash_impl_t)atomic_get_ptr(&aes_hash_impl))((const unsigned char*)p_key->p_key,
+						       (size_t)p_key->i_size);
+}
+
+/* The fastest hash function on this CPU */
+ght_fn_hash_t ght_best_hash(void)
+{
+#ifdef USE_X86_HW
+  if (cpu_features() & CPU_AES)
+    {
+      return ght_aes_hash;
+    }
+#endif
+
+  return ght_wy_hash;
+}
+
+/*
+ * Hashing many keys of the same size at once. The keys are stored
+ * back to back, so key i starts at byte i * i_key_size.
+ *
+ * One-at-a-time works on 32-bit words only, so it is computed for 8
+ * keys at a time in the lanes of AVX2 registers, or 16 with AVX-512.
+ * Byte w of every key is fetched with gathers of 32-bit words.
+ *
+ * wyhash of 4, 8 and 16 byte keys is computed for 8 keys at a time
+ * with AVX-512, which loads the keys directly from the array. There is
+ * no 64x64->128 bit multiplication in the vector instructions, so it
+ * is made from four 32x32->64 bit ones.
+ *
+ * Everything else (and the keys left over) is hashed one key at a
+ * time, but with the hash function inlined for the supplied ones.
+ */
+#define OAAT_STEP(add, shl, shr, xor_, h, c) \
+  h = add(h, c); \
+  h = add(h, shl(h, 10)); \
+  h = xor_(h, shr(h, 6))
+
+#ifdef USE_X86_HW
+TARGET("avx2")
+static unsigned int oaat_many_avx2(const unsigned char *p_keys, unsigned int n,
+				   unsigned int i_key_size, ght_uint32_t *p_hashes)
+{
+  const __m256i idx = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+					 _mm256_set1_epi32((int)i_key_size));
+  const __m256i ff = _mm256_set1_epi32(0xff);
+  unsigned int i;
+
+  for (i = 0; i + 8 <= n; i += 8)
+    {
+      const unsigned char *p = p_keys + (size_t)i * i_key_size;
+      __m256i h = _mm256_setzero_si256();
+      unsigned int w, b;
+
+      for (w = 0; w + 4 <= i_key_size; w += 4)
+	{
+	  __m256i v = _mm256_i32gather_epi32((const int*)(p + w), idx, 1);
+
+	  for (b = 0; b < 4; b++)
+	    {
+	      __m256i c = _mm256_and_si256(_mm256_srli_epi32(v, 8 * b), ff);
+
+	      OAAT_STEP(_mm256_add_epi32, _mm256_slli_epi32, _mm256_srli_epi32,
+			_mm256_xor_si256, h, c);
+	    }
+	}
+      if (w < i_key_size)
+	{
+	  /* The last 1-3 bytes are the top of the last word */
+	  __m256i v = _mm256_i32gather_epi32((const int*)(p + i_key_size - 4), idx, 1);
+
+	  for (b = 4 - (i_key_size - w); b < 4; b++)
+	    {
+	      __m256i c = _mm256_and_si256(_mm256_srli_epi32(v, 8 * b), ff);
+
+	      OAAT_STEP(_mm256_add_epi32, _mm256_slli_epi32, _mm256_srli_epi32,
+			_mm256_xor_si256, h, c);
+	    }
+	}
+      h = _mm256_add_epi32(h, _mm256_slli_epi32(h, 3));
+      h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 11));
+      h = _mm256_add_epi32(h, _mm256_slli_epi32(h, 15));
+      _mm256_storeu_si256((__m256i*)(p_hashes + i), h);
+    }
+
+  return i;
+}
+
+TARGET("avx512f")
+static unsigned int oaat_many_avx512(const unsigned char *p_keys, unsigned int n,
+				     unsigned int i_key_size, ght_uint32_t *p_hashes)
+{
+  const __m512i idx = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7,
+							   8, 9, 10, 11, 12, 13, 14, 15),
+					 _mm512_set1_epi32((int)i_key_size));
+  const __m512i ff = _mm512_set1_epi32(0xff);
+  unsigned int i;
+
+  for (i = 0; i + 16 <= n; i += 16)
+    {
+      const unsigned char *p = p_keys + (size_t)i * i_key_size;
+      __m512i h = _mm512_setzero_si512();
+      unsigned int w, b;
+
+      for (w = 0; w + 4 <= i_key_size; w += 4)
+	{
+	  __m512i v = _mm512_i32gather_epi32(idx, (const void*)(p + w), 1);
+
+	  for (b = 0; b < 4; b++)
+	    {
+	      __m512i c = _mm512_and_si512(_mm512_srli_epi32(v, 8 * b), ff);
+
+	      OAAT_STEP(_mm512_add_epi32, _mm512_slli_epi32, _mm512_srli_epi32,
+			_mm512_xor_si512, h, c);
+	    }
+	}
+      if (w < i_key_size)
+	{
+	  __m512i v = _mm512_i32gather_epi32(idx, (const void*)(p + i_key_size - 4), 1);
+
+	  for (b = 4 - (i_key_size - w); b < 4; b++)
+	    {
+	      __m512i c = _mm512_and_si512(_mm512_srli_epi32(v, 8 * b), ff);
+
+	      OAAT_STEP(_mm512_add_epi32, _mm512_slli_epi32, _mm512_srli_epi32,
+			_mm512_xor_si512, h, c);
+	    }
+	}
+      h = _mm512_add_epi32(h, _mm512_slli_epi32(h, 3));
+      h = _mm512_xor_si512(h, _mm512_srli_epi32(h, 11));
+      h = _mm512_add_epi32(h, _mm512_slli_epi32(h, 15));
+      _mm512_storeu_si512((void*)(p_hashes + i), h);
+    }
+
+  return i;
+}
+
+/* The 128-bit products of the 64-bit lanes of a and b, the low halves
+ * in *p_a and the high halves in *p_b */
+TARGET("avx512f")
+static inline void wy_mum_avx512(__m512i *p_a, __m512i *p_b)
+{
+  const __m512i lo32 = _mm512_set1_epi64(0xffffffff);
+  __m512i a_hi = _mm512_srli_epi64(*p_a, 32);
+  __m512i b_hi = _mm512_srli_epi64(*p_b, 32);
+  __m512i ll = _mm512_mul_epu32(*p_a, *p_b);
+  __m512i lh = _mm512_mul_epu32(*p_a, b_hi);
+  __m512i hl = _mm512_mul_epu32(a_hi, *p_b);
+  __m512i hh = _mm512_mul_epu32(a_hi, b_hi);
+  __m512i mid = _mm512_add_epi64(_mm512_srli_epi64(ll, 32),
+				 _mm512_add_epi64(_mm512_and_si512(lh, lo32),
+						  _mm512_and_si512(hl, lo32)));
+
+  *p_a = _mm512_or_si512(_mm512_and_si512(ll, lo32), _mm512_slli_epi64(mid, 32));
+  *p_b = _mm512_add_epi64(_mm512_add_epi64(hh, _mm512_srli_epi64(mid, 32)),
+			  _mm512_add_epi64(_mm512_srli_epi64(lh, 32),
+					   _mm512_srli_epi64(hl, 32)));
+}
+
+/* wyhash of keys of 4, 8 or 16 bytes, the same as wy_hash() */
+TARGET("avx512f")
+static unsigned int wy_many_avx512(const unsigned char *p_keys, unsigned int n,
+				   unsigned int i_key_size, ght_uint32_t *p_hashes)
+{
+  const __m512i s0 = _mm512_set1_epi64((long long)wy_secret[0]);
+  const __m512i s1 = _mm512_set1_epi64((long long)wy_secret[1]);
+  const __m512i seed = _mm512_set1_epi64((long long)wy_mix(wy_secret[0], wy_secret[1]));
+  const __m512i len = _mm512_set1_epi64((long long)i_key_size);
+  /* The even and odd 64-bit words of two registers */
+  const __m512i even = _mm512_setr_epi64(0, 2, 4, 6, 8, 10, 12, 14);
+  const __m512i odd = _mm512_setr_epi64(1, 3, 5, 7, 9, 11, 13, 15);
+  unsigned int i;
+
+  for (i = 0; i + 8 <= n; i += 8)
+    {
+      const unsigned char *p = p_keys + (size_t)i * i_key_size;
+      __m512i a, b;
+
+      if (i_key_size == 4)
+	{
+	  /* a = b = (r4(p) << 32) | r4(p) */
+	  a = _mm512_cvtepu32_epi64(_mm256_loadu_si256((const __m256i*)p));
+	  a = _mm512_or_si512(a, _mm512_slli_epi64(a, 32));
+	  b = a;
+	}
+      else if (i_key_size == 8)
+	{
+	  /* a = (r4(p) << 32) | r4(p + 4), b = r8(p) */
+	  b = _mm512_loadu_si512((const void*)p);
+	  a = _mm512_or_si512(_mm512_slli_epi64(b, 32), _mm512_srli_epi64(b, 32));
+	}
+      else
+	{
+	  /* a = (r4(p) << 32) | r4(p + 8), b = (r4(p + 12) << 32) | r4(p + 4) */
+	  __m512i v0 = _mm512_loadu_si512((const void*)p);
+	  __m512i v1 = _mm512_loadu_si512((const void*)(p + 64));
+	  __m512i first = _mm512_permutex2var_epi64(v0, even, v1);
+	  __m512i second = _mm512_permutex2var_epi64(v0, odd, v1);
+	  const __m512i lo32 = _mm512_set1_epi64(0xffffffff);
+
+	  a = _mm512_or_si512(_mm512_slli_epi64(first, 32), _mm512_and_si512(second, lo32));
+	  b = _mm512_or_si512(_mm512_andnot_si512(lo32, second), _mm512_srli_epi64(first, 32));
+	}
+
+      a = _mm512_xor_si512(a, s1);
+      b = _mm512_xor_si512(b, seed);
+      wy_mum_avx512(&a, &b);
+      a = _mm512_xor_si512(_mm512_xor_si512(a, s0), len);
+      b = _mm512_xor_si512(b, s1);
+      wy_mum_avx512(&a, &b);
+      a = _mm512_xor_si512(a, b);
+      a = _mm512_xor_si512(a, _mm512_srli_epi64(a, 32));
+      _mm256_storeu_si256((__m256i*)(p_hashes + i), _mm512_cvtepi64_epi32(a));
+    }
+
+  return i;
+}
+#endif /* USE_X86_HW */
+
+void ght_hash_many(ght_fn_hash_t fn_hash, unsigned int n, unsigned int i_key_size,
+		   const void *p_keys, ght_uint32_t *p_hashes)
+{
+  const unsigned char *p = (const unsigned char*)p_keys;
+  unsigned int i = 0;
+
+  assert(fn_hash && (p_keys || n == 0) && (p_hashes || n == 0));
+
+#ifdef USE_X86_HW
+  if (fn_hash == ght_one_at_a_time_hash && i_key_size >= 4)
+    {
+      if (cpu_features() & CPU_AVX512)
+	i = oaat_many_avx512(p, n, i_key_size, p_hashes);
+      else if (cpu_features() & CPU_AVX2)
+	i = oaat_many_avx2(p, n, i_key_size, p_hashes);
+    }
+  else if (fn_hash == ght_wy_hash &&
+	   (i_key_size == 4 || i_key_size == 8 || i_key_size == 16) &&
+	   (cpu_features() & CPU_AVX512))
+    {
+      i = wy_many_avx512(p, n, i_key_size, p_hashes);
+    }
+#endif
+
+  if (fn_hash == ght_wy_hash)
+    {
+      for (; i < n; i++)
+	{
+	  p_hashes[i] = wy_hash(p + (size_t)i * i_key_size, i_key_size);
+	}
+    }
+  else
+    {
+      for (; i < n; i++)
+	{
+	  ght_hash_key_t key;
+
+	  key.i_size = i_key_size;
+	  key.p_key = p + (size_t)i * i_key_size;
+	  p_hashes[i] = fn_hash(&key);
+	}
+    }
+}
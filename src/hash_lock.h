@@ -0,0 +1,167 @@
+/*********************************************************************
+ *
+ * Copyright (C) 2001-2005,  Simon Kagstrom
+ *
+ * Filename:      hash_lock.h
+ * Description:   Reader/writer locks and atomic operations for the
+ *                concurrent tables, on top of pthreads or Win32.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ ********************************************************************/
+#ifndef GHT_HASH_LOCK_H
+#define GHT_HASH_LOCK_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/*
+ * rwlock_init() returns 0 on success, RWLOCK_INITIALIZER initializes
+ * static locks.
+ *
+ * The atomic functions work on unsigned ints and pointers which are
+ * read or written by other threads at the same time. The gets are
+ * acquire loads and the sets are release stores. atomic_inc_uint()
+ * is a full barrier and returns the new value.
+ *
+ * cpu_relax() tells the CPU that the thread is spinning on a value
+ * which another thread is about to change.
+ *
+ * THREAD_LOCAL declares a variable with one instance per thread.
+ *
+ * Threads run functions declared with THREAD_FN(name, arg), which end
+ * with return THREAD_RETURN, and which are of the type ght_thread_fn_t.
+ * thread_create() returns 0 on success.
+ */
+#if defined(WIN32)
+# include <windows.h> /* SRWLOCK */
+
+typedef SRWLOCK ght_rwlock_t;
+
+# define RWLOCK_INITIALIZER  SRWLOCK_INIT
+# define rwlock_init(p)      (InitializeSRWLock(p), 0)
+# define rwlock_destroy(p)
+# define rwlock_rdlock(p)    AcquireSRWLockShared(p)
+# define rwlock_rdunlock(p)  ReleaseSRWLockShared(p)
+# define rwlock_wrlock(p)    AcquireSRWLockExclusive(p)
+# define rwlock_wrunlock(p)  ReleaseSRWLockExclusive(p)
+
+/* Volatile accesses are acquire loads and release stores with MSVC */
+# define atomic_inc_uint(p)  ((unsigned int)InterlockedIncrement((volatile LONG*)(p)))
+# define atomic_get_uint(p)  (*(volatile unsigned int*)(p))
+# define atomic_set_uint(p, v) (*(volatile unsigned int*)(p) = (v))
+# define atomic_get_ptr(pp)  (*(void * volatile *)(pp))
+# define atomic_set_ptr(pp, v) (*(void * volatile *)(pp) = (v))
+# define fence_acquire()     _ReadWriteBarrier()
+# define fence_release()     _ReadWriteBarrier()
+# define cpu_relax()         YieldProcessor()
+
+# define THREAD_LOCAL        __declspec(thread)
+
+typedef HANDLE ght_thread_t;
+typedef LPTHREAD_START_ROUTINE ght_thread_fn_t;
+
+# define THREAD_FN(name, arg) DWORD WINAPI name(LPVOID arg)
+# define THREAD_RETURN       0
+# define thread_create(p, fn, arg) ((*(p) = CreateThread(NULL, 0, fn, arg, 0, NULL)) ? 0 : -1)
+# define thread_join(t)      (WaitForSingleObject(t, INFINITE), CloseHandle(t))
+
+#elif defined(HAVE_PTHREAD_H) && defined(__GNUC__)
+# include <pthread.h> /* pthread_rwlock_t */
+
+typedef pthread_rwlock_t ght_rwlock_t;
+
+# define RWLOCK_INITIALIZER  PTHREAD_RWLOCK_INITIALIZER
+# define rwlock_init(p)      pthread_rwlock_init(p, NULL)
+# define rwlock_destroy(p)   pthread_rwlock_destroy(p)
+# define rwlock_rdlock(p)    pthread_rwlock_rdlock(p)
+# define rwlock_rdunlock(p)  pthread_rwlock_unlock(p)
+# define rwlock_wrlock(p)    pthread_rwlock_wrlock(p)
+# define rwlock_wrunlock(p)  pthread_rwlock_unlock(p)
+
+# define atomic_inc_uint(p)  __atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST)
+# define atomic_get_uint(p)  __atomic_load_n(p, __ATOMIC_ACQUIRE)
+# define atomic_set_uint(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+# define atomic_get_ptr(pp)  __atomic_load_n(pp, __ATOMIC_ACQUIRE)
+# define atomic_set_ptr(pp, v) __atomic_store_n(pp, v, __ATOMIC_RELEASE)
+# define fence_acquire()     __atomic_thread_fence(__ATOMIC_ACQUIRE)
+# define fence_release()     __atomic_thread_fence(__ATOMIC_RELEASE)
+# if defined(__i386__) || defined(__x86_64__)
+#  define cpu_relax()        __builtin_ia32_pause()
+# else
+#  define cpu_relax()        __asm__ __volatile__("" ::: "memory")
+# endif
+
+# define THREAD_LOCAL        __thread
+
+typedef pthread_t ght_thread_t;
+typedef void *(*ght_thread_fn_t)(void *);
+
+# define THREAD_FN(name, arg) void *name(void *arg)
+# define THREAD_RETURN       NULL
+# define thread_create(p, fn, arg) pthread_create(p, NULL, fn, arg)
+# define thread_join(t)      pthread_join(t, NULL)
+
+#else
+/* No threads, ght_set_concurrent() fails */
+# define GHT_NO_THREADS
+
+typedef int ght_rwlock_t;
+
+# define RWLOCK_INITIALIZER  0
+# define rwlock_init(p)      (-1)
+# define rwlock_destroy(p)
+# define rwlock_rdlock(p)
+# define rwlock_rdunlock(p)
+# define rwlock_wrlock(p)
+# define rwlock_wrunlock(p)
+
+# define atomic_inc_uint(p)  (++*(p))
+# define atomic_get_uint(p)  (*(p))
+# define atomic_set_uint(p, v) (*(p) = (v))
+# define atomic_get_ptr(pp)  (*(pp))
+# define atomic_set_ptr(pp, v) (*(pp) = (v))
+# define fence_acquire()
+# define fence_release()
+# define cpu_relax()
+
+# define THREAD_LOCAL
+
+typedef int ght_thread_t;
+typedef void *(*ght_thread_fn_t)(void *);
+
+# define THREAD_FN(name, arg) void *name(void *arg)
+# define THREAD_RETURN       NULL
+# define thread_create(p, fn, arg) (-1)
+# define thread_join(t)
+#endif
+
+/*
+ * The reclamation of memory which lock-free readers may still be
+ * looking at (hash_epoch.c, see ght_reader_register()).
+ *
+ * A writer unlinks the memory, takes a new epoch with ght_epoch_new()
+ * and may free the memory when ght_epoch_passed() returns TRUE for
+ * it, that is when every registered thread has called ght_quiescent()
+ * since. ght_epoch_reader() is TRUE if the calling thread is
+ * registered.
+ */
+unsigned int ght_epoch_new(void);
+int ght_epoch_passed(unsigned int i_epoch);
+int ght_epoch_reader(void);
+
+#endif /* GHT_HASH_LOCK_H */
@@ -0,0 +1,230 @@
+/*********************************************************************
+ *
+ * Copyright (C) 2001-2005,  Simon Kagstrom
+ *
+ * Filename:      hash_pool.c
+ * Description:   A pool allocator for the entries of one hash table.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ ********************************************************************/
+
+#include <stdlib.h> /* malloc */
+#include <stdio.h>  /* perror */
+#include <string.h> /* memset */
+#include <assert.h> /* assert */
+
+#include "ght_hash_table.h"
+#include "hash_engine.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/*
+ * Allocations are rounded up to a multiple of POOL_ALIGN bytes, and
+ * every such size up to POOL_MAX_SIZE is a size class. A size class
+ * hands out chunks from slabs, which start at POOL_MIN_SLAB bytes and
+ * double in size up to POOL_MAX_SLAB. Freed chunks are kept in a free
+ * list per size class, and are never returned to malloc() until the
+ * whole pool is destroyed.
+ *
+ * Larger allocations are made with malloc(), but are linked into a
+ * list so that they are released together with the slabs.
+ */
+#define POOL_ALIGN    8
+#define POOL_MAX_SIZE 256
+#define POOL_CLASSES  (POOL_MAX_SIZE / POOL_ALIGN)
+#define POOL_MIN_SLAB 4096
+#define POOL_MAX_SLAB (1024 * 1024)
+
+/* The header of slabs and of large allocations. It is 16 bytes on
+ * 64-bit machines, which keeps the chunks after it aligned. */
+typedef struct s_pool_block
+{
+  struct s_pool_block *p_next;
+  struct s_pool_block *p_prev;
+} pool_block_t;
+
+typedef struct s_pool_chunk
+{
+  struct s_pool_chunk *p_next;
+} pool_chunk_t;
+
+typedef struct
+{
+  pool_chunk_t *p_free;         /* Freed chunks */
+  char *p_unused;               /* The part of the last slab not yet handed out */
+  char *p_end;
+  size_t i_slab_size;           /* The size of the next slab */
+} pool_class_t;
+
+struct s_ght_pool
+{
+  pool_class_t classes[POOL_CLASSES];
+  pool_block_t *p_slabs;
+  pool_block_t *p_large;        /* Doubly linked, since they are freed one by one */
+};
+
+ght_pool_t *ght_pool_create(void)
+{
+  ght_pool_t *p_pool;
+  int i;
+
+  if ( !(p_pool = (ght_pool_t*)malloc(sizeof(ght_pool_t))) )
+    {
+      perror("malloc");
+      return NULL;
+    }
+  memset(p_pool, 0, sizeof(ght_pool_t));
+  for (i = 0; i < POOL_CLASSES; i++)
+    {
+      p_pool->classes[i].i_slab_size = POOL_MIN_SLAB;
+    }
+
+  return p_pool;
+}
+
+/* Get a new slab for a size class */
+static int add_slab(ght_pool_t *p_pool, pool_class_t *p_class)
+{
+  pool_block_t *p_slab;
+
+  if ( !(p_slab = (pool_block_t*)malloc(p_class->i_slab_size)) )
+    {
+      perror("malloc");
+      return -1;
+    }
+  p_slab->p_next = p_pool->p_slabs;
+  p_pool->p_slabs = p_slab;
+
+  p_class->p_unused = (char*)(p_slab + 1);
+  p_class->p_end = (char*)p_slab + p_class->i_slab_size;
+  if (p_class->i_slab_size < POOL_MAX_SLAB)
+    {
+      p_class->i_slab_size *= 2;
+    }
+
+  return 0;
+}
+
+static void *pool_alloc(void *p_ctx, size_t size)
+{
+  ght_pool_t *p_pool = (ght_pool_t*)p_ctx;
+  pool_class_t *p_class;
+  void *p_ret;
+
+  if (size > POOL_MAX_SIZE)
+    {
+      pool_block_t *p_block;
+
+      if ( !(p_block = (pool_block_t*)malloc(sizeof(pool_block_t) + size)) )
+	{
+	  return NULL;
+	}
+      p_block->p_prev = NULL;
+      p_block->p_next = p_pool->p_large;
+      if (p_pool->p_large)
+	{
+	  p_pool->p_large->p_prev = p_block;
+	}
+      p_pool->p_large = p_block;
+
+      return p_block + 1;
+    }
+
+  size = (size + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1);
+  if (size == 0)
+    {
+      size = POOL_ALIGN;
+    }
+  p_class = &p_pool->classes[size / POOL_ALIGN - 1];
+
+  if (p_class->p_free)
+    {
+      p_ret = p_class->p_free;
+      p_class->p_free = p_class->p_free->p_next;
+
+      return p_ret;
+    }
+
+  if ((size_t)(p_class->p_end - p_class->p_unused) < size &&
+      add_slab(p_pool, p_class) < 0)
+    {
+      return NULL;
+    }
+  p_ret = p_class->p_unused;
+  p_class->p_unused += size;
+
+  return p_ret;
+}
+
+static void pool_free(void *p_ctx, void *p, size_t size)
+{
+  ght_pool_t *p_pool = (ght_pool_t*)p_ctx;
+  pool_class_t *p_class;
+  pool_chunk_t *p_chunk = (pool_chunk_t*)p;
+
+  if (size > POOL_MAX_SIZE)
+    {
+      pool_block_t *p_block = ((pool_block_t*)p) - 1;
+
+      if (p_block->p_prev)
+	p_block->p_prev->p_next = p_block->p_next;
+      else
+	p_pool->p_large = p_block->p_next;
+      if (p_block->p_next)
+	p_block->p_next->p_prev = p_block->p_prev;
+      free(p_block);
+
+      return;
+    }
+
+  size = (size + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1);
+  if (size == 0)
+    {
+      size = POOL_ALIGN;
+    }
+  p_class = &p_pool->classes[size / POOL_ALIGN - 1];
+
+  p_chunk->p_next = p_class->p_free;
+  p_class->p_free = p_chunk;
+}
+
+static void pool_release(void *p_ctx)
+{
+  ght_pool_t *p_pool = (ght_pool_t*)p_ctx;
+  pool_block_t *p_block;
+
+  while ( (p_block = p_pool->p_slabs) )
+    {
+      p_pool->p_slabs = p_block->p_next;
+      free(p_block);
+    }
+  while ( (p_block = p_pool->p_large) )
+    {
+      p_pool->p_large = p_block->p_next;
+      free(p_block);
+    }
+  free(p_pool);
+}
+
+const ght_allocator_t ght_pool_allocator =
+{
+  pool_alloc,
+  pool_free,
+  pool_release,
+};
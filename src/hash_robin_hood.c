@@ -0,0 +1,413 @@
+/*********************************************************************
+ *
+ * Copyright (C) 2001-2005,  Simon Kagstrom
+ *
+ * Filename:      hash_robin_hood.c
+ * Description:   Open addressing storage engine with Robin Hood
+ *                displacement and backward-shift deletion.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ ********************************************************************/
+
+#include <stdlib.h> /* malloc */
+#include <stdio.h>  /* perror */
+#include <string.h> /* memcmp */
+#include <assert.h> /* assert */
+
+#include "ght_hash_table.h"
+#include "hash_engine.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/*
+ * All entries are stored in one array of slots. An entry is placed at
+ * the first free slot after its home slot (hash & mask), but on the
+ * way there it takes the place of any entry which is closer to its
+ * own home slot ("Robin Hood" displacement). This keeps the probe
+ * lengths short and lets a lookup stop as soon as it reaches an entry
+ * closer to home than the key would be.
+ *
+ * Removal shifts the following entries one step back instead of
+ * leaving a tombstone.
+ */
+
+/* Set in the stored hash of used slots, an empty slot has i_hash 0 */
+#define RH_USED            0x80000000
+#define RH_MIN_SIZE        16
+
+typedef ght_slot_t rh_slot_t;
+
+#define SLOTS(p_ht) ((rh_slot_t*)(p_ht)->p_engine_data)
+
+/* The maximum number of entries before the table must grow, 90% */
+#define MAX_ITEMS(p_ht) ((p_ht)->i_size - (p_ht)->i_size / 10)
+
+/* The distance from the home slot of the entry in slot i */
+static inline ght_uint32_t slot_dist(ght_hash_table_t *p_ht, rh_slot_t *p_s, ght_uint32_t i)
+{
+  return (i - (p_s->i_hash & p_ht->i_size_mask)) & p_ht->i_size_mask;
+}
+
+/* Allocate an empty slot array with room for at least i_size slots */
+static rh_slot_t *alloc_slots(unsigned int i_size, unsigned int *p_size)
+{
+  rh_slot_t *p_slots;
+  unsigned int i_real_size = RH_MIN_SIZE;
+
+  while (i_real_size < i_size && i_real_size < (1u << 30))
+    {
+      i_real_size <<= 1;
+    }
+
+  if ( !(p_slots = (rh_slot_t*)malloc(i_real_size * sizeof(rh_slot_t))) )
+    {
+      perror("malloc");
+      return NULL;
+    }
+  memset(p_slots, 0, i_real_size * sizeof(rh_slot_t));
+  *p_size = i_real_size;
+
+  return p_slots;
+}
+
+/* Place a slot in the table, displacing entries closer to home */
+static void place_slot(ght_hash_table_t *p_ht, rh_slot_t *p_slots, rh_slot_t *p_new)
+{
+  rh_slot_t cur = *p_new;
+  ght_uint32_t i = cur.i_hash & p_ht->i_size_mask;
+  ght_uint32_t dist = 0;
+
+  while (p_slots[i].i_hash)
+    {
+      ght_uint32_t i_other = slot_dist(p_ht, &p_slots[i], i);
+
+      if (i_other < dist)
+	{
+	  rh_slot_t tmp = p_slots[i];
+
+	  p_slots[i] = cur;
+	  cur = tmp;
+	  dist = i_other;
+	}
+      i = (i + 1) & p_ht->i_size_mask;
+      dist++;
+    }
+  p_slots[i] = cur;
+}
+
+/* Find the slot for a key, or -1 if the key is not in the table */
+static inline int find_slot(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  rh_slot_t *p_slots = SLOTS(p_ht);
+  ght_uint32_t i = l_hash & p_ht->i_size_mask;
+  ght_uint32_t dist = 0;
+
+  l_hash |= RH_USED;
+  while (p_slots[i].i_hash)
+    {
+      rh_slot_t *p_s = &p_slots[i];
+
+      /* The key would have displaced this entry */
+      if (slot_dist(p_ht, p_s, i) < dist)
+	{
+	  break;
+	}
+      if (p_s->i_hash == l_hash && slot_key_equals(p_s, p_key))
+	{
+	  return (int)i;
+	}
+      i = (i + 1) & p_ht->i_size_mask;
+      dist++;
+    }
+
+  return -1;
+}
+
+/* Move all entries to a new slot array of (at least) i_size slots */
+static int resize(ght_hash_table_t *p_ht, unsigned int i_size)
+{
+  rh_slot_t *p_old = SLOTS(p_ht);
+  rh_slot_t *p_new;
+  unsigned int i_old_size = p_ht->i_size;
+  unsigned int i_new_size;
+  unsigned int i;
+
+  /* Never go above the maximum load */
+  if (i_size < RH_MIN_SIZE)
+    {
+      i_size = RH_MIN_SIZE;
+    }
+  while (i_size - i_size / 10 <= p_ht->i_items)
+    {
+      i_size *= 2;
+    }
+  if ( !(p_new = alloc_slots(i_size, &i_new_size)) )
+    {
+      return -1;
+    }
+
+  p_ht->i_size = i_new_size;
+  p_ht->i_size_mask = i_new_size - 1;
+  for (i = 0; i < i_old_size; i++)
+    {
+      if (p_old[i].i_hash)
+	{
+	  place_slot(p_ht, p_new, &p_old[i]);
+	}
+    }
+  p_ht->p_engine_data = p_new;
+  free(p_old);
+
+  return 0;
+}
+
+static int rh_create(ght_hash_table_t *p_ht, unsigned int i_size)
+{
+  if ( !(p_ht->p_engine_data = alloc_slots(i_size, &p_ht->i_size)) )
+    {
+      return -1;
+    }
+  p_ht->i_size_mask = p_ht->i_size - 1;
+
+  return 0;
+}
+
+static void rh_finalize(ght_hash_table_t *p_ht)
+{
+  rh_slot_t *p_slots = SLOTS(p_ht);
+  unsigned int i;
+
+  for (i = 0; i < p_ht->i_size && !entries_released_at_once(p_ht); i++)
+    {
+      if (p_slots[i].i_hash)
+	{
+	  slot_free_key(p_ht, &p_slots[i]);
+	}
+    }
+  free(p_slots);
+  p_ht->p_engine_data = NULL;
+}
+
+static int rh_upsert(ght_hash_table_t *p_ht, void *p_entry_data,
+		     ght_hash_key_t *p_key, ght_uint32_t l_hash,
+		     int b_replace, void **pp_data)
+{
+  rh_slot_t slot;
+  int i;
+
+  if ( (i = find_slot(p_ht, p_key, l_hash)) >= 0)
+    {
+      return upsert_found(&SLOTS(p_ht)[i].p_data, p_entry_data, b_replace, pp_data);
+    }
+
+  /* The table always grows, there is no room for more than the slots */
+  if (p_ht->i_items >= MAX_ITEMS(p_ht) &&
+      resize(p_ht, 2 * p_ht->i_size) < 0)
+    {
+      return -2;
+    }
+
+  if (slot_fill(p_ht, &slot, p_entry_data, p_key, l_hash | RH_USED) < 0)
+    {
+      return -2;
+    }
+
+  place_slot(p_ht, SLOTS(p_ht), &slot);
+  p_ht->i_items++;
+
+  return 0;
+}
+
+static void *rh_get(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  int i = find_slot(p_ht, p_key, l_hash);
+
+  return i < 0 ? NULL : SLOTS(p_ht)[i].p_data;
+}
+
+static void *rh_replace(ght_hash_table_t *p_ht, void *p_entry_data,
+			ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  int i = find_slot(p_ht, p_key, l_hash);
+  void *p_old;
+
+  if (i < 0)
+    {
+      return NULL;
+    }
+  p_old = SLOTS(p_ht)[i].p_data;
+  SLOTS(p_ht)[i].p_data = p_entry_data;
+
+  return p_old;
+}
+
+/* Remove the entry in slot i and return its data */
+static void *remove_slot(ght_hash_table_t *p_ht, ght_uint32_t i)
+{
+  rh_slot_t *p_slots = SLOTS(p_ht);
+  ght_uint32_t i_next;
+  void *p_ret;
+
+  p_ret = p_slots[i].p_data;
+  slot_free_key(p_ht, &p_slots[i]);
+
+  /* Shift the following entries back until an empty slot or an entry
+   * in its home slot is found */
+  for (i_next = (i + 1) & p_ht->i_size_mask;
+       p_slots[i_next].i_hash && slot_dist(p_ht, &p_slots[i_next], i_next) > 0;
+       i_next = (i_next + 1) & p_ht->i_size_mask)
+    {
+      p_slots[i] = p_slots[i_next];
+      i = i_next;
+    }
+  p_slots[i].i_hash = 0;
+  p_ht->i_items--;
+
+  return p_ret;
+}
+
+static void *rh_remove(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  int i = find_slot(p_ht, p_key, l_hash);
+
+  return i < 0 ? NULL : remove_slot(p_ht, (ght_uint32_t)i);
+}
+
+static int rh_find(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash,
+		   ght_handle_t *p_handle)
+{
+  int i = find_slot(p_ht, p_key, l_hash);
+
+  if (i < 0)
+    {
+      return -1;
+    }
+  handle_fill_slot(p_handle, &SLOTS(p_ht)[i]);
+  p_handle->i_pos = i;
+
+  return 0;
+}
+
+static void *rh_remove_handle(ght_hash_table_t *p_ht, ght_handle_t *p_handle)
+{
+  return remove_slot(p_ht, (ght_uint32_t)p_handle->i_pos);
+}
+
+/*
+ * The iteration walks the slots backwards, starting just below a slot
+ * which is empty or holds an entry in its home slot. A removal only
+ * shifts entries after the removed slot one step back, and never past
+ * such a slot, so the entries moved by removing the current entry (or
+ * an entry which has already been visited) have all been visited.
+ */
+static void *rh_next(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator,
+		     const void **pp_key, unsigned int *size)
+{
+  rh_slot_t *p_slots = SLOTS(p_ht);
+
+  while (p_iterator->i_left > 0)
+    {
+      rh_slot_t *p_s = &p_slots[p_iterator->i_pos & p_ht->i_size_mask];
+
+      p_iterator->i_pos = (p_iterator->i_pos - 1) & p_ht->i_size_mask;
+      p_iterator->i_left--;
+      if (p_s->i_hash)
+	{
+	  *pp_key = slot_key(p_s);
+	  if (size != NULL)
+	    *size = p_s->i_key_size;
+
+	  return p_s->p_data;
+	}
+    }
+
+  *pp_key = NULL;
+  if (size != NULL)
+    *size = 0;
+
+  return NULL;
+}
+
+/* i_pos has already moved on to the slot before the current one */
+static void *rh_iterator_remove(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator)
+{
+  return remove_slot(p_ht, (p_iterator->i_pos + 1) & p_ht->i_size_mask);
+}
+
+static void *rh_first(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator,
+		      const void **pp_key, unsigned int *size)
+{
+  rh_slot_t *p_slots = SLOTS(p_ht);
+  ght_uint32_t i;
+
+  /* There is always at least one empty slot */
+  for (i = 0;
+       p_slots[i].i_hash && slot_dist(p_ht, &p_slots[i], i) > 0;
+       i++)
+    ;
+
+  p_iterator->p_entry = NULL;
+  p_iterator->p_next = NULL;
+  p_iterator->i_pos = (i - 1) & p_ht->i_size_mask;
+  p_iterator->i_left = p_ht->i_size;
+
+  return rh_next(p_ht, p_iterator, pp_key, size);
+}
+
+static void rh_rehash(ght_hash_table_t *p_ht, unsigned int i_size)
+{
+  if (resize(p_ht, i_size) < 0)
+    {
+      fprintf(stderr, "hash_robin_hood.c ERROR: Out of memory when rehashing\n");
+    }
+}
+
+static void rh_prefetch(ght_hash_table_t *p_ht, ght_uint32_t l_hash, int i_stage)
+{
+  if (i_stage == 0)
+    {
+      PREFETCH(&SLOTS(p_ht)[l_hash & p_ht->i_size_mask]);
+    }
+}
+
+static void rh_reserve(ght_hash_table_t *p_ht, unsigned int i_items)
+{
+  if (i_items >= MAX_ITEMS(p_ht))
+    {
+      resize(p_ht, i_items + i_items / 9 + 2);
+    }
+}
+
+const ght_engine_t ght_robin_hood_engine =
+{
+  rh_create,
+  rh_finalize,
+  rh_upsert,
+  rh_get,
+  rh_replace,
+  rh_remove,
+  rh_first,
+  rh_next,
+  rh_rehash,
+  rh_prefetch,
+  rh_reserve,
+  rh_find,
+  rh_remove_handle,
+  rh_iterator_remove,
+};
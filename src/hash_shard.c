@@ -0,0 +1,270 @@
+/*********************************************************************
+ *
+ * Copyright (C) 2001-2005,  Simon Kagstrom
+ *
+ * Filename:      hash_shard.c
+ * Description:   Sharded tables, several independent tables with a
+ *                lock each, selected by the high bits of the hash.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ ********************************************************************/
+
+#include <stdlib.h> /* malloc */
+#include <stdio.h>  /* perror */
+
+#include "ght_hash_table.h"
+#include "hash_lock.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/*
+ * A shard is an ordinary table with automatic rehashing and the pool
+ * allocator. ght_get() does not change such a table, so lookups only
+ * lock the shard for reading.
+ *
+ * The counters are copies of ght_size() and ght_table_size() of the
+ * table, written under the lock after every change, so that
+ * ght_sharded_size() can add them up without locking. The shards are
+ * kept on separate cache lines.
+ */
+typedef struct s_ght_shard
+{
+  ght_rwlock_t lock;
+  ght_hash_table_t *p_table;
+  unsigned int i_items;
+  unsigned int i_buckets;
+  char pad[64];
+} ght_shard_t;
+
+/* The shard of a hash value, from its high bits. The tables use the
+ * low bits for their buckets. */
+#define SHARD(p_sh, l_hash) \
+  (&(p_sh)->p_shards[(p_sh)->i_shards > 1 ? (l_hash) >> (p_sh)->i_shift : 0])
+
+/* Update the counters of a shard, which is locked for writing */
+static inline void shard_count(ght_shard_t *p_shard)
+{
+  atomic_set_uint(&p_shard->i_items, ght_size(p_shard->p_table));
+  atomic_set_uint(&p_shard->i_buckets, ght_table_size(p_shard->p_table));
+}
+
+/* Create a sharded table */
+ght_sharded_t *ght_sharded_create(unsigned int i_shards, unsigned int i_size)
+{
+  ght_sharded_t *p_sh;
+  unsigned int i_bits = 0;
+  unsigned int i;
+
+#if defined(GHT_NO_THREADS)
+  fprintf(stderr, "ght_sharded_create: Threads are not supported on this platform\n");
+  return NULL;
+#endif
+  while ((1u << i_bits) < i_shards && i_bits < 16)
+    {
+      i_bits++;
+    }
+  if ( !(p_sh = (ght_sharded_t*)malloc(sizeof(ght_sharded_t))) )
+    {
+      perror("malloc");
+      return NULL;
+    }
+  p_sh->i_shards = 1 << i_bits;
+  p_sh->i_shift = 32 - i_bits;
+  if ( !(p_sh->p_shards = (ght_shard_t*)malloc(p_sh->i_shards * sizeof(ght_shard_t))) )
+    {
+      perror("malloc");
+      free(p_sh);
+      return NULL;
+    }
+
+  for (i = 0; i < p_sh->i_shards; i++)
+    {
+      ght_shard_t *p_shard = &p_sh->p_shards[i];
+
+      if ( !(p_shard->p_table = ght_create(i_size / p_sh->i_shards)) )
+	{
+	  break;
+	}
+      ght_set_rehash(p_shard->p_table, TRUE);
+      if (ght_set_pool(p_shard->p_table, TRUE) < 0)
+	{
+	  ght_finalize(p_shard->p_table);
+	  break;
+	}
+      if (rwlock_init(&p_shard->lock) != 0)
+	{
+	  fprintf(stderr, "ght_sharded_create: Could not create the locks\n");
+	  ght_finalize(p_shard->p_table);
+	  break;
+	}
+      shard_count(p_shard);
+    }
+  if (i < p_sh->i_shards)
+    {
+      while (i-- > 0)
+	{
+	  rwlock_destroy(&p_sh->p_shards[i].lock);
+	  ght_finalize(p_sh->p_shards[i].p_table);
+	}
+      free(p_sh->p_shards);
+      free(p_sh);
+      return NULL;
+    }
+
+  return p_sh;
+}
+
+/* Insert an entry into its shard */
+int ght_sharded_insert(ght_sharded_t *p_sh,
+		       void *p_entry_data,
+		       unsigned int i_key_size, const void *p_key_data)
+{
+  ght_uint32_t l_hash = ght_hash_key(p_sh->p_shards[0].p_table, i_key_size, p_key_data);
+  ght_shard_t *p_shard = SHARD(p_sh, l_hash);
+  int ret;
+
+  rwlock_wrlock(&p_shard->lock);
+  ret = ght_insert_hashed(p_shard->p_table, p_entry_data, i_key_size, p_key_data, l_hash);
+  shard_count(p_shard);
+  rwlock_wrunlock(&p_shard->lock);
+
+  return ret;
+}
+
+/* Get the data of a key, or NULL */
+void *ght_sharded_get(ght_sharded_t *p_sh,
+		      unsigned int i_key_size, const void *p_key_data)
+{
+  ght_uint32_t l_hash = ght_hash_key(p_sh->p_shards[0].p_table, i_key_size, p_key_data);
+  ght_shard_t *p_shard = SHARD(p_sh, l_hash);
+  void *p_ret;
+
+  rwlock_rdlock(&p_shard->lock);
+  p_ret = ght_get_hashed(p_shard->p_table, i_key_size, p_key_data, l_hash);
+  rwlock_rdunlock(&p_shard->lock);
+
+  return p_ret;
+}
+
+/* Remove an entry from its shard and return the data, or NULL */
+void *ght_sharded_remove(ght_sharded_t *p_sh,
+			 unsigned int i_key_size, const void *p_key_data)
+{
+  ght_uint32_t l_hash = ght_hash_key(p_sh->p_shards[0].p_table, i_key_size, p_key_data);
+  ght_shard_t *p_shard = SHARD(p_sh, l_hash);
+  void *p_ret;
+
+  rwlock_wrlock(&p_shard->lock);
+  p_ret = ght_remove_hashed(p_shard->p_table, i_key_size, p_key_data, l_hash);
+  shard_count(p_shard);
+  rwlock_wrunlock(&p_shard->lock);
+
+  return p_ret;
+}
+
+/* The number of items in all shards, without locking */
+unsigned int ght_sharded_size(ght_sharded_t *p_sh)
+{
+  unsigned int i_items = 0;
+  unsigned int i;
+
+  for (i = 0; i < p_sh->i_shards; i++)
+    {
+      i_items += atomic_get_uint(&p_sh->p_shards[i].i_items);
+    }
+
+  return i_items;
+}
+
+/* The number of buckets in all shards, without locking */
+unsigned int ght_sharded_table_size(ght_sharded_t *p_sh)
+{
+  unsigned int i_buckets = 0;
+  unsigned int i;
+
+  for (i = 0; i < p_sh->i_shards; i++)
+    {
+      i_buckets += atomic_get_uint(&p_sh->p_shards[i].i_buckets);
+    }
+
+  return i_buckets;
+}
+
+/* Go on with the iteration from shard i_shard, or return NULL at the end */
+static void *first_from(ght_sharded_t *p_sh, ght_sharded_iterator_t *p_iterator,
+			const void **pp_key, unsigned int *size)
+{
+  void *p_ret;
+
+  for (; p_iterator->i_shard < p_sh->i_shards; p_iterator->i_shard++)
+    {
+      if ( (p_ret = ght_first_keysize(p_sh->p_shards[p_iterator->i_shard].p_table,
+				      &p_iterator->iterator, pp_key, size)) )
+	{
+	  return p_ret;
+	}
+    }
+  *pp_key = NULL;
+
+  return NULL;
+}
+
+/* Get the first entry of the first non-empty shard */
+void *ght_sharded_first(ght_sharded_t *p_sh, ght_sharded_iterator_t *p_iterator,
+			const void **pp_key, unsigned int *size)
+{
+  p_iterator->i_shard = 0;
+
+  return first_from(p_sh, p_iterator, pp_key, size);
+}
+
+/* Get the next entry, in this shard or the following ones */
+void *ght_sharded_next(ght_sharded_t *p_sh, ght_sharded_iterator_t *p_iterator,
+		       const void **pp_key, unsigned int *size)
+{
+  void *p_ret;
+
+  if (p_iterator->i_shard >= p_sh->i_shards)
+    {
+      *pp_key = NULL;
+      return NULL;
+    }
+  if ( (p_ret = ght_next_keysize(p_sh->p_shards[p_iterator->i_shard].p_table,
+				 &p_iterator->iterator, pp_key, size)) )
+    {
+      return p_ret;
+    }
+  p_iterator->i_shard++;
+
+  return first_from(p_sh, p_iterator, pp_key, size);
+}
+
+/* Free the shards and the sharded table */
+void ght_sharded_finalize(ght_sharded_t *p_sh)
+{
+  unsigned int i;
+
+  for (i = 0; i < p_sh->i_shards; i++)
+    {
+      rwlock_destroy(&p_sh->p_shards[i].lock);
+      ght_finalize(p_sh->p_shards[i].p_table);
+    }
+  free(p_sh->p_shards);
+  free(p_sh);
+}
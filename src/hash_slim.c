@@ -0,0 +1,632 @@
+/*********************************************************************
+ *
+ * Copyright (C) 2001-2005,  Simon Kagstrom
+ *
+ * Filename:      hash_slim.c
+ * Description:   Chained storage engine with smaller entries: singly
+ *                linked chains and an optional insertion order list.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ ********************************************************************/
+
+#include <stdlib.h> /* malloc */
+#include <stdio.h>  /* perror */
+#include <string.h> /* memcmp */
+#include <assert.h> /* assert */
+
+#include "ght_hash_table.h"
+#include "hash_engine.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/*
+ * The chains work like those of GHT_ENGINE_CHAINED, but an entry only
+ * has the data, the next pointer, the hash value and the key size. The
+ * key data is always stored right after the entry, so there is no
+ * need to point to it, and the entry before in the chain is found
+ * while searching the chain.
+ *
+ * An entry of an ordered table (GHT_ENGINE_SLIM) is preceded by the
+ * links of the insertion order list:
+ *
+ *  ___________________________
+ * |order links|entry|key data|
+ * |___________|_____|________|
+ *             \
+ *              p_e
+ *
+ * Unordered tables (GHT_ENGINE_SLIM_UNORDERED) leave the links out and
+ * iterate in bucket order.
+ */
+typedef struct s_slim_entry
+{
+  void *p_data;
+  struct s_slim_entry *p_next;
+  ght_uint32_t i_hash;
+  unsigned int i_key_size;
+} slim_entry_t;
+
+typedef struct
+{
+  slim_entry_t *p_older;
+  slim_entry_t *p_newer;
+} order_links_t;
+
+#define ENTRY_KEY(p_e) ((const void*)((p_e) + 1))
+#define ORDER(p_e)     (((order_links_t*)(p_e)) - 1)
+
+typedef struct
+{
+  slim_entry_t **pp_buckets;
+  slim_entry_t *p_oldest;       /* The insertion order list, if b_ordered */
+  slim_entry_t *p_newest;
+  int b_ordered;
+} slim_table_t;
+
+#define TABLE(p_ht) ((slim_table_t*)(p_ht)->p_engine_data)
+
+/* The size of what is allocated before the entry itself */
+#define PREFIX_SIZE(p_t) ((p_t)->b_ordered ? sizeof(order_links_t) : 0)
+
+static slim_entry_t *entry_create(ght_hash_table_t *p_ht, void *p_data,
+				  ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  size_t i_prefix = PREFIX_SIZE(TABLE(p_ht));
+  slim_entry_t *p_e;
+  char *p_mem;
+
+  if ( !(p_mem = (char*)mem_alloc(p_ht, i_prefix + sizeof(slim_entry_t) + p_key->i_size)) )
+    {
+      fprintf(stderr, "fn_alloc failed!\n");
+      return NULL;
+    }
+
+  p_e = (slim_entry_t*)(p_mem + i_prefix);
+  p_e->p_data = p_data;
+  p_e->p_next = NULL;
+  p_e->i_hash = l_hash;
+  p_e->i_key_size = p_key->i_size;
+  memcpy(p_e + 1, p_key->p_key, p_key->i_size);
+
+  return p_e;
+}
+
+static void entry_free(ght_hash_table_t *p_ht, slim_entry_t *p_e)
+{
+  size_t i_prefix = PREFIX_SIZE(TABLE(p_ht));
+
+  mem_free(p_ht, (char*)p_e - i_prefix, i_prefix + sizeof(slim_entry_t) + p_e->i_key_size);
+}
+
+/* Link an entry last in the insertion order list */
+static void entry_order_append(slim_table_t *p_t, slim_entry_t *p_e)
+{
+  ORDER(p_e)->p_older = p_t->p_newest;
+  ORDER(p_e)->p_newer = NULL;
+  if (p_t->p_newest)
+    ORDER(p_t->p_newest)->p_newer = p_e;
+  else
+    p_t->p_oldest = p_e;
+  p_t->p_newest = p_e;
+}
+
+/* Link an entry out of the insertion order list */
+static void entry_order_remove(slim_table_t *p_t, slim_entry_t *p_e)
+{
+  if (ORDER(p_e)->p_older)
+    ORDER(ORDER(p_e)->p_older)->p_newer = ORDER(p_e)->p_newer;
+  else
+    p_t->p_oldest = ORDER(p_e)->p_newer;
+  if (ORDER(p_e)->p_newer)
+    ORDER(ORDER(p_e)->p_newer)->p_older = ORDER(p_e)->p_older;
+  else
+    p_t->p_newest = ORDER(p_e)->p_older;
+}
+
+/* Allocate an empty bucket array with (at least) i_size buckets */
+static slim_entry_t **alloc_buckets(unsigned int i_size, unsigned int *p_size)
+{
+  slim_entry_t **pp_buckets;
+  unsigned int i_real_size = 1;
+
+  while (i_real_size < i_size && i_real_size < (1u << 31))
+    {
+      i_real_size <<= 1;
+    }
+
+  if ( !(pp_buckets = (slim_entry_t**)malloc(i_real_size * sizeof(slim_entry_t*))) )
+    {
+      perror("malloc");
+      return NULL;
+    }
+  memset(pp_buckets, 0, i_real_size * sizeof(slim_entry_t*));
+  *p_size = i_real_size;
+
+  return pp_buckets;
+}
+
+/* Search for a key in the chain starting at *pp_link. If it is found,
+ * *ppp_link is set to the link pointing to the entry and *ppp_prev to
+ * the link pointing to the entry before it (NULL if it is first). */
+static inline slim_entry_t *search_chain(slim_entry_t **pp_link, ght_hash_key_t *p_key,
+					 ght_uint32_t l_hash, slim_entry_t ***ppp_link,
+					 slim_entry_t ***ppp_prev)
+{
+  slim_entry_t **pp_prev = NULL;
+  slim_entry_t *p_e;
+
+  for (; (p_e = *pp_link); pp_prev = pp_link, pp_link = &p_e->p_next)
+    {
+      if (p_e->i_hash == l_hash &&
+	  p_e->i_key_size == p_key->i_size &&
+	  memcmp(ENTRY_KEY(p_e), p_key->p_key, p_key->i_size) == 0)
+	{
+	  *ppp_link = pp_link;
+	  *ppp_prev = pp_prev;
+	  return p_e;
+	}
+    }
+
+  return NULL;
+}
+
+/* Apply the heuristics to an entry found by search_chain() */
+static inline void apply_heuristics(ght_hash_table_t *p_ht, slim_entry_t **pp_head,
+				    slim_entry_t *p_e, slim_entry_t **pp_link,
+				    slim_entry_t **pp_prev)
+{
+  switch (p_ht->i_heuristics)
+    {
+    case GHT_HEURISTICS_MOVE_TO_FRONT:
+      if (pp_link != pp_head)
+	{
+	  *pp_link = p_e->p_next;
+	  p_e->p_next = *pp_head;
+	  *pp_head = p_e;
+	}
+      break;
+    case GHT_HEURISTICS_TRANSPOSE:
+      if (pp_prev)
+	{
+	  slim_entry_t *p_x = *pp_prev;
+
+	  /* pp_prev -> X -> p_e  =>  pp_prev -> p_e -> X */
+	  *pp_prev = p_e;
+	  p_x->p_next = p_e->p_next;
+	  p_e->p_next = p_x;
+	}
+      break;
+    default:
+      break;
+    }
+}
+
+/* Move all entries to a new bucket array of (at least) i_size buckets.
+ * The order of the chains is kept as when GHT_ENGINE_CHAINED rehashes.
+ * The table is unchanged if this fails. */
+static int resize(ght_hash_table_t *p_ht, unsigned int i_size)
+{
+  slim_table_t *p_t = TABLE(p_ht);
+  slim_entry_t **pp_buckets;
+  slim_entry_t **pp_tails;
+  unsigned int i_new_size;
+  unsigned int i;
+
+  if ( !(pp_buckets = alloc_buckets(i_size, &i_new_size)) )
+    {
+      return -1;
+    }
+  if ( !(pp_tails = (slim_entry_t**)malloc(i_new_size * sizeof(slim_entry_t*))) )
+    {
+      perror("malloc");
+      free(pp_buckets);
+      return -1;
+    }
+  memset(pp_tails, 0, i_new_size * sizeof(slim_entry_t*));
+
+  for (i = p_ht->i_size; i-- > 0; )
+    {
+      slim_entry_t *p_e = p_t->pp_buckets[i];
+
+      while (p_e)
+	{
+	  slim_entry_t *p_next = p_e->p_next;
+	  ght_uint32_t l_key = p_e->i_hash & (i_new_size - 1);
+
+	  p_e->p_next = NULL;
+	  if (pp_tails[l_key])
+	    pp_tails[l_key]->p_next = p_e;
+	  else
+	    pp_buckets[l_key] = p_e;
+	  pp_tails[l_key] = p_e;
+	  p_e = p_next;
+	}
+    }
+  free(pp_tails);
+  free(p_t->pp_buckets);
+  p_t->pp_buckets = pp_buckets;
+  p_ht->i_size = i_new_size;
+  p_ht->i_size_mask = i_new_size - 1;
+
+  return 0;
+}
+
+static int create(ght_hash_table_t *p_ht, unsigned int i_size, int b_ordered)
+{
+  slim_table_t *p_t;
+
+  if ( !(p_t = (slim_table_t*)malloc(sizeof(slim_table_t))) )
+    {
+      perror("malloc");
+      return -1;
+    }
+  if ( !(p_t->pp_buckets = alloc_buckets(i_size, &p_ht->i_size)) )
+    {
+      free(p_t);
+      return -1;
+    }
+  p_ht->i_size_mask = p_ht->i_size - 1;
+  p_t->p_oldest = NULL;
+  p_t->p_newest = NULL;
+  p_t->b_ordered = b_ordered;
+  p_ht->p_engine_data = p_t;
+
+  return 0;
+}
+
+static int sl_create(ght_hash_table_t *p_ht, unsigned int i_size)
+{
+  return create(p_ht, i_size, TRUE);
+}
+
+static int sl_create_unordered(ght_hash_table_t *p_ht, unsigned int i_size)
+{
+  return create(p_ht, i_size, FALSE);
+}
+
+static void sl_finalize(ght_hash_table_t *p_ht)
+{
+  slim_table_t *p_t = TABLE(p_ht);
+  unsigned int i;
+
+  for (i = 0; i < p_ht->i_size && !entries_released_at_once(p_ht); i++)
+    {
+      slim_entry_t *p_e = p_t->pp_buckets[i];
+
+      while (p_e)
+	{
+	  slim_entry_t *p_next = p_e->p_next;
+
+	  entry_free(p_ht, p_e);
+	  p_e = p_next;
+	}
+    }
+  free(p_t->pp_buckets);
+  free(p_t);
+  p_ht->p_engine_data = NULL;
+}
+
+static int sl_upsert(ght_hash_table_t *p_ht, void *p_entry_data,
+		     ght_hash_key_t *p_key, ght_uint32_t l_hash,
+		     int b_replace, void **pp_data)
+{
+  slim_table_t *p_t = TABLE(p_ht);
+  slim_entry_t **pp_head = &p_t->pp_buckets[l_hash & p_ht->i_size_mask];
+  slim_entry_t **pp_link;
+  slim_entry_t **pp_prev;
+  slim_entry_t *p_entry;
+  unsigned int i_nr = 0;
+
+  if ( (p_entry = search_chain(pp_head, p_key, l_hash, &pp_link, &pp_prev)) )
+    {
+      return upsert_found(&p_entry->p_data, p_entry_data, b_replace, pp_data);
+    }
+  if ( !(p_entry = entry_create(p_ht, p_entry_data, p_key, l_hash)) )
+    {
+      return -2;
+    }
+
+  /* Rehash if the number of items inserted is too high. */
+  if (p_ht->i_automatic_rehash && p_ht->i_items > 2*p_ht->i_size)
+    {
+      resize(p_ht, 2*p_ht->i_size);
+      pp_head = &p_t->pp_buckets[l_hash & p_ht->i_size_mask];
+    }
+
+  if (p_ht->bucket_limit != 0)
+    {
+      slim_entry_t *p_e;
+
+      for (p_e = *pp_head; p_e; p_e = p_e->p_next)
+	{
+	  i_nr++;
+	}
+    }
+
+  /* Place the entry first in the list. */
+  p_entry->p_next = *pp_head;
+  *pp_head = p_entry;
+  if (p_t->b_ordered)
+    {
+      entry_order_append(p_t, p_entry);
+    }
+
+  /* If this is a limited bucket hash table, remove the last item */
+  if (p_ht->bucket_limit != 0 && i_nr >= p_ht->bucket_limit)
+    {
+      slim_entry_t *p_last;
+
+      for (pp_link = pp_head; (*pp_link)->p_next; pp_link = &(*pp_link)->p_next)
+	;
+      p_last = *pp_link;
+      *pp_link = NULL;
+      if (p_t->b_ordered)
+	{
+	  entry_order_remove(p_t, p_last);
+	}
+
+      p_ht->fn_bucket_free(p_last->p_data, ENTRY_KEY(p_last));
+      entry_free(p_ht, p_last);
+    }
+  else
+    {
+      p_ht->i_items++;
+    }
+
+  return 0;
+}
+
+static inline slim_entry_t *lookup(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  slim_entry_t **pp_head = &TABLE(p_ht)->pp_buckets[l_hash & p_ht->i_size_mask];
+  slim_entry_t **pp_link;
+  slim_entry_t **pp_prev;
+  slim_entry_t *p_e;
+
+  if ( (p_e = search_chain(pp_head, p_key, l_hash, &pp_link, &pp_prev)) )
+    {
+      apply_heuristics(p_ht, pp_head, p_e, pp_link, pp_prev);
+    }
+
+  return p_e;
+}
+
+static void *sl_get(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  slim_entry_t *p_e = lookup(p_ht, p_key, l_hash);
+
+  return p_e ? p_e->p_data : NULL;
+}
+
+static void *sl_replace(ght_hash_table_t *p_ht, void *p_entry_data,
+			ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  slim_entry_t *p_e = lookup(p_ht, p_key, l_hash);
+  void *p_old;
+
+  if (!p_e)
+    {
+      return NULL;
+    }
+  p_old = p_e->p_data;
+  p_e->p_data = p_entry_data;
+
+  return p_old;
+}
+
+/* Remove the entry *pp_link points to and return its data */
+static void *remove_entry(ght_hash_table_t *p_ht, slim_entry_t **pp_link)
+{
+  slim_table_t *p_t = TABLE(p_ht);
+  slim_entry_t *p_e = *pp_link;
+  void *p_ret;
+
+  *pp_link = p_e->p_next;
+  if (p_t->b_ordered)
+    {
+      entry_order_remove(p_t, p_e);
+    }
+  p_ht->i_items--;
+
+  p_ret = p_e->p_data;
+  entry_free(p_ht, p_e);
+
+  return p_ret;
+}
+
+static void *sl_remove(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  slim_entry_t **pp_link;
+  slim_entry_t **pp_prev;
+
+  if ( !search_chain(&TABLE(p_ht)->pp_buckets[l_hash & p_ht->i_size_mask],
+		     p_key, l_hash, &pp_link, &pp_prev) )
+    {
+      return NULL;
+    }
+
+  return remove_entry(p_ht, pp_link);
+}
+
+static int sl_find(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash,
+		   ght_handle_t *p_handle)
+{
+  slim_entry_t **pp_link;
+  slim_entry_t **pp_prev;
+  slim_entry_t *p_e;
+
+  if ( !(p_e = search_chain(&TABLE(p_ht)->pp_buckets[l_hash & p_ht->i_size_mask],
+			    p_key, l_hash, &pp_link, &pp_prev)) )
+    {
+      return -1;
+    }
+  handle_fill(p_handle, &p_e->p_data, ENTRY_KEY(p_e), p_e->i_key_size);
+  p_handle->p_pos = pp_link;
+
+  return 0;
+}
+
+static void *sl_remove_handle(ght_hash_table_t *p_ht, ght_handle_t *p_handle)
+{
+  return remove_entry(p_ht, (slim_entry_t**)p_handle->p_pos);
+}
+
+/*
+ * Ordered tables iterate over the insertion order list, unordered ones
+ * over the buckets (i_pos is the next bucket). In both cases p_cursor
+ * is the next entry, so the current entry can be removed.
+ */
+static void *sl_next(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator,
+		     const void **pp_key, unsigned int *size)
+{
+  slim_table_t *p_t = TABLE(p_ht);
+  slim_entry_t *p_e = (slim_entry_t*)p_iterator->p_cursor;
+
+  if (!p_t->b_ordered)
+    {
+      while (!p_e && p_iterator->i_pos < p_ht->i_size)
+	{
+	  p_e = p_t->pp_buckets[p_iterator->i_pos++];
+	}
+    }
+
+  if (p_e)
+    {
+      p_iterator->p_cursor = p_t->b_ordered ? ORDER(p_e)->p_newer : p_e->p_next;
+      *pp_key = ENTRY_KEY(p_e);
+      if (size != NULL)
+	*size = p_e->i_key_size;
+
+      return p_e->p_data;
+    }
+
+  p_iterator->p_cursor = NULL;
+  *pp_key = NULL;
+  if (size != NULL)
+    *size = 0;
+
+  return NULL;
+}
+
+/* The current entry is the one before p_cursor, and is unlinked from
+ * its bucket by looking for the link which points to it */
+static void *sl_iterator_remove(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator)
+{
+  slim_table_t *p_t = TABLE(p_ht);
+  slim_entry_t *p_cursor = (slim_entry_t*)p_iterator->p_cursor;
+  slim_entry_t **pp_link;
+  slim_entry_t *p_e;
+
+  if (p_t->b_ordered)
+    {
+      p_e = p_cursor ? ORDER(p_cursor)->p_older : p_t->p_newest;
+    }
+  else
+    {
+      for (p_e = p_t->pp_buckets[p_iterator->i_pos - 1]; p_e->p_next != p_cursor; p_e = p_e->p_next)
+	;
+    }
+
+  for (pp_link = &p_t->pp_buckets[p_e->i_hash & p_ht->i_size_mask]; *pp_link != p_e;
+       pp_link = &(*pp_link)->p_next)
+    ;
+
+  return remove_entry(p_ht, pp_link);
+}
+
+static void *sl_first(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator,
+		      const void **pp_key, unsigned int *size)
+{
+  slim_table_t *p_t = TABLE(p_ht);
+
+  p_iterator->p_entry = NULL;
+  p_iterator->p_next = NULL;
+  p_iterator->p_cursor = p_t->b_ordered ? p_t->p_oldest : NULL;
+  p_iterator->i_pos = 0;
+  p_iterator->i_left = 0;
+
+  return sl_next(p_ht, p_iterator, pp_key, size);
+}
+
+static void sl_rehash(ght_hash_table_t *p_ht, unsigned int i_size)
+{
+  if (resize(p_ht, i_size) < 0)
+    {
+      fprintf(stderr, "hash_slim.c ERROR: Out of memory when rehashing\n");
+    }
+}
+
+static void sl_prefetch(ght_hash_table_t *p_ht, ght_uint32_t l_hash, int i_stage)
+{
+  slim_entry_t **pp_head = &TABLE(p_ht)->pp_buckets[l_hash & p_ht->i_size_mask];
+
+  if (i_stage == 0)
+    {
+      PREFETCH(pp_head);
+    }
+  else
+    {
+      PREFETCH(*pp_head);
+    }
+}
+
+/* Only grows a table which would grow anyway, like sl_upsert() */
+static void sl_reserve(ght_hash_table_t *p_ht, unsigned int i_items)
+{
+  if (p_ht->i_automatic_rehash && i_items > 2*p_ht->i_size)
+    {
+      resize(p_ht, i_items / 2);
+    }
+}
+
+const ght_engine_t ght_slim_engine =
+{
+  sl_create,
+  sl_finalize,
+  sl_upsert,
+  sl_get,
+  sl_replace,
+  sl_remove,
+  sl_first,
+  sl_next,
+  sl_rehash,
+  sl_prefetch,
+  sl_reserve,
+  sl_find,
+  sl_remove_handle,
+  sl_iterator_remove,
+};
+
+const ght_engine_t ght_slim_unordered_engine =
+{
+  sl_create_unordered,
+  sl_finalize,
+  sl_upsert,
+  sl_get,
+  sl_replace,
+  sl_remove,
+  sl_first,
+  sl_next,
+  sl_rehash,
+  sl_prefetch,
+  sl_reserve,
+  sl_find,
+  sl_remove_handle,
+  sl_iterator_remove,
+};
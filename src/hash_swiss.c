@@ -0,0 +1,561 @@
+/*********************************************************************
+ *
+ * Copyright (C) 2001-2005,  Simon Kagstrom
+ *
+ * Filename:      hash_swiss.c
+ * Description:   Open addressing storage engine which probes groups
+ *                of control bytes at a time ("Swiss table").
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ ********************************************************************/
+
+#include <stdlib.h> /* malloc */
+#include <stdio.h>  /* perror */
+#include <string.h> /* memset */
+#include <assert.h> /* assert */
+
+#include "ght_hash_table.h"
+#include "hash_engine.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# include <emmintrin.h>
+# define USE_SSE2 1
+#endif
+
+/*
+ * Besides the array of slots, the table keeps one control byte per
+ * slot. The control byte is EMPTY, DELETED or, for used slots, the
+ * top 7 bits of the hash value (the "tag"). A lookup loads the
+ * control bytes of GROUP_SIZE consecutive slots at once and compares
+ * all of them with the tag of the key, so only slots with a matching
+ * tag are looked at. Most misses never touch a slot at all.
+ *
+ * The groups are probed quadratically starting at (hash & mask), and
+ * a lookup ends at the first group which has an EMPTY slot. The first
+ * GROUP_SIZE control bytes are mirrored after the last one, so a group
+ * can be loaded from any position without wrapping.
+ *
+ * Removed slots become DELETED (unless no lookup could have passed
+ * them), and are reused by later insertions.
+ */
+#define GROUP_SIZE  16
+#define CTRL_EMPTY  ((unsigned char)0x80)
+#define CTRL_DELETED ((unsigned char)0xfe)
+#define MIN_SIZE    GROUP_SIZE
+
+#define TAG(l_hash) ((unsigned char)((l_hash) >> 25))
+#define IS_FULL(c)  (((c) & 0x80) == 0)
+
+/* The maximum number of entries before the table must grow, 7/8 */
+#define MAX_ITEMS(i_size) ((i_size) - (i_size) / 8)
+
+typedef struct
+{
+  unsigned char *p_ctrl;        /* i_size + GROUP_SIZE control bytes */
+  ght_slot_t *p_slots;
+  unsigned int i_growth_left;   /* Entries which can be inserted in EMPTY slots */
+} swiss_table_t;
+
+#define TABLE(p_ht) ((swiss_table_t*)(p_ht)->p_engine_data)
+
+/* A bitmask with one bit for each slot in a group */
+typedef unsigned int group_mask_t;
+
+#if defined(USE_SSE2)
+static inline group_mask_t match_tag(const unsigned char *p_group, unsigned char tag)
+{
+  __m128i group = _mm_loadu_si128((const __m128i*)p_group);
+
+  return (group_mask_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)tag)));
+}
+
+static inline group_mask_t match_empty(const unsigned char *p_group)
+{
+  return match_tag(p_group, CTRL_EMPTY);
+}
+
+static inline group_mask_t match_empty_or_deleted(const unsigned char *p_group)
+{
+  /* EMPTY and DELETED are the only control bytes with the top bit set */
+  return (group_mask_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)p_group));
+}
+#else
+/* Portable version, working on 8 control bytes at a time */
+typedef unsigned long long word_t;
+
+#define LSBS ((word_t)0x0101010101010101ULL)
+#define MSBS ((word_t)0x8080808080808080ULL)
+
+static inline word_t load_word(const unsigned char *p)
+{
+  word_t w = 0;
+  int i;
+
+  /* Byte i in the group is byte i (from the least significant) in w */
+  for (i = 7; i >= 0; i--)
+    {
+      w = (w << 8) | p[i];
+    }
+  return w;
+}
+
+/* Convert the top bits of the bytes in w to an 8-bit mask */
+static inline group_mask_t pack_msbs(word_t w)
+{
+  return (group_mask_t)((((w & MSBS) >> 7) * 0x0102040810204080ULL) >> 56);
+}
+
+static inline group_mask_t match_word(word_t w, unsigned char tag)
+{
+  word_t x = w ^ (LSBS * tag);
+
+  /* Exact: set the top bit of each byte of x which is zero */
+  return pack_msbs(~(((x & ~MSBS) + ~MSBS) | x) & MSBS);
+}
+
+static inline group_mask_t match_tag(const unsigned char *p_group, unsigned char tag)
+{
+  return match_word(load_word(p_group), tag) |
+    (match_word(load_word(p_group + 8), tag) << 8);
+}
+
+static inline group_mask_t match_empty(const unsigned char *p_group)
+{
+  return match_tag(p_group, CTRL_EMPTY);
+}
+
+static inline group_mask_t match_empty_or_deleted(const unsigned char *p_group)
+{
+  return pack_msbs(load_word(p_group)) | (pack_msbs(load_word(p_group + 8)) << 8);
+}
+#endif /* USE_SSE2 */
+
+static inline unsigned int lowest_bit(group_mask_t m)
+{
+#if defined(__GNUC__)
+  return (unsigned int)__builtin_ctz(m);
+#else
+  unsigned int i = 0;
+
+  while (!(m & 1))
+    {
+      m >>= 1;
+      i++;
+    }
+  return i;
+#endif
+}
+
+/* The number of leading zeros in a GROUP_SIZE bit mask */
+static inline unsigned int leading_zeros(group_mask_t m)
+{
+  unsigned int i = 0;
+
+  while (i < GROUP_SIZE && !(m & (1 << (GROUP_SIZE - 1 - i))))
+    {
+      i++;
+    }
+  return i;
+}
+
+static inline void set_ctrl(ght_hash_table_t *p_ht, unsigned char *p_ctrl,
+			    ght_uint32_t i, unsigned char c)
+{
+  p_ctrl[i] = c;
+  if (i < GROUP_SIZE)
+    {
+      p_ctrl[p_ht->i_size + i] = c;
+    }
+}
+
+/* Find the slot for a key, or -1 if the key is not in the table */
+static inline int find_slot(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  swiss_table_t *p_t = TABLE(p_ht);
+  unsigned char tag = TAG(l_hash);
+  ght_uint32_t pos = l_hash & p_ht->i_size_mask;
+  ght_uint32_t stride = 0;
+
+  for (;;)
+    {
+      const unsigned char *p_group = p_t->p_ctrl + pos;
+      group_mask_t m;
+
+      for (m = match_tag(p_group, tag); m; m &= m - 1)
+	{
+	  ght_uint32_t i = (pos + lowest_bit(m)) & p_ht->i_size_mask;
+	  ght_slot_t *p_s = &p_t->p_slots[i];
+
+	  if (p_s->i_hash == l_hash && slot_key_equals(p_s, p_key))
+	    {
+	      return (int)i;
+	    }
+	}
+      if (match_empty(p_group))
+	{
+	  return -1;
+	}
+      stride += GROUP_SIZE;
+      pos = (pos + stride) & p_ht->i_size_mask;
+    }
+}
+
+/* Find the first EMPTY or DELETED slot in the probe sequence */
+static inline ght_uint32_t find_free(ght_hash_table_t *p_ht, unsigned char *p_ctrl, ght_uint32_t l_hash)
+{
+  ght_uint32_t pos = l_hash & p_ht->i_size_mask;
+  ght_uint32_t stride = 0;
+  group_mask_t m;
+
+  while ( !(m = match_empty_or_deleted(p_ctrl + pos)) )
+    {
+      stride += GROUP_SIZE;
+      pos = (pos + stride) & p_ht->i_size_mask;
+    }
+
+  return (pos + lowest_bit(m)) & p_ht->i_size_mask;
+}
+
+/* Allocate empty control bytes and slots for (at least) i_size slots */
+static int alloc_table(unsigned int i_size, unsigned char **pp_ctrl,
+		       ght_slot_t **pp_slots, unsigned int *p_size)
+{
+  unsigned int i_real_size = MIN_SIZE;
+
+  while (i_real_size < i_size && i_real_size < (1u << 30))
+    {
+      i_real_size <<= 1;
+    }
+
+  if ( !(*pp_ctrl = (unsigned char*)malloc(i_real_size + GROUP_SIZE)) )
+    {
+      perror("malloc");
+      return -1;
+    }
+  if ( !(*pp_slots = (ght_slot_t*)malloc(i_real_size * sizeof(ght_slot_t))) )
+    {
+      perror("malloc");
+      free(*pp_ctrl);
+      return -1;
+    }
+  memset(*pp_ctrl, CTRL_EMPTY, i_real_size + GROUP_SIZE);
+  *p_size = i_real_size;
+
+  return 0;
+}
+
+/* Move all entries to new arrays of (at least) i_size slots. This also
+ * clears all DELETED slots. */
+static int resize(ght_hash_table_t *p_ht, unsigned int i_size)
+{
+  swiss_table_t *p_t = TABLE(p_ht);
+  unsigned char *p_ctrl;
+  ght_slot_t *p_slots;
+  unsigned int i_old_size = p_ht->i_size;
+  unsigned int i_new_size;
+  unsigned int i;
+
+  if (i_size < MIN_SIZE)
+    {
+      i_size = MIN_SIZE;
+    }
+  while (MAX_ITEMS(i_size) <= p_ht->i_items)
+    {
+      i_size *= 2;
+    }
+  if (alloc_table(i_size, &p_ctrl, &p_slots, &i_new_size) < 0)
+    {
+      return -1;
+    }
+
+  p_ht->i_size = i_new_size;
+  p_ht->i_size_mask = i_new_size - 1;
+  for (i = 0; i < i_old_size; i++)
+    {
+      if (IS_FULL(p_t->p_ctrl[i]))
+	{
+	  ght_uint32_t j = find_free(p_ht, p_ctrl, p_t->p_slots[i].i_hash);
+
+	  set_ctrl(p_ht, p_ctrl, j, p_t->p_ctrl[i]);
+	  p_slots[j] = p_t->p_slots[i];
+	}
+    }
+  free(p_t->p_ctrl);
+  free(p_t->p_slots);
+  p_t->p_ctrl = p_ctrl;
+  p_t->p_slots = p_slots;
+  p_t->i_growth_left = MAX_ITEMS(i_new_size) - p_ht->i_items;
+
+  return 0;
+}
+
+static int sw_create(ght_hash_table_t *p_ht, unsigned int i_size)
+{
+  swiss_table_t *p_t;
+
+  if ( !(p_t = (swiss_table_t*)malloc(sizeof(swiss_table_t))) )
+    {
+      perror("malloc");
+      return -1;
+    }
+  if (alloc_table(i_size, &p_t->p_ctrl, &p_t->p_slots, &p_ht->i_size) < 0)
+    {
+      free(p_t);
+      return -1;
+    }
+  p_ht->i_size_mask = p_ht->i_size - 1;
+  p_t->i_growth_left = MAX_ITEMS(p_ht->i_size);
+  p_ht->p_engine_data = p_t;
+
+  return 0;
+}
+
+static void sw_finalize(ght_hash_table_t *p_ht)
+{
+  swiss_table_t *p_t = TABLE(p_ht);
+  unsigned int i;
+
+  for (i = 0; i < p_ht->i_size && !entries_released_at_once(p_ht); i++)
+    {
+      if (IS_FULL(p_t->p_ctrl[i]))
+	{
+	  slot_free_key(p_ht, &p_t->p_slots[i]);
+	}
+    }
+  free(p_t->p_ctrl);
+  free(p_t->p_slots);
+  free(p_t);
+  p_ht->p_engine_data = NULL;
+}
+
+static int sw_upsert(ght_hash_table_t *p_ht, void *p_entry_data,
+		     ght_hash_key_t *p_key, ght_uint32_t l_hash,
+		     int b_replace, void **pp_data)
+{
+  swiss_table_t *p_t = TABLE(p_ht);
+  ght_uint32_t i;
+  int i_found;
+
+  if ( (i_found = find_slot(p_ht, p_key, l_hash)) >= 0)
+    {
+      return upsert_found(&p_t->p_slots[i_found].p_data, p_entry_data, b_replace, pp_data);
+    }
+
+  if (p_t->i_growth_left == 0)
+    {
+      /* Mostly DELETED slots: Clean them up without growing */
+      unsigned int i_size = p_ht->i_items < MAX_ITEMS(p_ht->i_size) / 2 ?
+	p_ht->i_size : 2 * p_ht->i_size;
+
+      if (resize(p_ht, i_size) < 0)
+	{
+	  return -2;
+	}
+    }
+
+  i = find_free(p_ht, p_t->p_ctrl, l_hash);
+  if (slot_fill(p_ht, &p_t->p_slots[i], p_entry_data, p_key, l_hash) < 0)
+    {
+      return -2;
+    }
+  if (p_t->p_ctrl[i] == CTRL_EMPTY)
+    {
+      p_t->i_growth_left--;
+    }
+  set_ctrl(p_ht, p_t->p_ctrl, i, TAG(l_hash));
+  p_ht->i_items++;
+
+  return 0;
+}
+
+static void *sw_get(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  int i = find_slot(p_ht, p_key, l_hash);
+
+  return i < 0 ? NULL : TABLE(p_ht)->p_slots[i].p_data;
+}
+
+static void *sw_replace(ght_hash_table_t *p_ht, void *p_entry_data,
+			ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  int i = find_slot(p_ht, p_key, l_hash);
+  ght_slot_t *p_s;
+  void *p_old;
+
+  if (i < 0)
+    {
+      return NULL;
+    }
+  p_s = &TABLE(p_ht)->p_slots[i];
+  p_old = p_s->p_data;
+  p_s->p_data = p_entry_data;
+
+  return p_old;
+}
+
+/* Remove the entry in slot i and return its data */
+static void *remove_slot(ght_hash_table_t *p_ht, int i)
+{
+  swiss_table_t *p_t = TABLE(p_ht);
+  group_mask_t empty_before, empty_after;
+  void *p_ret;
+
+  p_ret = p_t->p_slots[i].p_data;
+  slot_free_key(p_ht, &p_t->p_slots[i]);
+
+  /* If every group which contains this slot also has an EMPTY slot, no
+   * lookup can have continued past it and it can be made EMPTY. */
+  empty_before = match_empty(p_t->p_ctrl + ((i - GROUP_SIZE) & p_ht->i_size_mask));
+  empty_after = match_empty(p_t->p_ctrl + i);
+  if (empty_before && empty_after &&
+      lowest_bit(empty_after) + leading_zeros(empty_before) < GROUP_SIZE)
+    {
+      set_ctrl(p_ht, p_t->p_ctrl, i, CTRL_EMPTY);
+      p_t->i_growth_left++;
+    }
+  else
+    {
+      set_ctrl(p_ht, p_t->p_ctrl, i, CTRL_DELETED);
+    }
+  p_ht->i_items--;
+
+  return p_ret;
+}
+
+static void *sw_remove(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  int i = find_slot(p_ht, p_key, l_hash);
+
+  return i < 0 ? NULL : remove_slot(p_ht, i);
+}
+
+static int sw_find(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash,
+		   ght_handle_t *p_handle)
+{
+  int i = find_slot(p_ht, p_key, l_hash);
+
+  if (i < 0)
+    {
+      return -1;
+    }
+  handle_fill_slot(p_handle, &TABLE(p_ht)->p_slots[i]);
+  p_handle->i_pos = i;
+
+  return 0;
+}
+
+static void *sw_remove_handle(ght_hash_table_t *p_ht, ght_handle_t *p_handle)
+{
+  return remove_slot(p_ht, p_handle->i_pos);
+}
+
+/* Iteration is in slot order. Nothing is moved by a removal. */
+static void *sw_next(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator,
+		     const void **pp_key, unsigned int *size)
+{
+  swiss_table_t *p_t = TABLE(p_ht);
+
+  while (p_iterator->i_pos < p_ht->i_size)
+    {
+      ght_uint32_t i = p_iterator->i_pos++;
+
+      if (IS_FULL(p_t->p_ctrl[i]))
+	{
+	  *pp_key = slot_key(&p_t->p_slots[i]);
+	  if (size != NULL)
+	    *size = p_t->p_slots[i].i_key_size;
+
+	  return p_t->p_slots[i].p_data;
+	}
+    }
+
+  *pp_key = NULL;
+  if (size != NULL)
+    *size = 0;
+
+  return NULL;
+}
+
+static void *sw_iterator_remove(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator)
+{
+  return remove_slot(p_ht, p_iterator->i_pos - 1);
+}
+
+static void *sw_first(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator,
+		      const void **pp_key, unsigned int *size)
+{
+  p_iterator->p_entry = NULL;
+  p_iterator->p_next = NULL;
+  p_iterator->i_pos = 0;
+  p_iterator->i_left = 0;
+
+  return sw_next(p_ht, p_iterator, pp_key, size);
+}
+
+static void sw_rehash(ght_hash_table_t *p_ht, unsigned int i_size)
+{
+  if (resize(p_ht, i_size) < 0)
+    {
+      fprintf(stderr, "hash_swiss.c ERROR: Out of memory when rehashing\n");
+    }
+}
+
+/* The control bytes first, the slot is only read if the tag matches */
+static void sw_prefetch(ght_hash_table_t *p_ht, ght_uint32_t l_hash, int i_stage)
+{
+  swiss_table_t *p_t = TABLE(p_ht);
+  ght_uint32_t pos = l_hash & p_ht->i_size_mask;
+
+  if (i_stage == 0)
+    {
+      PREFETCH(p_t->p_ctrl + pos);
+    }
+  else
+    {
+      PREFETCH(&p_t->p_slots[pos]);
+    }
+}
+
+static void sw_reserve(ght_hash_table_t *p_ht, unsigned int i_items)
+{
+  if (i_items >= MAX_ITEMS(p_ht->i_size))
+    {
+      resize(p_ht, i_items + i_items / 7 + 2);
+    }
+}
+
+const ght_engine_t ght_swiss_engine =
+{
+  sw_create,
+  sw_finalize,
+  sw_upsert,
+  sw_get,
+  sw_replace,
+  sw_remove,
+  sw_first,
+  sw_next,
+  sw_rehash,
+  sw_prefetch,
+  sw_reserve,
+  sw_find,
+  sw_remove_handle,
+  sw_iterator_remove,
+};
@@ -31,6 +31,8 @@
 #include <assert.h> /* assert */
 
 #include "ght_hash_table.h"
+#include "hash_engine.h"
+#include "hash_lock.h"
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -41,18 +43,54 @@
 #define FLAGS_NORMAL   0 /* Normal item. All user-inserted stuff is normal */
 #define FLAGS_INTERNAL 1 /* The item is internal to the hash table */
 
+/*
+ * A stripe of a concurrent table (see ght_set_concurrent()). Stripe s
+ * has buckets s, s + i_stripes, s + 2*i_stripes and so on. As the
+ * stripe is given by the lowest bits of the hash value and the table
+ * is never smaller than i_stripes, the entries of a stripe stay in
+ * the same stripe when the table is rehashed.
+ */
+typedef struct s_ght_stripe
+{
+  ght_rwlock_t lock;
+  unsigned int i_items;   /* The number of entries in the stripe */
+  unsigned int i_migrate; /* The next old bucket of the stripe to move */
+  unsigned int i_seq;     /* Odd while entries are moved between chains */
+
+  ght_hash_entry_t *p_retired;  /* Removed entries, linked with p_older */
+  unsigned int i_retired;
+  ght_hash_entry_t *p_waiting;  /* Removed entries waiting for i_wait_epoch */
+  unsigned int i_wait_epoch;
+  char pad[64];           /* Keep the locks on different cache lines */
+} ght_stripe_t;
+
+/* An old bucket array which lock-free readers may still be looking
+ * at, see free_old_buckets() */
+typedef struct s_ght_retired
+{
+  void *p_mem;
+  unsigned int i_epoch;
+  struct s_ght_retired *p_next;
+} ght_retired_t;
+
+#define STRIPE(p_ht, l_hash) (&(p_ht)->p_stripes[(l_hash) & ((p_ht)->i_stripes - 1)])
+
 /* Prototypes */
 static inline void              transpose(ght_hash_table_t *p_ht, ght_uint32_t l_bucket, ght_hash_entry_t *p_entry);
 static inline void              move_to_front(ght_hash_table_t *p_ht, ght_uint32_t l_bucket, ght_hash_entry_t *p_entry);
 static inline void              free_entry_chain(ght_hash_table_t *p_ht, ght_hash_entry_t *p_entry);
-static inline ght_hash_entry_t *search_in_bucket(ght_hash_table_t *p_ht, ght_uint32_t l_bucket, ght_hash_key_t *p_key, unsigned char i_heuristics);
+static inline ght_hash_entry_t *search_in_bucket(ght_hash_table_t *p_ht, ght_uint32_t l_bucket, ght_hash_key_t *p_key, ght_uint32_t l_hash, unsigned char i_heuristics);
 
 static inline void              hk_fill(ght_hash_key_t *p_hk, int i_size, const void *p_key);
-static inline ght_hash_entry_t *he_create(ght_hash_table_t *p_ht, void *p_data, unsigned int i_key_size, const void *p_key_data);
-static inline void              he_finalize(ght_hash_table_t *p_ht, ght_hash_entry_t *p_he);
 
 /* --- private methods --- */
 
+/*
+ * The links of the chains and the bucket heads are written with
+ * atomic_set_ptr(), as the readers of a table with lock-free reads
+ * (see get_lockfree()) follow them without any lock.
+ */
+
 /* Move p_entry one up in its list. */
 static inline void transpose(ght_hash_table_t *p_ht, ght_uint32_t l_bucket, ght_hash_entry_t *p_entry)
 {
@@ -72,11 +110,11 @@ static inline void transpose(ght_hash_table_t *p_ht, ght_uint32_t l_bucket, ght_
 
       if (p_a)
 	{
-	  p_a->p_next = p_entry;
+	  atomic_set_ptr(&p_a->p_next, p_entry);
 	}
       else /* This element is now placed first */
 	{
-	  p_ht->pp_entries[l_bucket] = p_entry;
+	  atomic_set_ptr(&p_ht->pp_entries[l_bucket], p_entry);
 	}
 
       if (p_b)
@@ -85,10 +123,10 @@ static inline void transpose(ght_hash_table_t *p_ht, ght_uint32_t l_bucket, ght_
 	}
       if (p_x)
 	{
-	  p_x->p_next = p_entry->p_next;
+	  atomic_set_ptr(&p_x->p_next, p_entry->p_next);
 	  p_x->p_prev = p_entry;
 	}
-      p_entry->p_next = p_x;
+      atomic_set_ptr(&p_entry->p_next, p_x);
       p_entry->p_prev = p_a;
     }
 }
@@ -110,83 +148,218 @@ static inline void move_to_front(ght_hash_table_t *p_ht, ght_uint32_t l_bucket,
     }
 
   /* Link p_entry out of the list. */
-  p_entry->p_prev->p_next = p_entry->p_next;
+  atomic_set_ptr(&p_entry->p_prev->p_next, p_entry->p_next);
   if (p_entry->p_next)
     {
       p_entry->p_next->p_prev = p_entry->p_prev;
     }
 
   /* Place p_entry first */
-  p_entry->p_next = p_ht->pp_entries[l_bucket];
+  atomic_set_ptr(&p_entry->p_next, p_ht->pp_entries[l_bucket]);
   p_entry->p_prev = NULL;
   p_ht->pp_entries[l_bucket]->p_prev = p_entry;
-  p_ht->pp_entries[l_bucket] = p_entry;
+  atomic_set_ptr(&p_ht->pp_entries[l_bucket], p_entry);
 }
 
 static inline void remove_from_chain(ght_hash_table_t *p_ht, ght_uint32_t l_bucket, ght_hash_entry_t *p)
 {
   if (p->p_prev)
     {
-      p->p_prev->p_next = p->p_next;
+      atomic_set_ptr(&p->p_prev->p_next, p->p_next);
     }
   else /* first in list */
     {
-      p_ht->pp_entries[l_bucket] = p->p_next;
+      atomic_set_ptr(&p_ht->pp_entries[l_bucket], p->p_next);
     }
   if (p->p_next)
     {
       p->p_next->p_prev = p->p_prev;
     }
 
-  if (p->p_older)
+  /* Concurrent tables have no insertion order */
+  if (!p_ht->p_stripes)
     {
-      p->p_older->p_newer = p->p_newer;
+      order_remove(p_ht, p);
     }
-  else /* oldest */
+}
+
+/* Count entries added to or removed from the table. Concurrent tables
+ * count per stripe, under the lock of the stripe. */
+static inline void count_items(ght_hash_table_t *p_ht, ght_uint32_t l_hash, int i_diff)
+{
+  if (p_ht->p_stripes)
     {
-      p_ht->p_oldest = p->p_newer;
+      STRIPE(p_ht, l_hash)->i_items += i_diff;
     }
-  if (p->p_newer)
+  else
     {
-      p->p_newer->p_older = p->p_older;
+      p_ht->i_items += i_diff;
     }
-  else /* newest */
+}
+
+/* TRUE if the table uses the pool of ght_set_pool(), which, unlike
+ * other allocators, belongs to the table */
+static inline int uses_pool(ght_hash_table_t *p_ht)
+{
+  return p_ht->allocator.fn_alloc == ght_pool_allocator.fn_alloc;
+}
+
+/* Note that entries may have moved, see ght_handle_t. The handles of
+ * concurrent tables are not checked. */
+static inline void entries_moved(ght_hash_table_t *p_ht)
+{
+  if (!p_ht->p_stripes)
     {
-      p_ht->p_newest = p->p_older;
+      p_ht->i_generation++;
     }
 }
 
-/* Search for an element in a bucket */
-static inline ght_hash_entry_t *search_in_bucket(ght_hash_table_t *p_ht, ght_uint32_t l_bucket,
-						 ght_hash_key_t *p_key, unsigned char i_heuristics)
+/* Make the seq of a stripe odd before its entries are moved to other
+ * chains, and even again afterwards, see get_lockfree(). Only called
+ * with the stripe locked for writing. */
+static inline void seq_begin(ght_stripe_t *p_stripe)
 {
-  ght_hash_entry_t *p_e;
+  atomic_set_uint(&p_stripe->i_seq, p_stripe->i_seq + 1);
+  fence_release();
+}
+
+static inline void seq_end(ght_stripe_t *p_stripe)
+{
+  atomic_set_uint(&p_stripe->i_seq, p_stripe->i_seq + 1);
+}
+
+/* Free a list of removed entries, linked with p_older */
+static void free_retired(ght_hash_table_t *p_ht, ght_hash_entry_t *p_e)
+{
+  while (p_e)
+    {
+      ght_hash_entry_t *p_older = p_e->p_older;
+
+      he_finalize(p_ht, p_e);
+      p_e = p_older;
+    }
+}
+
+/* The number of removed entries a stripe collects before trying to
+ * free the ones removed before them */
+#define RETIRE_BATCH 64
+
+/*
+ * Free an entry which has been unlinked from its chain. With lock-free
+ * reads, other threads may still be looking at it, so it is put on
+ * the retired list of its stripe instead. Every RETIRE_BATCH entries,
+ * the list which has been waiting is freed if all registered threads
+ * have been quiescent since, and the retired entries start waiting.
+ */
+static inline void entry_free(ght_hash_table_t *p_ht, ght_hash_entry_t *p_e)
+{
+  ght_stripe_t *p_stripe;
+
+  if (!p_ht->i_lockfree_reads)
+    {
+      he_finalize(p_ht, p_e);
+      return;
+    }
+
+  p_stripe = STRIPE(p_ht, p_e->i_hash);
+  p_e->p_older = p_stripe->p_retired;
+  p_stripe->p_retired = p_e;
+  if (++p_stripe->i_retired % RETIRE_BATCH != 0)
+    {
+      return;
+    }
+
+  if (p_stripe->p_waiting && ght_epoch_passed(p_stripe->i_wait_epoch))
+    {
+      free_retired(p_ht, p_stripe->p_waiting);
+      p_stripe->p_waiting = NULL;
+    }
+  if (!p_stripe->p_waiting)
+    {
+      p_stripe->p_waiting = p_stripe->p_retired;
+      p_stripe->i_wait_epoch = ght_epoch_new();
+      p_stripe->p_retired = NULL;
+      p_stripe->i_retired = 0;
+    }
+}
+
+/* Unlink an entry from bucket l_bucket, free it and return its data */
+static void *remove_entry(ght_hash_table_t *p_ht, ght_uint32_t l_bucket, ght_hash_entry_t *p_out)
+{
+  void *p_ret;
+
+  remove_from_chain(p_ht, l_bucket, p_out);
+
+  /* This should ONLY be done for normal items (for now all items) */
+  count_items(p_ht, p_out->i_hash, -1);
+
+  p_ht->p_nr[l_bucket]--;
+#if !defined(NDEBUG)
+  /* Lock-free readers may still follow p_next */
+  if (!p_ht->i_lockfree_reads)
+    {
+      p_out->p_next = NULL;
+    }
+  p_out->p_prev = NULL;
+#endif /* NDEBUG */
+
+  p_ret = p_out->p_data;
+  entry_free(p_ht, p_out);
+
+  return p_ret;
+}
 
-  for (p_e = p_ht->pp_entries[l_bucket];
-       p_e;
-       p_e = p_e->p_next)
+/* Search for an element in a chain. The cached hash value of the
+ * entries is compared first, so the key data is only touched for
+ * entries which are very likely to match. */
+static inline ght_hash_entry_t *search_chain(ght_hash_entry_t *p_e,
+					     ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  for (; p_e; p_e = atomic_get_ptr(&p_e->p_next))
     {
-      if ((p_e->key.i_size == p_key->i_size) &&
+      if ((p_e->i_hash == l_hash) &&
+	  (p_e->key.i_size == p_key->i_size) &&
 	  (memcmp(p_e->key.p_key, p_key->p_key, p_e->key.i_size) == 0))
 	{
-	  /* Matching entry found - Apply heuristics, if any */
-	  switch (i_heuristics)
-	    {
-	    case GHT_HEURISTICS_MOVE_TO_FRONT:
-	      move_to_front(p_ht, l_bucket, p_e);
-	      break;
-	    case GHT_HEURISTICS_TRANSPOSE:
-	      transpose(p_ht, l_bucket, p_e);
-	      break;
-	    default:
-	      break;
-	    }
 	  return p_e;
 	}
     }
   return NULL;
 }
 
+/* Search for an element in a bucket */
+static inline ght_hash_entry_t *search_in_bucket(ght_hash_table_t *p_ht, ght_uint32_t l_bucket,
+						 ght_hash_key_t *p_key, ght_uint32_t l_hash,
+						 unsigned char i_heuristics)
+{
+  ght_hash_entry_t *p_e = search_chain(p_ht->pp_entries[l_bucket], p_key, l_hash);
+
+  if (p_e && i_heuristics != GHT_HEURISTICS_NONE)
+    {
+      /* Matching entry found - Apply heuristics */
+      if (p_ht->p_stripes)
+	{
+	  seq_begin(STRIPE(p_ht, l_hash));
+	}
+      switch (i_heuristics)
+	{
+	case GHT_HEURISTICS_MOVE_TO_FRONT:
+	  move_to_front(p_ht, l_bucket, p_e);
+	  break;
+	case GHT_HEURISTICS_TRANSPOSE:
+	  transpose(p_ht, l_bucket, p_e);
+	  break;
+	default:
+	  break;
+	}
+      if (p_ht->p_stripes)
+	{
+	  seq_end(STRIPE(p_ht, l_hash));
+	}
+    }
+  return p_e;
+}
+
 /* Free a chain of entries (in a bucket) */
 static inline void free_entry_chain(ght_hash_table_t *p_ht, ght_hash_entry_t *p_entry)
 {
@@ -210,316 +383,1814 @@ static inline void hk_fill(ght_hash_key_t *p_hk, int i_size, const void *p_key)
   p_hk->p_key = p_key;
 }
 
-/* Create an hash entry */
-static inline ght_hash_entry_t *he_create(ght_hash_table_t *p_ht, void *p_data,
-					  unsigned int i_key_size, const void *p_key_data)
+/* The number of old buckets moved for each operation during an
+ * incremental rehash. */
+#define GHT_REHASH_STEP 4
+
+/* Allocate an empty bucket array (and the bucket counters) with room
+ * for at least i_size buckets. The size is rounded up to the nearest
+ * power of two. Returns 0 on success, -1 if the allocation failed. */
+static int alloc_buckets(unsigned int i_size, ght_hash_entry_t ***ppp_entries, int **pp_nr,
+			 unsigned int *p_size, int *p_size_mask)
 {
-  ght_hash_entry_t *p_he;
+  unsigned int i_real_size = 1;
+  int i=1;
 
-  /*
-   * An element like the following is allocated:
-   *        elem->p_key
-   *       /   elem->p_key->p_key_data
-   *  ____|___/________
-   * |elem|key|key data|
-   * |____|___|________|
-   *
-   * That is, the key and the key data is stored "inline" within the
-   * hash entry.
-   *
-   * This saves space since malloc only is called once and thus avoids
-   * some fragmentation. Thanks to Dru Lemley for this idea.
-   */
-  if ( !(p_he = (ght_hash_entry_t*)p_ht->fn_alloc (sizeof(ght_hash_entry_t)+i_key_size)) )
+  /* Set the size of the hash table to the nearest 2^i higher then i_size */
+  while(i_real_size < i_size)
     {
-      fprintf(stderr, "fn_alloc failed!\n");
-      return NULL;
+      i_real_size = 1<<i++;
+    }
+
+  /* Create an empty bucket list. */
+  if ( !(*ppp_entries = (ght_hash_entry_t**)malloc(i_real_size*sizeof(ght_hash_entry_t*))) )
+    {
+      perror("malloc");
+      return -1;
     }
+  memset(*ppp_entries, 0, i_real_size*sizeof(ght_hash_entry_t*));
 
-  p_he->p_data = p_data;
-  p_he->p_next = NULL;
-  p_he->p_prev = NULL;
-  p_he->p_older = NULL;
-  p_he->p_newer = NULL;
+  /* Initialise the number of entries in each bucket to zero */
+  if ( !(*pp_nr = (int*)malloc(i_real_size*sizeof(int))))
+    {
+      perror("malloc");
+      free(*ppp_entries);
+      return -1;
+    }
+  memset(*pp_nr, 0, i_real_size*sizeof(int));
 
-  /* Create the key */
-  p_he->key.i_size = i_key_size;
-  memcpy(p_he+1, p_key_data, i_key_size);
-  p_he->key.p_key = (void*)(p_he+1);
+  *p_size = i_real_size;
+  *p_size_mask = (1<<(i-1))-1; /* Mask to & with */
 
-  return p_he;
+  return 0;
 }
 
-/* Finalize (free) a hash entry */
-static inline void he_finalize(ght_hash_table_t *p_ht, ght_hash_entry_t *p_he)
+/* Move all entries in bucket l_old of the old bucket array into the
+ * current bucket array. The entries are relinked, not reallocated, and
+ * their relative order within the bucket is kept. */
+static inline void migrate_bucket(ght_hash_table_t *p_ht, ght_uint32_t l_old)
 {
-  assert(p_he);
+  ght_hash_entry_t *p_e = p_ht->pp_old_entries[l_old];
 
-#if !defined(NDEBUG)
-  p_he->p_next = NULL;
-  p_he->p_prev = NULL;
-  p_he->p_older = NULL;
-  p_he->p_newer = NULL;
-#endif /* NDEBUG */
+  if (!p_e)
+    {
+      return;
+    }
+
+  /* Find the last entry and move the chain backwards, placing each
+   * entry first in its new bucket. */
+  while (p_e->p_next)
+    {
+      p_e = p_e->p_next;
+    }
+  while (p_e)
+    {
+      ght_hash_entry_t *p_prev = p_e->p_prev;
+      ght_uint32_t l_key = p_e->i_hash & p_ht->i_size_mask;
+
+      atomic_set_ptr(&p_e->p_next, p_ht->pp_entries[l_key]);
+      p_e->p_prev = NULL;
+      if (p_ht->pp_entries[l_key])
+	{
+	  p_ht->pp_entries[l_key]->p_prev = p_e;
+	}
+      atomic_set_ptr(&p_ht->pp_entries[l_key], p_e);
+      p_ht->p_nr[l_key]++;
 
-  /* Free the entry */
-  p_ht->fn_free(p_he);
+      p_e = p_prev;
+    }
+  atomic_set_ptr(&p_ht->pp_old_entries[l_old], NULL);
+  p_ht->p_old_nr[l_old] = 0;
 }
 
-#if 0
-/* Tried this to avoid recalculating hash values by caching
- * them. Overhead larger than benefits.
- */
-static inline ght_uint32_t get_hash_value(ght_hash_table_t *p_ht, ght_hash_key_t *p_key)
+/* Free the bucket arrays of the old buckets of rehash which is done.
+ * With lock-free reads, the old buckets are freed later, as other
+ * threads may still be looking at them. */
+static void free_old_buckets(ght_hash_table_t *p_ht)
 {
-  int i;
+  ght_retired_t *p_retired;
 
-  if (p_key->i_size > sizeof(uint64_t))
-    return p_ht->fn_hash(p_key);
+  free (p_ht->p_old_nr);
+  p_ht->p_old_nr = NULL;
 
-  /* Lookup in the hash value cache */
-  for (i = 0; i < GHT_N_CACHED_HASH_KEYS; i++)
+  if (!p_ht->i_lockfree_reads)
     {
-      if ( p_key->i_size == p_ht->cached_keys[i].key.i_size &&
-	   memcmp(p_key->p_key, p_ht->cached_keys[i].key.p_key, p_key->i_size) == 0)
-	return p_ht->cached_keys[i].hash_val;
+      free (p_ht->pp_old_entries);
     }
-  p_ht->cur_cache_evict = (p_ht->cur_cache_evict + 1) % GHT_N_CACHED_HASH_KEYS;
-  p_ht->cached_keys[ p_ht->cur_cache_evict ].key = *p_key;
-  p_ht->cached_keys[ p_ht->cur_cache_evict ].hash_val = p_ht->fn_hash(p_key);
-
-  return p_ht->cached_keys[ p_ht->cur_cache_evict ].hash_val;
+  else if ( (p_retired = (ght_retired_t*)malloc(sizeof(ght_retired_t))) )
+    {
+      p_retired->p_mem = p_ht->pp_old_entries;
+      p_retired->i_epoch = ght_epoch_new();
+      p_retired->p_next = p_ht->p_retired_buckets;
+      p_ht->p_retired_buckets = p_retired;
+    }
+  else
+    {
+      /* The buckets are leaked rather than freed too early */
+      perror("malloc");
+    }
+  atomic_set_ptr(&p_ht->pp_old_entries, NULL);
 }
-#else
-# define get_hash_value(p_ht, p_key) ( (p_ht)->fn_hash(p_key) )
-#endif
-
 
-/* --- Exported methods --- */
-/* Create a new hash table */
-ght_hash_table_t *ght_create(unsigned int i_size)
+/* Free the old bucket arrays no other thread can be looking at
+ * anymore, or all of them if b_all is set */
+static void free_retired_buckets(ght_hash_table_t *p_ht, int b_all)
 {
-  ght_hash_table_t *p_ht;
-  int i=1;
+  ght_retired_t **pp = &p_ht->p_retired_buckets;
 
-  if ( !(p_ht = (ght_hash_table_t*)malloc (sizeof(ght_hash_table_t))) )
+  while (*pp)
     {
-      perror("malloc");
-      return NULL;
+      ght_retired_t *p_retired = *pp;
+
+      if (b_all || ght_epoch_passed(p_retired->i_epoch))
+	{
+	  *pp = p_retired->p_next;
+	  free (p_retired->p_mem);
+	  free (p_retired);
+	}
+      else
+	{
+	  pp = &p_retired->p_next;
+	}
     }
+}
 
-  /* Set the size of the hash table to the nearest 2^i higher then i_size */
-  p_ht->i_size = 1;
-  while(p_ht->i_size < i_size)
+/* Move a few more buckets from the old bucket array, and free the old
+ * array when all entries have been moved. */
+static void rehash_step(ght_hash_table_t *p_ht, unsigned int i_buckets)
+{
+  while (i_buckets-- > 0 && p_ht->i_migrate < p_ht->i_old_size)
     {
-      p_ht->i_size = 1<<i++;
+      migrate_bucket(p_ht, p_ht->i_migrate++);
     }
 
-  p_ht->i_size_mask = (1<<(i-1))-1; /* Mask to & with */
-  p_ht->i_items = 0;
+  if (p_ht->i_migrate >= p_ht->i_old_size)
+    {
+      free_old_buckets(p_ht);
+      atomic_set_uint(&p_ht->i_old_size, 0);
+      atomic_set_uint(&p_ht->i_old_size_mask, 0);
+      p_ht->i_migrate = 0;
+    }
+}
 
-  p_ht->fn_hash = ght_one_at_a_time_hash;
+/*
+ * A parallel rehash splits the buckets into groups which no entry
+ * moves between. With n = min(old size, new size), group g is made of
+ * the old buckets g, g+n, g+2n... and of the new buckets g, g+n,
+ * g+2n..., as every old bucket of the group only has entries for new
+ * buckets of the group. Every thread moves a range of groups, so the
+ * threads write to different buckets and entries and need no locks.
+ *
+ * The old buckets of a group are moved in increasing order, so every
+ * new chain ends up the same as with rehash_step(). The insertion
+ * order list is not touched at all.
+ */
+typedef struct
+{
+  ght_hash_table_t *p_ht;
+  unsigned int i_first;          /* The first group to move */
+  unsigned int i_last;           /* One past the last group */
+} rehash_slice_t;
 
-  /* Standard values for allocations */
-  p_ht->fn_alloc = malloc;
-  p_ht->fn_free = free;
+/* Don't start threads for less than this many groups each */
+#define REHASH_MIN_GROUPS 4096
 
-  /* Set flags */
-  p_ht->i_heuristics = GHT_HEURISTICS_NONE;
-  p_ht->i_automatic_rehash = FALSE;
+static void migrate_groups(rehash_slice_t *p_slice)
+{
+  ght_hash_table_t *p_ht = p_slice->p_ht;
+  unsigned int i_groups = p_ht->i_old_size < p_ht->i_size ? p_ht->i_old_size : p_ht->i_size;
+  unsigned int i_group;
+  ght_uint32_t l_old;
 
-  p_ht->bucket_limit = 0;
-  p_ht->fn_bucket_free = NULL;
+  for (i_group = p_slice->i_first; i_group < p_slice->i_last; i_group++)
+    {
+      for (l_old = i_group; l_old < p_ht->i_old_size; l_old += i_groups)
+	{
+	  migrate_bucket(p_ht, l_old);
+	}
+    }
+}
 
-  /* Create an empty bucket list. */
-  if ( !(p_ht->pp_entries = (ght_hash_entry_t**)malloc(p_ht->i_size*sizeof(ght_hash_entry_t*))) )
+static THREAD_FN(rehash_worker, p_arg)
+{
+  migrate_groups((rehash_slice_t*)p_arg);
+
+  return THREAD_RETURN;
+}
+
+/* Run fn for each of the i_threads arguments in p_args, which are
+ * i_arg_size bytes each, in i_threads threads (the calling one
+ * included). Arguments whose thread could not be started are run by
+ * the calling thread. */
+static void run_parallel(ght_thread_fn_t fn, void *p_args, size_t i_arg_size,
+			 unsigned int i_threads)
+{
+  ght_thread_t *p_threads;
+  int *p_started;
+  unsigned int i;
+
+  if ( !(p_threads = (ght_thread_t*)malloc(i_threads * (sizeof(ght_thread_t) + sizeof(int)))) )
     {
-      perror("malloc");
-      free(p_ht);
-      return NULL;
+      for (i = 0; i < i_threads; i++)
+	{
+	  fn((char*)p_args + i * i_arg_size);
+	}
+      return;
     }
-  memset(p_ht->pp_entries, 0, p_ht->i_size*sizeof(ght_hash_entry_t*));
+  p_started = (int*)(p_threads + i_threads);
 
-  /* Initialise the number of entries in each bucket to zero */
-  if ( !(p_ht->p_nr = (int*)malloc(p_ht->i_size*sizeof(int))))
+  for (i = 1; i < i_threads; i++)
     {
-      perror("malloc");
-      free(p_ht->pp_entries);
-      free(p_ht);
-      return NULL;
+      p_started[i] = thread_create(&p_threads[i], fn, (char*)p_args + i * i_arg_size) == 0;
+    }
+  fn(p_args);
+  for (i = 1; i < i_threads; i++)
+    {
+      if (p_started[i])
+	{
+	  thread_join(p_threads[i]);
+	}
+      else
+	{
+	  fn((char*)p_args + i * i_arg_size);
+	}
     }
-  memset(p_ht->p_nr, 0, p_ht->i_size*sizeof(int));
+  free(p_threads);
+}
 
-  p_ht->p_oldest = NULL;
-  p_ht->p_newest = NULL;
+/* Move all old buckets with up to i_threads threads, the calling one
+ * included, and free the old bucket array. */
+static void rehash_parallel(ght_hash_table_t *p_ht, unsigned int i_threads)
+{
+  unsigned int i_groups = p_ht->i_old_size < p_ht->i_size ? p_ht->i_old_size : p_ht->i_size;
+  rehash_slice_t *p_slices;
+  unsigned int i;
 
-  return p_ht;
+  if (i_threads > i_groups / REHASH_MIN_GROUPS)
+    {
+      i_threads = i_groups / REHASH_MIN_GROUPS;
+    }
+  if (i_threads <= 1 ||
+      !(p_slices = (rehash_slice_t*)malloc(i_threads * sizeof(rehash_slice_t))) )
+    {
+      rehash_step(p_ht, p_ht->i_old_size);
+      return;
+    }
+
+  for (i = 0; i < i_threads; i++)
+    {
+      p_slices[i].p_ht = p_ht;
+      p_slices[i].i_first = i * (i_groups / i_threads);
+      p_slices[i].i_last = i + 1 < i_threads ? (i + 1) * (i_groups / i_threads) : i_groups;
+    }
+  run_parallel(rehash_worker, p_slices, sizeof(rehash_slice_t), i_threads);
+  free(p_slices);
+
+  /* Every old bucket is empty now */
+  p_ht->i_migrate = p_ht->i_old_size;
+  rehash_step(p_ht, 0);
 }
 
-/* Set the allocation/deallocation function to use */
-void ght_set_alloc(ght_hash_table_t *p_ht, ght_fn_alloc_t fn_alloc, ght_fn_free_t fn_free)
+/* Make a new bucket array the current one, and the current one the
+ * old one of an incremental rehash */
+static void swap_buckets(ght_hash_table_t *p_ht, ght_hash_entry_t **pp_entries, int *p_nr,
+			 unsigned int i_new_size, int i_new_size_mask)
 {
-  p_ht->fn_alloc = fn_alloc;
-  p_ht->fn_free = fn_free;
+  assert(p_ht->pp_old_entries == NULL);
+
+  atomic_set_ptr(&p_ht->pp_old_entries, p_ht->pp_entries);
+  p_ht->p_old_nr = p_ht->p_nr;
+  atomic_set_uint(&p_ht->i_old_size, p_ht->i_size);
+  atomic_set_uint(&p_ht->i_old_size_mask, p_ht->i_size_mask);
+  p_ht->i_migrate = 0;
+
+  atomic_set_ptr(&p_ht->pp_entries, pp_entries);
+  p_ht->p_nr = p_nr;
+  atomic_set_uint(&p_ht->i_size, i_new_size);
+  atomic_set_uint(&p_ht->i_size_mask, i_new_size_mask);
 }
 
-/* Set the hash function to use */
-void ght_set_hash(ght_hash_table_t *p_ht, ght_fn_hash_t fn_hash)
+/* Start an incremental rehash to i_size buckets. The current bucket
+ * array becomes the old one, which is then emptied a few buckets at a
+ * time by the following operations on the table. */
+static void start_rehash(ght_hash_table_t *p_ht, unsigned int i_size)
 {
-  p_ht->fn_hash = fn_hash;
+  ght_hash_entry_t **pp_entries;
+  int *p_nr;
+  unsigned int i_new_size;
+  int i_new_size_mask;
+
+  if (alloc_buckets(i_size, &pp_entries, &p_nr, &i_new_size, &i_new_size_mask) < 0)
+    {
+      /* Keep the current size, we'll try again on the next insert */
+      return;
+    }
+  swap_buckets(p_ht, pp_entries, p_nr, i_new_size, i_new_size_mask);
 }
 
-/* Set the heuristics to use. */
-void ght_set_heuristics(ght_hash_table_t *p_ht, int i_heuristics)
+/* TRUE if the stripe of l_hash still has entries in the old buckets */
+static inline int stripe_migrating(ght_hash_table_t *p_ht, ght_uint32_t l_hash)
 {
-  p_ht->i_heuristics = i_heuristics;
+  return STRIPE(p_ht, l_hash)->i_migrate < p_ht->i_old_size;
 }
 
-/* Set the rehashing status of the table. */
-void ght_set_rehash(ght_hash_table_t *p_ht, int b_rehash)
+/*
+ * The incremental rehash of a concurrent table. Every stripe moves its
+ * own old buckets, which only hold entries for its own new buckets, so
+ * only the lock of the stripe of l_hash is needed. The stripe moves a
+ * few more of its old buckets and the one l_hash is in. The old bucket
+ * array is freed by the last stripe to finish, when no other stripe
+ * will look at it anymore.
+ */
+static void stripe_migrate(ght_hash_table_t *p_ht, ght_uint32_t l_hash)
 {
-  p_ht->i_automatic_rehash = b_rehash;
+  ght_stripe_t *p_stripe = STRIPE(p_ht, l_hash);
+  int i;
+
+  if (!stripe_migrating(p_ht, l_hash))
+    {
+      return;
+    }
+  seq_begin(p_stripe);
+  for (i = 0; i < GHT_REHASH_STEP && p_stripe->i_migrate < p_ht->i_old_size; i++)
+    {
+      migrate_bucket(p_ht, p_stripe->i_migrate);
+      atomic_set_uint(&p_stripe->i_migrate, p_stripe->i_migrate + p_ht->i_stripes);
+    }
+  if (stripe_migrating(p_ht, l_hash))
+    {
+      migrate_bucket(p_ht, l_hash & p_ht->i_old_size_mask);
+    }
+  else if (atomic_inc_uint(&p_ht->i_stripes_migrated) == p_ht->i_stripes)
+    {
+      /* i_old_size is left, it is only changed with all stripes locked */
+      free_old_buckets(p_ht);
+    }
+  seq_end(p_stripe);
 }
 
-void ght_set_bounded_buckets(ght_hash_table_t *p_ht, unsigned int limit, ght_fn_bucket_free_callback_t fn)
+/* Lock (for writing) all stripes of a concurrent table, in order. This
+ * is only done to move entries around, so the seqs are made odd too. */
+static void lock_stripes(ght_hash_table_t *p_ht)
 {
-  p_ht->bucket_limit = limit;
-  p_ht->fn_bucket_free = fn;
+  unsigned int i;
 
-  if (limit > 0 && fn == NULL)
+  for (i = 0; i < p_ht->i_stripes; i++)
     {
-      fprintf(stderr, "ght_set_bounded_buckets: The bucket callback function is NULL but the limit is %d\n", limit);
+      rwlock_wrlock(&p_ht->p_stripes[i].lock);
+      seq_begin(&p_ht->p_stripes[i]);
     }
 }
 
+static void unlock_stripes(ght_hash_table_t *p_ht)
+{
+  unsigned int i;
 
-/* Get the number of items in the hash table */
-unsigned int ght_size(ght_hash_table_t *p_ht)
+  for (i = 0; i < p_ht->i_stripes; i++)
+    {
+      seq_end(&p_ht->p_stripes[i]);
+      rwlock_wrunlock(&p_ht->p_stripes[i].lock);
+    }
+}
+
+/* Finish the incremental rehash of a concurrent table with all stripes
+ * locked */
+static void finish_stripes(ght_hash_table_t *p_ht)
 {
-  return p_ht->i_items;
+  if (p_ht->pp_old_entries)
+    {
+      rehash_step(p_ht, p_ht->i_old_size);
+    }
+  /* All stripes are done now */
+  atomic_set_uint(&p_ht->i_old_size, 0);
+  atomic_set_uint(&p_ht->i_old_size_mask, 0);
+  free_retired_buckets(p_ht, FALSE);
 }
 
-/* Get the size of the hash table */
-unsigned int ght_table_size(ght_hash_table_t *p_ht)
+/*
+ * Double the buckets of a concurrent table of i_size buckets, unless
+ * another thread already has. The new bucket array is allocated before
+ * the stripes are locked, and they are only held while the bucket
+ * arrays are swapped. The entries are then moved by stripe_migrate().
+ */
+static void grow_stripes(ght_hash_table_t *p_ht, unsigned int i_size)
 {
-  return p_ht->i_size;
+  ght_hash_entry_t **pp_entries;
+  int *p_nr;
+  unsigned int i_new_size;
+  int i_new_size_mask;
+  unsigned int i;
+
+  if (alloc_buckets(2*i_size, &pp_entries, &p_nr, &i_new_size, &i_new_size_mask) < 0)
+    {
+      return;
+    }
+
+  lock_stripes(p_ht);
+  if (p_ht->i_size == i_size)
+    {
+      /* The previous rehash is very rarely still going on */
+      finish_stripes(p_ht);
+      swap_buckets(p_ht, pp_entries, p_nr, i_new_size, i_new_size_mask);
+      for (i = 0; i < p_ht->i_stripes; i++)
+	{
+	  atomic_set_uint(&p_ht->p_stripes[i].i_migrate, i);
+	}
+      p_ht->i_stripes_migrated = 0;
+      pp_entries = NULL;
+    }
+  unlock_stripes(p_ht);
+
+  if (pp_entries)
+    {
+      free(pp_entries);
+      free(p_nr);
+    }
+}
+
+/* Lock the stripe of l_hash for writing, if the table is concurrent */
+static inline void lock_bucket(ght_hash_table_t *p_ht, ght_uint32_t l_hash)
+{
+  if (p_ht->p_stripes)
+    {
+      rwlock_wrlock(&STRIPE(p_ht, l_hash)->lock);
+    }
+}
+
+static inline void unlock_bucket(ght_hash_table_t *p_ht, ght_uint32_t l_hash)
+{
+  if (p_ht->p_stripes)
+    {
+      rwlock_wrunlock(&STRIPE(p_ht, l_hash)->lock);
+    }
+}
+
+/* Get the bucket for a hash value. If an incremental rehash is in
+ * progress, this also moves some buckets over and makes sure the
+ * entries which might match l_hash are in the current bucket array. */
+static inline ght_uint32_t get_bucket(ght_hash_table_t *p_ht, ght_uint32_t l_hash)
+{
+  if (p_ht->p_stripes)
+    {
+      stripe_migrate(p_ht, l_hash);
+    }
+  else if (p_ht->pp_old_entries)
+    {
+      rehash_step(p_ht, GHT_REHASH_STEP);
+      if (p_ht->pp_old_entries)
+	{
+	  migrate_bucket(p_ht, l_hash & p_ht->i_old_size_mask);
+	}
+    }
+
+  return l_hash & p_ht->i_size_mask;
+}
+
+/* The hash value of every entry is cached in ght_hash_entry_t, so
+ * the hash function only needs to be called once per operation and
+ * never when rehashing. */
+#define get_hash_value(p_ht, p_key) ( (p_ht)->fn_hash(p_key) )
+
+/* The number of keys ght_get_many() and ght_insert_many() prefetch
+ * for at a time */
+#define MANY_GROUP 16
+
+/* The largest keys a group is copied together for ght_hash_many() */
+#define MANY_KEY_SIZE 32
+
+
+/* --- Exported methods --- */
+/* Create a new hash table */
+ght_hash_table_t *ght_create(unsigned int i_size)
+{
+  return ght_create_ex(i_size, GHT_ENGINE_CHAINED);
+}
+
+/* Create a new hash table using a specific storage engine */
+ght_hash_table_t *ght_create_ex(unsigned int i_size, int i_engine)
+{
+  const ght_engine_t *p_engine;
+  ght_hash_table_t *p_ht;
+
+  switch (i_engine)
+    {
+    case GHT_ENGINE_CHAINED:
+      p_engine = NULL;
+      break;
+    case GHT_ENGINE_ROBIN_HOOD:
+      p_engine = &ght_robin_hood_engine;
+      break;
+    case GHT_ENGINE_SWISS:
+      p_engine = &ght_swiss_engine;
+      break;
+    case GHT_ENGINE_CUCKOO:
+      p_engine = &ght_cuckoo_engine;
+      break;
+    case GHT_ENGINE_BLOCK_CHAINED:
+      p_engine = &ght_block_chained_engine;
+      break;
+    case GHT_ENGINE_COMPACT:
+      p_engine = &ght_compact_engine;
+      break;
+    case GHT_ENGINE_SLIM:
+      p_engine = &ght_slim_engine;
+      break;
+    case GHT_ENGINE_SLIM_UNORDERED:
+      p_engine = &ght_slim_unordered_engine;
+      break;
+    default:
+      fprintf(stderr, "ght_create_ex: Unknown storage engine %d\n", i_engine);
+      return NULL;
+    }
+
+  if ( !(p_ht = (ght_hash_table_t*)malloc (sizeof(ght_hash_table_t))) )
+    {
+      perror("malloc");
+      return NULL;
+    }
+
+  p_ht->i_items = 0;
+
+  p_ht->fn_hash = ght_wy_hash;
+
+  /* Standard values for allocations */
+  p_ht->fn_alloc = malloc;
+  p_ht->fn_free = free;
+
+  /* Set flags */
+  p_ht->i_heuristics = GHT_HEURISTICS_NONE;
+  p_ht->i_automatic_rehash = FALSE;
+  p_ht->i_incremental_rehash = FALSE;
+
+  p_ht->bucket_limit = 0;
+  p_ht->fn_bucket_free = NULL;
+
+  p_ht->p_engine = p_engine;
+  p_ht->p_engine_data = NULL;
+  p_ht->allocator.fn_alloc = NULL;
+  p_ht->allocator.fn_free = NULL;
+  p_ht->allocator.fn_release = NULL;
+  p_ht->p_alloc_ctx = NULL;
+  p_ht->pp_entries = NULL;
+  p_ht->p_nr = NULL;
+
+  if (p_engine)
+    {
+      /* The engine sets up its own storage */
+      if (p_engine->fn_create(p_ht, i_size) < 0)
+	{
+	  free(p_ht);
+	  return NULL;
+	}
+    }
+  /* Create an empty bucket list. */
+  else if (alloc_buckets(i_size, &p_ht->pp_entries, &p_ht->p_nr,
+			 &p_ht->i_size, &p_ht->i_size_mask) < 0)
+    {
+      free(p_ht);
+      return NULL;
+    }
+
+  /* No incremental rehash in progress */
+  p_ht->pp_old_entries = NULL;
+  p_ht->p_old_nr = NULL;
+  p_ht->i_old_size = 0;
+  p_ht->i_old_size_mask = 0;
+  p_ht->i_migrate = 0;
+
+  p_ht->p_oldest = NULL;
+  p_ht->p_newest = NULL;
+  p_ht->i_generation = 0;
+
+  p_ht->p_stripes = NULL;
+  p_ht->i_stripes = 0;
+  p_ht->i_stripes_migrated = 0;
+  p_ht->i_lockfree_reads = FALSE;
+  p_ht->p_retired_buckets = NULL;
+
+  return p_ht;
+}
+
+/* Set the allocation/deallocation function to use */
+void ght_set_alloc(ght_hash_table_t *p_ht, ght_fn_alloc_t fn_alloc, ght_fn_free_t fn_free)
+{
+  p_ht->fn_alloc = fn_alloc;
+  p_ht->fn_free = fn_free;
+}
+
+/* Set the allocator with a context pointer */
+int ght_set_allocator(ght_hash_table_t *p_ht, const ght_allocator_t *p_allocator, void *p_ctx)
+{
+  if (ght_size(p_ht) != 0)
+    {
+      fprintf(stderr, "ght_set_allocator: The table must be empty\n");
+      return -1;
+    }
+
+  if (uses_pool(p_ht))
+    {
+      p_ht->allocator.fn_release(p_ht->p_alloc_ctx);
+    }
+
+  if (p_allocator)
+    {
+      p_ht->allocator = *p_allocator;
+      p_ht->p_alloc_ctx = p_ctx;
+    }
+  else
+    {
+      p_ht->allocator.fn_alloc = NULL;
+      p_ht->allocator.fn_free = NULL;
+      p_ht->allocator.fn_release = NULL;
+      p_ht->p_alloc_ctx = NULL;
+    }
+
+  return 0;
+}
+
+/* Use (or stop using) the pool allocator for the entries */
+int ght_set_pool(ght_hash_table_t *p_ht, int b_pool)
+{
+  int b_current = uses_pool(p_ht);
+  ght_pool_t *p_pool;
+
+  if (!b_pool == !b_current)
+    {
+      return 0;
+    }
+  if (!b_pool)
+    {
+      return ght_set_allocator(p_ht, NULL, NULL);
+    }
+
+  if (ght_size(p_ht) != 0)
+    {
+      fprintf(stderr, "ght_set_pool: The table must be empty\n");
+      return -1;
+    }
+  if (p_ht->p_stripes)
+    {
+      fprintf(stderr, "ght_set_pool: The pool cannot be used by concurrent tables\n");
+      return -1;
+    }
+  if ( !(p_pool = ght_pool_create()) )
+    {
+      return -1;
+    }
+
+  return ght_set_allocator(p_ht, &ght_pool_allocator, p_pool);
+}
+
+/* Set the hash function to use */
+void ght_set_hash(ght_hash_table_t *p_ht, ght_fn_hash_t fn_hash)
+{
+  p_ht->fn_hash = fn_hash;
+}
+
+/* Set the heuristics to use. */
+void ght_set_heuristics(ght_hash_table_t *p_ht, int i_heuristics)
+{
+  p_ht->i_heuristics = i_heuristics;
+}
+
+/* Set the rehashing status of the table. */
+void ght_set_rehash(ght_hash_table_t *p_ht, int b_rehash)
+{
+  p_ht->i_automatic_rehash = b_rehash;
+}
+
+/* Set incremental rehashing for the table. */
+void ght_set_incremental_rehash(ght_hash_table_t *p_ht, int b_incremental)
+{
+  p_ht->i_incremental_rehash = b_incremental;
+
+  /* Finish an ongoing incremental rehash when switching it off.
+   * Concurrent tables always rehash incrementally. */
+  if (!b_incremental && p_ht->pp_old_entries && !p_ht->p_stripes)
+    {
+      rehash_step(p_ht, p_ht->i_old_size);
+    }
+}
+
+void ght_set_bounded_buckets(ght_hash_table_t *p_ht, unsigned int limit, ght_fn_bucket_free_callback_t fn)
+{
+  p_ht->bucket_limit = limit;
+  p_ht->fn_bucket_free = fn;
+
+  if (limit > 0 && fn == NULL)
+    {
+      fprintf(stderr, "ght_set_bounded_buckets: The bucket callback function is NULL but the limit is %d\n", limit);
+    }
+}
+
+
+/* Make the table safe to use from several threads */
+int ght_set_concurrent(ght_hash_table_t *p_ht, unsigned int i_stripes)
+{
+  ght_stripe_t *p_stripes;
+  unsigned int i_real_stripes = 1;
+  unsigned int i;
+
+  if (p_ht->p_engine || p_ht->p_stripes)
+    {
+      fprintf(stderr, "ght_set_concurrent: Only chained tables can be made concurrent, once\n");
+      return -1;
+    }
+  if (p_ht->i_items != 0)
+    {
+      fprintf(stderr, "ght_set_concurrent: The table must be empty\n");
+      return -1;
+    }
+  if (uses_pool(p_ht))
+    {
+      fprintf(stderr, "ght_set_concurrent: The pool cannot be used by concurrent tables\n");
+      return -1;
+    }
+#if defined(GHT_NO_THREADS)
+  fprintf(stderr, "ght_set_concurrent: Threads are not supported on this platform\n");
+  return -1;
+#endif
+
+  while (i_real_stripes < i_stripes)
+    {
+      i_real_stripes <<= 1;
+    }
+  if ( !(p_stripes = (ght_stripe_t*)malloc(i_real_stripes * sizeof(ght_stripe_t))) )
+    {
+      perror("malloc");
+      return -1;
+    }
+  for (i = 0; i < i_real_stripes; i++)
+    {
+      if (rwlock_init(&p_stripes[i].lock) != 0)
+	{
+	  fprintf(stderr, "ght_set_concurrent: Could not create the locks\n");
+	  while (i-- > 0)
+	    {
+	      rwlock_destroy(&p_stripes[i].lock);
+	    }
+	  free(p_stripes);
+	  return -1;
+	}
+      p_stripes[i].i_items = 0;
+      p_stripes[i].i_migrate = 0;
+      p_stripes[i].i_seq = 0;
+      p_stripes[i].p_retired = NULL;
+      p_stripes[i].i_retired = 0;
+      p_stripes[i].p_waiting = NULL;
+      p_stripes[i].i_wait_epoch = 0;
+    }
+
+  /* Every stripe has at least one bucket */
+  if (p_ht->i_size < i_real_stripes || p_ht->pp_old_entries)
+    {
+      ght_rehash(p_ht, p_ht->i_size < i_real_stripes ? i_real_stripes : p_ht->i_size);
+    }
+  p_ht->p_stripes = p_stripes;
+  p_ht->i_stripes = i_real_stripes;
+  p_ht->i_stripes_migrated = 0;
+
+  return 0;
+}
+
+/* Let registered threads get entries without locking */
+int ght_set_lockfree_reads(ght_hash_table_t *p_ht, int b_lockfree)
+{
+  unsigned int i;
+
+  if (!p_ht->p_stripes)
+    {
+      fprintf(stderr, "ght_set_lockfree_reads: The table is not concurrent\n");
+      return -1;
+    }
+  if (!b_lockfree && p_ht->i_lockfree_reads)
+    {
+      /* No other thread uses the table, the entries can be freed now */
+      for (i = 0; i < p_ht->i_stripes; i++)
+	{
+	  free_retired(p_ht, p_ht->p_stripes[i].p_retired);
+	  free_retired(p_ht, p_ht->p_stripes[i].p_waiting);
+	  p_ht->p_stripes[i].p_retired = NULL;
+	  p_ht->p_stripes[i].p_waiting = NULL;
+	  p_ht->p_stripes[i].i_retired = 0;
+	}
+      free_retired_buckets(p_ht, TRUE);
+    }
+  p_ht->i_lockfree_reads = b_lockfree;
+
+  return 0;
+}
+
+/* Get the number of items in the hash table */
+unsigned int ght_size(ght_hash_table_t *p_ht)
+{
+  unsigned int i_items = 0;
+  unsigned int i;
+
+  if (!p_ht->p_stripes)
+    {
+      return p_ht->i_items;
+    }
+
+  /* The stripes are not locked, so the sum is only exact if no other
+   * thread changes the table */
+  for (i = 0; i < p_ht->i_stripes; i++)
+    {
+      i_items += atomic_get_uint(&p_ht->p_stripes[i].i_items);
+    }
+
+  return i_items;
+}
+
+/* Get the size of the hash table */
+unsigned int ght_table_size(ght_hash_table_t *p_ht)
+{
+  return atomic_get_uint(&p_ht->i_size);
+}
+
+/* Hash a key with the hash function of the table */
+ght_uint32_t ght_hash_key(ght_hash_table_t *p_ht,
+			  unsigned int i_key_size, const void *p_key_data)
+{
+  ght_hash_key_t key;
+
+  assert(p_ht);
+
+  hk_fill(&key, i_key_size, p_key_data);
+
+  return get_hash_value(p_ht, &key);
+}
+
+/* Insert an entry with a known hash value into the hash table, or
+ * find the entry already there (see fn_upsert in hash_engine.h) */
+static int upsert_entry(ght_hash_table_t *p_ht,
+			void *p_entry_data,
+			unsigned int i_key_size, const void *p_key_data,
+			ght_uint32_t l_hash, int b_replace, void **pp_data)
+{
+  ght_hash_entry_t *p_entry;
+  ght_uint32_t l_key;
+  ght_hash_key_t key;
+
+  hk_fill(&key, i_key_size, p_key_data);
+  l_key = get_bucket(p_ht, l_hash);
+  if ( (p_entry = search_in_bucket(p_ht, l_key, &key, l_hash, 0)) )
+    {
+      return upsert_found(&p_entry->p_data, p_entry_data, b_replace, pp_data);
+    }
+  if (!(p_entry = he_create(p_ht, p_entry_data,
+			    i_key_size, p_key_data, l_hash)))
+    {
+      return -2;
+    }
+
+  /* Rehash if the number of items inserted is too high. Concurrent
+   * tables do this in upsert_stripe(), without the lock. */
+  if (p_ht->i_automatic_rehash && !p_ht->p_stripes && p_ht->i_items > 2*p_ht->i_size)
+    {
+      if (!p_ht->i_incremental_rehash)
+	{
+	  ght_rehash(p_ht, 2*p_ht->i_size);
+	}
+      else if (!p_ht->pp_old_entries)
+	{
+	  /* The new entry is not in the old buckets, so it can go
+	   * straight into the new ones. */
+	  start_rehash(p_ht, 2*p_ht->i_size);
+	}
+      /* Recalculate l_key after the rehash has updated i_size_mask */
+      l_key = l_hash & p_ht->i_size_mask;
+    }
+
+  /* Place the entry first in the list. */
+  p_entry->p_next = p_ht->pp_entries[l_key];
+  p_entry->p_prev = NULL;
+  if (p_ht->pp_entries[l_key])
+    {
+      p_ht->pp_entries[l_key]->p_prev = p_entry;
+    }
+  atomic_set_ptr(&p_ht->pp_entries[l_key], p_entry);
+
+  /* If this is a limited bucket hash table, potentially remove the last item */
+  if (p_ht->bucket_limit != 0 &&
+      p_ht->p_nr[l_key] >= p_ht->bucket_limit)
+    {
+      ght_hash_entry_t *p;
+
+      /* Loop through entries until the last
+       *
+       * FIXME: Better with a pointer to the last entry
+       */
+      for (p = p_ht->pp_entries[l_key];
+	   p->p_next != NULL;
+	   p = p->p_next);
+
+      assert(p && p->p_next == NULL);
+
+      remove_from_chain(p_ht, l_key, p); /* To allow it to be reinserted in fn_bucket_free */
+      p_ht->fn_bucket_free(p->p_data, p->key.p_key);
+
+      entry_free(p_ht, p);
+    }
+  else
+    {
+      p_ht->p_nr[l_key]++;
+
+      assert( p_ht->pp_entries[l_key]?p_ht->pp_entries[l_key]->p_prev == NULL:1 );
+
+      count_items(p_ht, l_hash, 1);
+    }
+
+  if (!p_ht->p_stripes)
+    {
+      order_append(p_ht, p_entry);
+    }
+
+  return 0;
+}
+
+/* upsert_entry() for a concurrent table. The stripe of the key is
+ * locked, and a rehash is started when it has more than twice as many
+ * entries as it has buckets. */
+static int upsert_stripe(ght_hash_table_t *p_ht,
+			 void *p_entry_data,
+			 unsigned int i_key_size, const void *p_key_data,
+			 ght_uint32_t l_hash, int b_replace, void **pp_data)
+{
+  ght_stripe_t *p_stripe = STRIPE(p_ht, l_hash);
+  unsigned int i_size;
+  int b_grow;
+  int ret;
+
+  rwlock_wrlock(&p_stripe->lock);
+  ret = upsert_entry(p_ht, p_entry_data, i_key_size, p_key_data, l_hash,
+		     b_replace, pp_data);
+  i_size = p_ht->i_size;
+  b_grow = p_ht->i_automatic_rehash &&
+    p_stripe->i_items > 2 * (i_size / p_ht->i_stripes);
+  rwlock_wrunlock(&p_stripe->lock);
+
+  if (b_grow)
+    {
+      grow_stripes(p_ht, i_size);
+    }
+
+  return ret;
+}
+
+/* Insert an entry with a known hash value, or find the entry already
+ * there. Same return values as fn_upsert. */
+static inline int upsert_hashed(ght_hash_table_t *p_ht, void *p_entry_data,
+				ght_hash_key_t *p_key, ght_uint32_t l_hash,
+				int b_replace, void **pp_data)
+{
+  int ret;
+
+  if (p_ht->p_engine)
+    {
+      ret = p_ht->p_engine->fn_upsert(p_ht, p_entry_data, p_key, l_hash,
+				      b_replace, pp_data);
+    }
+  else if (p_ht->p_stripes)
+    {
+      ret = upsert_stripe(p_ht, p_entry_data, p_key->i_size, p_key->p_key, l_hash,
+			  b_replace, pp_data);
+    }
+  else
+    {
+      ret = upsert_entry(p_ht, p_entry_data, p_key->i_size, p_key->p_key, l_hash,
+			 b_replace, pp_data);
+    }
+  if (ret == 0)
+    {
+      entries_moved(p_ht);
+    }
+
+  return ret;
+}
+
+/* Insert an entry with a known hash value, same return values as ght_insert() */
+static inline int insert_hashed(ght_hash_table_t *p_ht, void *p_entry_data,
+				ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  void *p_old;
+  int ret = upsert_hashed(p_ht, p_entry_data, p_key, l_hash, FALSE, &p_old);
+
+  return ret > 0 ? -1 : ret;
+}
+
+/* Insert an entry into the hash table */
+int ght_insert(ght_hash_table_t *p_ht,
+	       void *p_entry_data,
+	       unsigned int i_key_size, const void *p_key_data)
+{
+  ght_hash_key_t key;
+
+  assert(p_ht);
+
+  hk_fill(&key, i_key_size, p_key_data);
+
+  return insert_hashed(p_ht, p_entry_data, &key, get_hash_value(p_ht, &key));
+}
+
+/* Insert an entry with a hash value from ght_hash_key() */
+int ght_insert_hashed(ght_hash_table_t *p_ht,
+		      void *p_entry_data,
+		      unsigned int i_key_size, const void *p_key_data,
+		      ght_uint32_t l_hash)
+{
+  ght_hash_key_t key;
+
+  assert(p_ht);
+
+  hk_fill(&key, i_key_size, p_key_data);
+
+  return insert_hashed(p_ht, p_entry_data, &key, l_hash);
+}
+
+/* Get the data of a key, or insert it with p_entry_data */
+void *ght_get_or_insert(ght_hash_table_t *p_ht,
+			void *p_entry_data,
+			unsigned int i_key_size, const void *p_key_data)
+{
+  ght_hash_key_t key;
+  void *p_old;
+  int ret;
+
+  assert(p_ht);
+
+  hk_fill(&key, i_key_size, p_key_data);
+
+  ret = upsert_hashed(p_ht, p_entry_data, &key, get_hash_value(p_ht, &key),
+		      FALSE, &p_old);
+  if (ret < 0)
+    {
+      return NULL;
+    }
+
+  return ret > 0 ? p_old : p_entry_data;
+}
+
+/* Insert an entry, or replace the data of the key if it is present */
+int ght_upsert(ght_hash_table_t *p_ht,
+	       void *p_entry_data,
+	       unsigned int i_key_size, const void *p_key_data,
+	       void **pp_old)
+{
+  ght_hash_key_t key;
+  void *p_old = NULL;
+  int ret;
+
+  assert(p_ht);
+
+  hk_fill(&key, i_key_size, p_key_data);
+
+  ret = upsert_hashed(p_ht, p_entry_data, &key, get_hash_value(p_ht, &key),
+		      TRUE, &p_old);
+  if (pp_old)
+    {
+      *pp_old = p_old;
+    }
+
+  return ret;
+}
+
+/* Get the data of a key in a concurrent table, with the stripe locked
+ * for reading. The entries are not moved, so if the stripe is being
+ * rehashed the old bucket is searched as well. */
+static void *get_stripe(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  ght_stripe_t *p_stripe = STRIPE(p_ht, l_hash);
+  ght_hash_entry_t *p_e;
+  void *p_ret;
+
+  rwlock_rdlock(&p_stripe->lock);
+  p_e = search_chain(p_ht->pp_entries[l_hash & p_ht->i_size_mask], p_key, l_hash);
+  if (!p_e && stripe_migrating(p_ht, l_hash))
+    {
+      p_e = search_chain(p_ht->pp_old_entries[l_hash & p_ht->i_old_size_mask], p_key, l_hash);
+    }
+  p_ret = p_e?p_e->p_data:NULL;
+  rwlock_rdunlock(&p_stripe->lock);
+
+  return p_ret;
+}
+
+/*
+ * Get the data of a key in a table with lock-free reads, without
+ * taking any lock or writing anything. The writers of the stripe may
+ * change its chains at the same time:
+ *
+ * - New entries are complete before they are linked in, and removed
+ *   entries keep their p_next until they are freed, which is not done
+ *   before the calling thread has called ght_quiescent().
+ * - Moving entries to other chains (by a rehash or the heuristics)
+ *   could make the search miss an entry, so it is done with the seq of
+ *   the stripe odd. Like with a seqlock, the search starts over if the
+ *   seq was odd or has changed when the bucket arrays have been read,
+ *   and when the key has not been found.
+ *
+ * The writer keeps the seq odd for as long as it has the stripe locked,
+ * which may be a while if it is rehashing, so after GET_RETRIES tries
+ * the search is done with the stripe locked for reading instead.
+ */
+#define GET_RETRIES 64
+static void *get_lockfree(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  ght_stripe_t *p_stripe = STRIPE(p_ht, l_hash);
+  ght_hash_entry_t **pp_entries;
+  ght_hash_entry_t **pp_old_entries;
+  ght_hash_entry_t *p_e;
+  unsigned int i_seq;
+  int i_size_mask;
+  int i_old_size_mask = 0;
+  int i_tries;
+
+  for (i_tries = 0; i_tries < GET_RETRIES; i_tries++)
+    {
+      if ( (i_seq = atomic_get_uint(&p_stripe->i_seq)) & 1 )
+	{
+	  cpu_relax();
+	  continue;
+	}
+      pp_entries = atomic_get_ptr(&p_ht->pp_entries);
+      i_size_mask = atomic_get_uint(&p_ht->i_size_mask);
+      pp_old_entries = NULL;
+      if (atomic_get_uint(&p_stripe->i_migrate) < atomic_get_uint(&p_ht->i_old_size))
+	{
+	  pp_old_entries = atomic_get_ptr(&p_ht->pp_old_entries);
+	  i_old_size_mask = atomic_get_uint(&p_ht->i_old_size_mask);
+	}
+      fence_acquire();
+      if (atomic_get_uint(&p_stripe->i_seq) != i_seq)
+	{
+	  cpu_relax();
+	  continue;
+	}
+
+      p_e = search_chain(atomic_get_ptr(&pp_entries[l_hash & i_size_mask]), p_key, l_hash);
+      if (!p_e && pp_old_entries)
+	{
+	  p_e = search_chain(atomic_get_ptr(&pp_old_entries[l_hash & i_old_size_mask]),
+			     p_key, l_hash);
+	}
+      if (p_e)
+	{
+	  return atomic_get_ptr(&p_e->p_data);
+	}
+      fence_acquire();
+      if (atomic_get_uint(&p_stripe->i_seq) == i_seq)
+	{
+	  return NULL;
+	}
+    }
+
+  return get_stripe(p_ht, p_key, l_hash);
+}
+
+/* Get the data of a key with a known hash value, or NULL */
+static inline void *get_hashed(ght_hash_table_t *p_ht, ght_hash_key_t *p_key, ght_uint32_t l_hash)
+{
+  ght_hash_entry_t *p_e;
+  ght_uint32_t l_key;
+  void *p_ret;
+
+  if (p_ht->p_engine)
+    {
+      /* The heuristics of the engines may move the entry within its
+       * chain, ght_handle_t has to know */
+      if (p_ht->i_heuristics != GHT_HEURISTICS_NONE)
+	{
+	  entries_moved(p_ht);
+	}
+      return p_ht->p_engine->fn_get(p_ht, p_key, l_hash);
+    }
+  if (p_ht->p_stripes && p_ht->i_heuristics == GHT_HEURISTICS_NONE)
+    {
+      if (p_ht->i_lockfree_reads && ght_epoch_reader())
+	{
+	  return get_lockfree(p_ht, p_key, l_hash);
+	}
+      return get_stripe(p_ht, p_key, l_hash);
+    }
+  /* The heuristics change the chain, so they lock for writing */
+  lock_bucket(p_ht, l_hash);
+  l_key = get_bucket(p_ht, l_hash);
+
+  /* Check that the first element in the list really is the first. */
+  assert( p_ht->pp_entries[l_key]?p_ht->pp_entries[l_key]->p_prev == NULL:1 );
+
+  p_e = search_in_bucket(p_ht, l_key, p_key, l_hash, p_ht->i_heuristics);
+  p_ret = p_e?p_e->p_data:NULL;
+  unlock_bucket(p_ht, l_hash);
+
+  return p_ret;
+}
+
+/* Get an entry from the hash table. The entry is returned, or NULL if it wasn't found */
+void *ght_get(ght_hash_table_t *p_ht,
+	      unsigned int i_key_size, const void *p_key_data)
+{
+  ght_hash_key_t key;
+
+  assert(p_ht);
+
+  hk_fill(&key, i_key_size, p_key_data);
+
+  return get_hashed(p_ht, &key, get_hash_value(p_ht, &key));
+}
+
+/* Get an entry with a hash value from ght_hash_key() */
+void *ght_get_hashed(ght_hash_table_t *p_ht,
+		     unsigned int i_key_size, const void *p_key_data,
+		     ght_uint32_t l_hash)
+{
+  ght_hash_key_t key;
+
+  assert(p_ht);
+
+  hk_fill(&key, i_key_size, p_key_data);
+
+  return get_hashed(p_ht, &key, l_hash);
+}
+
+/* Prefetch the memory a lookup of l_hash starts with, see fn_prefetch */
+static inline void prefetch_bucket(ght_hash_table_t *p_ht, ght_uint32_t l_hash, int i_stage)
+{
+  if (p_ht->p_engine)
+    {
+      if (p_ht->p_engine->fn_prefetch)
+	{
+	  p_ht->p_engine->fn_prefetch(p_ht, l_hash, i_stage);
+	}
+    }
+  else if (p_ht->p_stripes)
+    {
+      /* Another thread may swap the buckets at any time */
+    }
+  else if (i_stage == 0)
+    {
+      PREFETCH(&p_ht->pp_entries[l_hash & p_ht->i_size_mask]);
+    }
+  else
+    {
+      PREFETCH(p_ht->pp_entries[l_hash & p_ht->i_size_mask]);
+    }
+}
+
+/*
+ * Hash the i_group keys of a group. If they all have the same size,
+ * they are hashed with one call to ght_hash_many(), which hashes 8
+ * keys at a time with AVX-512 for the default hash function. The keys
+ * are copied together first unless they are back to back already.
+ */
+static void hash_group(ght_hash_table_t *p_ht, unsigned int i_group,
+		       ght_hash_key_t *p_keys, ght_uint32_t *p_hashes)
+{
+  unsigned char buf[MANY_GROUP * MANY_KEY_SIZE];
+  const unsigned char *p_first = (const unsigned char*)p_keys[0].p_key;
+  unsigned int i_size = p_keys[0].i_size;
+  int b_together = TRUE;
+  unsigned int j;
+
+  for (j = 1; j < i_group; j++)
+    {
+      if (p_keys[j].i_size != i_size)
+	{
+	  break;
+	}
+      if ((const unsigned char*)p_keys[j].p_key != p_first + j * i_size)
+	{
+	  b_together = FALSE;
+	}
+    }
+
+  if (j < i_group || i_size == 0 || (!b_together && i_size > MANY_KEY_SIZE))
+    {
+      for (j = 0; j < i_group; j++)
+	{
+	  p_hashes[j] = get_hash_value(p_ht, &p_keys[j]);
+	}
+      return;
+    }
+  if (!b_together)
+    {
+      for (j = 0; j < i_group; j++)
+	{
+	  memcpy(buf + j * i_size, p_keys[j].p_key, i_size);
+	}
+      p_first = buf;
+    }
+  ght_hash_many(p_ht->fn_hash, i_group, i_size, p_first, p_hashes);
+}
+
+/*
+ * Look up many keys. The keys are handled in groups of MANY_GROUP:
+ * All keys of a group are hashed (unless p_hashes has their hash
+ * values already) and their buckets prefetched, then the first
+ * entries of the buckets are prefetched, and then the keys are looked
+ * up. The cache misses of a group thus overlap instead of being taken
+ * one after the other.
+ */
+static unsigned int get_many(ght_hash_table_t *p_ht, unsigned int n,
+			     const unsigned int *p_key_sizes, const void *const *pp_keys,
+			     const ght_uint32_t *p_hashes, void **pp_results)
+{
+  ght_hash_key_t keys[MANY_GROUP];
+  ght_uint32_t hashes[MANY_GROUP];
+  unsigned int i_found = 0;
+  unsigned int i, j;
+
+  for (i = 0; i < n; i += MANY_GROUP)
+    {
+      unsigned int i_group = n - i < MANY_GROUP ? n - i : MANY_GROUP;
+      const ght_uint32_t *p_group = p_hashes ? p_hashes + i : hashes;
+
+      for (j = 0; j < i_group; j++)
+	{
+	  hk_fill(&keys[j], p_key_sizes[i + j], pp_keys[i + j]);
+	}
+      if (!p_hashes)
+	{
+	  hash_group(p_ht, i_group, keys, hashes);
+	}
+      for (j = 0; j < i_group; j++)
+	{
+	  prefetch_bucket(p_ht, p_group[j], 0);
+	}
+      for (j = 0; j < i_group; j++)
+	{
+	  prefetch_bucket(p_ht, p_group[j], 1);
+	}
+      for (j = 0; j < i_group; j++)
+	{
+	  if ( (pp_results[i + j] = get_hashed(p_ht, &keys[j], p_group[j])) )
+	    {
+	      i_found++;
+	    }
+	}
+    }
+
+  return i_found;
+}
+
+/* Look up many keys */
+unsigned int ght_get_many(ght_hash_table_t *p_ht, unsigned int n,
+			  const unsigned int *p_key_sizes, const void *const *pp_keys,
+			  void **pp_results)
+{
+  assert(p_ht);
+
+  return get_many(p_ht, n, p_key_sizes, pp_keys, NULL, pp_results);
+}
+
+/* Look up many keys with hash values from ght_hash_many() */
+unsigned int ght_get_many_hashed(ght_hash_table_t *p_ht, unsigned int n,
+				 const unsigned int *p_key_sizes, const void *const *pp_keys,
+				 const ght_uint32_t *p_hashes, void **pp_results)
+{
+  assert(p_ht && (p_hashes || n == 0));
+
+  return get_many(p_ht, n, p_key_sizes, pp_keys, p_hashes, pp_results);
+}
+
+/* Grow the table once so that i_items entries fit, see fn_reserve */
+static void reserve(ght_hash_table_t *p_ht, unsigned int i_items)
+{
+  entries_moved(p_ht);
+  if (p_ht->p_engine)
+    {
+      if (p_ht->p_engine->fn_reserve)
+	{
+	  p_ht->p_engine->fn_reserve(p_ht, i_items);
+	}
+    }
+  else if (p_ht->i_automatic_rehash && i_items > 2*ght_table_size(p_ht))
+    {
+      ght_rehash(p_ht, i_items / 2);
+    }
+}
+
+/*
+ * Insert many entries. The table is first grown to fit all of them
+ * (assuming that none are duplicates), and the keys are then handled
+ * in groups of MANY_GROUP like in get_many(), so that the duplicate
+ * checks of a group overlap their cache misses.
+ */
+static unsigned int insert_many(ght_hash_table_t *p_ht, unsigned int n,
+				void *const *pp_entry_data,
+				const unsigned int *p_key_sizes, const void *const *pp_keys,
+				const ght_uint32_t *p_hashes, int *p_results)
+{
+  ght_hash_key_t keys[MANY_GROUP];
+  ght_uint32_t hashes[MANY_GROUP];
+  unsigned int i_inserted = 0;
+  unsigned int i_items;
+  unsigned int i, j;
+
+  i_items = ght_size(p_ht);
+  reserve(p_ht, n < ~0u - i_items ? i_items + n : ~0u);
+
+  for (i = 0; i < n; i += MANY_GROUP)
+    {
+      unsigned int i_group = n - i < MANY_GROUP ? n - i : MANY_GROUP;
+      const ght_uint32_t *p_group = p_hashes ? p_hashes + i : hashes;
+
+      for (j = 0; j < i_group; j++)
+	{
+	  hk_fill(&keys[j], p_key_sizes[i + j], pp_keys[i + j]);
+	}
+      if (!p_hashes)
+	{
+	  hash_group(p_ht, i_group, keys, hashes);
+	}
+      for (j = 0; j < i_group; j++)
+	{
+	  prefetch_bucket(p_ht, p_group[j], 0);
+	}
+      for (j = 0; j < i_group; j++)
+	{
+	  prefetch_bucket(p_ht, p_group[j], 1);
+	}
+      for (j = 0; j < i_group; j++)
+	{
+	  int ret = insert_hashed(p_ht, pp_entry_data[i + j], &keys[j], p_group[j]);
+
+	  if (p_results)
+	    {
+	      p_results[i + j] = ret;
+	    }
+	  if (ret == 0)
+	    {
+	      i_inserted++;
+	    }
+	}
+    }
+
+  return i_inserted;
+}
+
+/* Insert many entries */
+unsigned int ght_insert_many(ght_hash_table_t *p_ht, unsigned int n,
+			     void *const *pp_entry_data,
+			     const unsigned int *p_key_sizes, const void *const *pp_keys,
+			     int *p_results)
+{
+  assert(p_ht);
+
+  return insert_many(p_ht, n, pp_entry_data, p_key_sizes, pp_keys, NULL, p_results);
+}
+
+/* Insert many entries with hash values from ght_hash_many() */
+unsigned int ght_insert_many_hashed(ght_hash_table_t *p_ht, unsigned int n,
+				    void *const *pp_entry_data,
+				    const unsigned int *p_key_sizes, const void *const *pp_keys,
+				    const ght_uint32_t *p_hashes, int *p_results)
+{
+  assert(p_ht && (p_hashes || n == 0));
+
+  return insert_many(p_ht, n, pp_entry_data, p_key_sizes, pp_keys, p_hashes, p_results);
+}
+
+/*
+ * The parallel insert of ght_insert_many_parallel(). Every thread
+ * owns a range of the entries and a range of the buckets (its
+ * partition), and the insert is done in phases with all threads:
+ *
+ * BUILD_HASH:      Hash the keys of the entries, and count how many go
+ *                  to each partition.
+ * BUILD_PARTITION: Place the indices of the entries in p_order,
+ *                  grouped by partition (a radix partition). Within a
+ *                  partition the indices are in increasing order.
+ * BUILD_INSERT:    Insert the entries of the partition, so every thread
+ *                  only writes to its own buckets.
+ * BUILD_LINK:      Link the inserted entries of the range in insertion
+ *                  order. The ranges are then linked by the calling
+ *                  thread.
+ */
+#define BUILD_HASH      0
+#define BUILD_PARTITION 1
+#define BUILD_INSERT    2
+#define BUILD_LINK      3
+
+typedef struct
+{
+  ght_hash_table_t *p_ht;
+  unsigned int n;
+  void *const *pp_entry_data;
+  const unsigned int *p_key_sizes;
+  const void *const *pp_keys;
+  int *p_results;
+
+  unsigned int i_threads;
+  int i_phase;
+  ght_uint32_t *p_hashes;        /* The hash value of every entry */
+  unsigned int *p_order;         /* The entries grouped by partition */
+  unsigned int *p_counts;        /* [range * i_threads + partition] */
+  unsigned int *p_partitions;    /* Where each partition starts in p_order */
+  ght_hash_entry_t **pp_new;     /* The inserted entries, or NULL */
+} build_t;
+
+typedef struct
+{
+  build_t *p_build;
+  unsigned int i_thread;
+  unsigned int i_inserted;
+  ght_hash_entry_t *p_first;     /* The first and last inserted entry of the range */
+  ght_hash_entry_t *p_last;
+} build_thread_t;
+
+/* Don't start threads for less than this many entries each */
+#define BUILD_MIN_ENTRIES 4096
+
+/* The partition of a hash value */
+static inline unsigned int build_partition(build_t *p_build, ght_uint32_t l_hash)
+{
+  ght_hash_table_t *p_ht = p_build->p_ht;
+
+  return (unsigned int)(((unsigned long long)(l_hash & p_ht->i_size_mask) * p_build->i_threads) /
+			p_ht->i_size);
+}
+
+static void build_insert(build_thread_t *p_thread)
+{
+  build_t *p_build = p_thread->p_build;
+  ght_hash_table_t *p_ht = p_build->p_ht;
+  unsigned int i_end = p_build->p_partitions[p_thread->i_thread + 1];
+  unsigned int k;
+
+  for (k = p_build->p_partitions[p_thread->i_thread]; k < i_end; k++)
+    {
+      unsigned int i = p_build->p_order[k];
+      ght_uint32_t l_hash = p_build->p_hashes[i];
+      ght_uint32_t l_key = l_hash & p_ht->i_size_mask;
+      ght_hash_entry_t *p_e;
+      ght_hash_key_t key;
+      int ret = 0;
+
+      if (k + 8 < i_end)
+	{
+	  PREFETCH(&p_ht->pp_entries[p_build->p_hashes[p_build->p_order[k + 8]] & p_ht->i_size_mask]);
+	}
+      hk_fill(&key, p_build->p_key_sizes[i], p_build->pp_keys[i]);
+      if (search_chain(p_ht->pp_entries[l_key], &key, l_hash))
+	{
+	  p_e = NULL;
+	  ret = -1;
+	}
+      else if ( !(p_e = he_create(p_ht, p_build->pp_entry_data[i],
+				  key.i_size, key.p_key, l_hash)) )
+	{
+	  ret = -2;
+	}
+      else
+	{
+	  /* Place the entry first in the list, like upsert_entry() */
+	  p_e->p_next = p_ht->pp_entries[l_key];
+	  if (p_ht->pp_entries[l_key])
+	    {
+	      p_ht->pp_entries[l_key]->p_prev = p_e;
+	    }
+	  p_ht->pp_entries[l_key] = p_e;
+	  p_ht->p_nr[l_key]++;
+	  p_thread->i_inserted++;
+	}
+      p_build->pp_new[i] = p_e;
+      if (p_build->p_results)
+	{
+	  p_build->p_results[i] = ret;
+	}
+    }
+}
+
+static THREAD_FN(build_worker, p_arg)
+{
+  build_thread_t *p_thread = (build_thread_t*)p_arg;
+  build_t *p_build = p_thread->p_build;
+  unsigned int *p_counts = &p_build->p_counts[p_thread->i_thread * p_build->i_threads];
+  unsigned int i_per_thread = p_build->n / p_build->i_threads;
+  unsigned int i_first = p_thread->i_thread * i_per_thread;
+  unsigned int i_last = p_thread->i_thread + 1 < p_build->i_threads ?
+    i_first + i_per_thread : p_build->n;
+  unsigned int i;
+
+  switch (p_build->i_phase)
+    {
+    case BUILD_HASH:
+      for (i = i_first; i < i_last; i += MANY_GROUP)
+	{
+	  ght_hash_key_t keys[MANY_GROUP];
+	  unsigned int i_group = i_last - i < MANY_GROUP ? i_last - i : MANY_GROUP;
+	  unsigned int j;
+
+	  for (j = 0; j < i_group; j++)
+	    {
+	      hk_fill(&keys[j], p_build->p_key_sizes[i + j], p_build->pp_keys[i + j]);
+	    }
+	  hash_group(p_build->p_ht, i_group, keys, p_build->p_hashes + i);
+	  for (j = 0; j < i_group; j++)
+	    {
+	      p_counts[build_partition(p_build, p_build->p_hashes[i + j])]++;
+	    }
+	}
+      break;
+    case BUILD_PARTITION:
+      /* p_counts is where the next entry of each partition goes now */
+      for (i = i_first; i < i_last; i++)
+	{
+	  p_build->p_order[p_counts[build_partition(p_build, p_build->p_hashes[i])]++] = i;
+	}
+      break;
+    case BUILD_INSERT:
+      build_insert(p_thread);
+      break;
+    case BUILD_LINK:
+      p_thread->p_first = p_thread->p_last = NULL;
+      for (i = i_first; i < i_last; i++)
+	{
+	  ght_hash_entry_t *p_e = p_build->pp_new[i];
+
+	  if (!p_e)
+	    {
+	      continue;
+	    }
+	  p_e->p_older = p_thread->p_last;
+	  if (p_thread->p_last)
+	    {
+	      p_thread->p_last->p_newer = p_e;
+	    }
+	  else
+	    {
+	      p_thread->p_first = p_e;
+	    }
+	  p_thread->p_last = p_e;
+	}
+      break;
+    }
+
+  return THREAD_RETURN;
 }
 
-/* Insert an entry into the hash table */
-int ght_insert(ght_hash_table_t *p_ht,
-	       void *p_entry_data,
-	       unsigned int i_key_size, const void *p_key_data)
+/*
+ * Insert many entries with several threads, see build_worker(). Tables
+ * where the threads would have to share anything other than the
+ * allocator are done by ght_insert_many().
+ */
+unsigned int ght_insert_many_parallel(ght_hash_table_t *p_ht, unsigned int n,
+				      void *const *pp_entry_data,
+				      const unsigned int *p_key_sizes, const void *const *pp_keys,
+				      int *p_results, unsigned int i_threads)
 {
-  ght_hash_entry_t *p_entry;
-  ght_uint32_t l_key;
-  ght_hash_key_t key;
+  build_thread_t *p_threads;
+  build_t build;
+  size_t i_max = (size_t)-1 / sizeof(unsigned int);
+  size_t i_counts;
+  unsigned int i_inserted = 0;
+  unsigned int i_items;
+  unsigned int i, pos;
 
   assert(p_ht);
 
-  hk_fill(&key, i_key_size, p_key_data);
-  l_key = get_hash_value(p_ht, &key) & p_ht->i_size_mask;
-  if (search_in_bucket(p_ht, l_key, &key, 0))
+  if (i_threads > n / BUILD_MIN_ENTRIES)
     {
-      /* Don't insert if the key is already present. */
-      return -1;
+      i_threads = n / BUILD_MIN_ENTRIES;
     }
-  if (!(p_entry = he_create(p_ht, p_entry_data,
-			    i_key_size, p_key_data)))
+  if (i_threads <= 1 || p_ht->p_engine || p_ht->p_stripes || p_ht->bucket_limit != 0 ||
+      uses_pool(p_ht))
     {
-      return -2;
+      return ght_insert_many(p_ht, n, pp_entry_data, p_key_sizes, pp_keys, p_results);
     }
 
-  /* Rehash if the number of items inserted is too high. */
-  if (p_ht->i_automatic_rehash && p_ht->i_items > 2*p_ht->i_size)
+  /* The arrays are allocated in one go, the pointers first. Their size
+   * may not fit in a size_t on 32-bit platforms. */
+  if (i_threads > (i_max - 1) / (i_threads + 1))
     {
-      ght_rehash(p_ht, 2*p_ht->i_size);
-      /* Recalculate l_key after ght_rehash has updated i_size_mask */
-      l_key = get_hash_value(p_ht, &key) & p_ht->i_size_mask;
+      fprintf(stderr, "ght_insert_many_parallel: Too many threads\n");
+      return (unsigned int)-1;
     }
-
-  /* Place the entry first in the list. */
-  p_entry->p_next = p_ht->pp_entries[l_key];
-  p_entry->p_prev = NULL;
-  if (p_ht->pp_entries[l_key])
+  i_counts = ((size_t)i_threads * (i_threads + 1) + 1) * sizeof(unsigned int);
+  if (n > ((size_t)-1 - i_counts) / (sizeof(ght_hash_entry_t*) + 2 * sizeof(unsigned int)))
     {
-      p_ht->pp_entries[l_key]->p_prev = p_entry;
+      fprintf(stderr, "ght_insert_many_parallel: Too many entries\n");
+      return (unsigned int)-1;
     }
-  p_ht->pp_entries[l_key] = p_entry;
-
-  /* If this is a limited bucket hash table, potentially remove the last item */
-  if (p_ht->bucket_limit != 0 &&
-      p_ht->p_nr[l_key] >= p_ht->bucket_limit)
+  if ( !(build.pp_new = (ght_hash_entry_t**)malloc(n * (sizeof(ght_hash_entry_t*) + 2 * sizeof(unsigned int)) +
+						   i_counts)) )
     {
-      ght_hash_entry_t *p;
-
-      /* Loop through entries until the last
-       *
-       * FIXME: Better with a pointer to the last entry
-       */
-      for (p = p_ht->pp_entries[l_key];
-	   p->p_next != NULL;
-	   p = p->p_next);
-
-      assert(p && p->p_next == NULL);
-
-      remove_from_chain(p_ht, l_key, p); /* To allow it to be reinserted in fn_bucket_free */
-      p_ht->fn_bucket_free(p->p_data, p->key.p_key);
-
-      he_finalize(p_ht, p);
+      perror("malloc");
+      return ght_insert_many(p_ht, n, pp_entry_data, p_key_sizes, pp_keys, p_results);
     }
-  else
+  if ( !(p_threads = (build_thread_t*)malloc(i_threads * sizeof(build_thread_t))) )
     {
-      p_ht->p_nr[l_key]++;
-
-      assert( p_ht->pp_entries[l_key]?p_ht->pp_entries[l_key]->p_prev == NULL:1 );
+      perror("malloc");
+      free(build.pp_new);
+      return ght_insert_many(p_ht, n, pp_entry_data, p_key_sizes, pp_keys, p_results);
+    }
+  build.p_hashes = (ght_uint32_t*)(build.pp_new + n);
+  build.p_order = (unsigned int*)(build.p_hashes + n);
+  build.p_counts = build.p_order + n;
+  build.p_partitions = build.p_counts + i_threads * i_threads;
+  memset(build.p_counts, 0, i_threads * i_threads * sizeof(unsigned int));
+
+  build.p_ht = p_ht;
+  build.n = n;
+  build.pp_entry_data = pp_entry_data;
+  build.p_key_sizes = p_key_sizes;
+  build.pp_keys = pp_keys;
+  build.p_results = p_results;
+  build.i_threads = i_threads;
+  for (i = 0; i < i_threads; i++)
+    {
+      p_threads[i].p_build = &build;
+      p_threads[i].i_thread = i;
+      p_threads[i].i_inserted = 0;
+    }
 
-      p_ht->i_items++;
+  /* Grow the table first, like ght_insert_many(), and finish an
+   * incremental rehash so that there is only one bucket array */
+  i_items = ght_size(p_ht);
+  reserve(p_ht, n < ~0u - i_items ? i_items + n : ~0u);
+  if (p_ht->pp_old_entries)
+    {
+      rehash_step(p_ht, p_ht->i_old_size);
     }
 
-  if (p_ht->p_oldest == NULL)
+  build.i_phase = BUILD_HASH;
+  run_parallel(build_worker, p_threads, sizeof(build_thread_t), i_threads);
+
+  /* Turn the counts into the positions in p_order, partition by
+   * partition and range by range within a partition */
+  for (pos = 0, i = 0; i < i_threads * i_threads; i++)
     {
-      p_ht->p_oldest = p_entry;
+      unsigned int i_range = i % i_threads;
+      unsigned int i_partition = i / i_threads;
+      unsigned int *p_count = &build.p_counts[i_range * i_threads + i_partition];
+      unsigned int i_count = *p_count;
+
+      if (i_range == 0)
+	{
+	  build.p_partitions[i_partition] = pos;
+	}
+      *p_count = pos;
+      pos += i_count;
     }
-  p_entry->p_older = p_ht->p_newest;
+  build.p_partitions[i_threads] = n;
+
+  build.i_phase = BUILD_PARTITION;
+  run_parallel(build_worker, p_threads, sizeof(build_thread_t), i_threads);
+  build.i_phase = BUILD_INSERT;
+  run_parallel(build_worker, p_threads, sizeof(build_thread_t), i_threads);
+  build.i_phase = BUILD_LINK;
+  run_parallel(build_worker, p_threads, sizeof(build_thread_t), i_threads);
 
-  if (p_ht->p_newest != NULL)
+  /* Append the ranges to the insertion order list */
+  for (i = 0; i < i_threads; i++)
     {
-      p_ht->p_newest->p_newer = p_entry;
+      i_inserted += p_threads[i].i_inserted;
+      if (!p_threads[i].p_first)
+	{
+	  continue;
+	}
+      p_threads[i].p_first->p_older = p_ht->p_newest;
+      if (p_ht->p_newest)
+	{
+	  p_ht->p_newest->p_newer = p_threads[i].p_first;
+	}
+      else
+	{
+	  p_ht->p_oldest = p_threads[i].p_first;
+	}
+      p_ht->p_newest = p_threads[i].p_last;
     }
+  p_ht->i_items += i_inserted;
+  entries_moved(p_ht);
 
-  p_ht->p_newest = p_entry;
+  free(p_threads);
+  free(build.pp_new);
 
-  return 0;
+  return i_inserted;
 }
 
-/* Get an entry from the hash table. The entry is returned, or NULL if it wasn't found */
-void *ght_get(ght_hash_table_t *p_ht,
-	      unsigned int i_key_size, const void *p_key_data)
+/* Replace an entry from the hash table. The entry is returned, or NULL if it wasn't found */
+void *ght_replace(ght_hash_table_t *p_ht,
+		  void *p_entry_data,
+		  unsigned int i_key_size, const void *p_key_data)
 {
-  ght_hash_entry_t *p_e;
   ght_hash_key_t key;
-  ght_uint32_t l_key;
 
   assert(p_ht);
 
   hk_fill(&key, i_key_size, p_key_data);
 
-  l_key = get_hash_value(p_ht, &key) & p_ht->i_size_mask;
-
-  /* Check that the first element in the list really is the first. */
-  assert( p_ht->pp_entries[l_key]?p_ht->pp_entries[l_key]->p_prev == NULL:1 );
-
-  /* LOCK: p_ht->pp_entries[l_key] */
-  p_e = search_in_bucket(p_ht, l_key, &key, p_ht->i_heuristics);
-  /* UNLOCK: p_ht->pp_entries[l_key] */
-
-  return (p_e?p_e->p_data:NULL);
+  return ght_replace_hashed(p_ht, p_entry_data, i_key_size, p_key_data,
+			    get_hash_value(p_ht, &key));
 }
 
-/* Replace an entry from the hash table. The entry is returned, or NULL if it wasn't found */
-void *ght_replace(ght_hash_table_t *p_ht,
-		  void *p_entry_data,
-		  unsigned int i_key_size, const void *p_key_data)
+/* Replace an entry with a hash value from ght_hash_key() */
+void *ght_replace_hashed(ght_hash_table_t *p_ht,
+			 void *p_entry_data,
+			 unsigned int i_key_size, const void *p_key_data,
+			 ght_uint32_t l_hash)
 {
   ght_hash_entry_t *p_e;
   ght_hash_key_t key;
@@ -530,20 +2201,23 @@ void *ght_replace(ght_hash_table_t *p_ht,
 
   hk_fill(&key, i_key_size, p_key_data);
 
-  l_key = get_hash_value(p_ht, &key) & p_ht->i_size_mask;
+  if (p_ht->p_engine)
+    {
+      return p_ht->p_engine->fn_replace(p_ht, p_entry_data, &key, l_hash);
+    }
+  lock_bucket(p_ht, l_hash);
+  l_key = get_bucket(p_ht, l_hash);
 
   /* Check that the first element in the list really is the first. */
   assert( p_ht->pp_entries[l_key]?p_ht->pp_entries[l_key]->p_prev == NULL:1 );
 
-  /* LOCK: p_ht->pp_entries[l_key] */
-  p_e = search_in_bucket(p_ht, l_key, &key, p_ht->i_heuristics);
-  /* UNLOCK: p_ht->pp_entries[l_key] */
-
-  if ( !p_e )
-    return NULL;
-
-  p_old = p_e->p_data;
-  p_e->p_data = p_entry_data;
+  p_old = NULL;
+  if ( (p_e = search_in_bucket(p_ht, l_key, &key, l_hash, p_ht->i_heuristics)) )
+    {
+      p_old = p_e->p_data;
+      atomic_set_ptr(&p_e->p_data, p_entry_data);
+    }
+  unlock_bucket(p_ht, l_hash);
 
   return p_old;
 }
@@ -552,6 +2226,21 @@ void *ght_replace(ght_hash_table_t *p_ht,
    returned (and NOT free'd). */
 void *ght_remove(ght_hash_table_t *p_ht,
 		 unsigned int i_key_size, const void *p_key_data)
+{
+  ght_hash_key_t key;
+
+  assert(p_ht);
+
+  hk_fill(&key, i_key_size, p_key_data);
+
+  return ght_remove_hashed(p_ht, i_key_size, p_key_data,
+			   get_hash_value(p_ht, &key));
+}
+
+/* Remove an entry with a hash value from ght_hash_key() */
+void *ght_remove_hashed(ght_hash_table_t *p_ht,
+			unsigned int i_key_size, const void *p_key_data,
+			ght_uint32_t l_hash)
 {
   ght_hash_entry_t *p_out;
   ght_hash_key_t key;
@@ -561,41 +2250,188 @@ void *ght_remove(ght_hash_table_t *p_ht,
   assert(p_ht);
 
   hk_fill(&key, i_key_size, p_key_data);
-  l_key = get_hash_value(p_ht, &key) & p_ht->i_size_mask;
+  if (p_ht->p_engine)
+    {
+      p_ret = p_ht->p_engine->fn_remove(p_ht, &key, l_hash);
+    }
+  else
+    {
+      lock_bucket(p_ht, l_hash);
+      l_key = get_bucket(p_ht, l_hash);
 
-  /* Check that the first element really is the first */
-  assert( (p_ht->pp_entries[l_key]?p_ht->pp_entries[l_key]->p_prev == NULL:1) );
+      /* Check that the first element really is the first */
+      assert( (p_ht->pp_entries[l_key]?p_ht->pp_entries[l_key]->p_prev == NULL:1) );
 
-  /* LOCK: p_ht->pp_entries[l_key] */
-  p_out = search_in_bucket(p_ht, l_key, &key, 0);
+      if ( (p_out = search_in_bucket(p_ht, l_key, &key, l_hash, 0)) )
+	{
+	  p_ret = remove_entry(p_ht, l_key, p_out);
+	}
+      unlock_bucket(p_ht, l_hash);
+    }
+  if (p_ret)
+    {
+      entries_moved(p_ht);
+    }
+
+  return p_ret;
+}
 
-  /* Link p_out out of the list. */
-  if (p_out)
+/* Find an entry and fill in a handle for it */
+void *ght_find(ght_hash_table_t *p_ht,
+	       unsigned int i_key_size, const void *p_key_data,
+	       ght_handle_t *p_handle)
+{
+  ght_hash_entry_t *p_e;
+  ght_hash_key_t key;
+  ght_uint32_t l_hash;
+
+  assert(p_ht && p_handle);
+
+  hk_fill(&key, i_key_size, p_key_data);
+  l_hash = get_hash_value(p_ht, &key);
+
+  if (p_ht->p_engine)
+    {
+      if (p_ht->p_engine->fn_find(p_ht, &key, l_hash, p_handle) < 0)
+	{
+	  return NULL;
+	}
+    }
+  else
     {
-      remove_from_chain(p_ht, l_key, p_out);
+      lock_bucket(p_ht, l_hash);
+      p_e = search_in_bucket(p_ht, get_bucket(p_ht, l_hash), &key, l_hash, 0);
+      unlock_bucket(p_ht, l_hash);
+      if (!p_e)
+	{
+	  return NULL;
+	}
+      handle_fill(p_handle, &p_e->p_data, p_e->key.p_key, p_e->key.i_size);
+      p_handle->p_pos = p_e;
+    }
+  p_handle->i_generation = p_ht->i_generation;
+
+  return *p_handle->pp_data;
+}
 
-      /* This should ONLY be done for normal items (for now all items) */
-      p_ht->i_items--;
+/* Get the data of the entry of a handle */
+void *ght_handle_data(ght_hash_table_t *p_ht, ght_handle_t *p_handle)
+{
+  (void)p_ht; /* Only checked by the assertion */
+  assert(p_handle->i_generation == p_ht->i_generation);
 
-      p_ht->p_nr[l_key]--;
-      /* UNLOCK: p_ht->pp_entries[l_key] */
-#if !defined(NDEBUG)
-      p_out->p_next = NULL;
-      p_out->p_prev = NULL;
-#endif /* NDEBUG */
+  return *p_handle->pp_data;
+}
+
+/* Get the key of the entry of a handle */
+const void *ght_handle_key(ght_hash_table_t *p_ht, ght_handle_t *p_handle,
+			   unsigned int *p_key_size)
+{
+  (void)p_ht; /* Only checked by the assertion */
+  assert(p_handle->i_generation == p_ht->i_generation);
 
-      p_ret = p_out->p_data;
-      he_finalize(p_ht, p_out);
+  if (p_key_size)
+    {
+      *p_key_size = p_handle->i_key_size;
+    }
+
+  return p_handle->p_key;
+}
+
+/* Replace the data of the entry of a handle, the old data is returned */
+void *ght_handle_replace(ght_hash_table_t *p_ht, ght_handle_t *p_handle,
+			 void *p_entry_data)
+{
+  void *p_old;
+
+  (void)p_ht; /* Only checked by the assertion */
+  assert(p_handle->i_generation == p_ht->i_generation);
+
+  p_old = *p_handle->pp_data;
+  *p_handle->pp_data = p_entry_data;
+
+  return p_old;
+}
+
+/* Remove the entry of a handle. The chained buckets find the bucket of
+ * the entry from its cached hash value, and unlink it with its
+ * p_prev/p_next links. */
+void *ght_handle_remove(ght_hash_table_t *p_ht, ght_handle_t *p_handle)
+{
+  ght_hash_entry_t *p_e;
+  ght_uint32_t l_hash;
+  void *p_ret;
+
+  assert(p_handle->i_generation == p_ht->i_generation);
+
+  if (p_ht->p_engine)
+    {
+      p_ret = p_ht->p_engine->fn_remove_handle(p_ht, p_handle);
+    }
+  else
+    {
+      p_e = (ght_hash_entry_t*)p_handle->p_pos;
+      l_hash = p_e->i_hash;
+      lock_bucket(p_ht, l_hash);
+      p_ret = remove_entry(p_ht, get_bucket(p_ht, l_hash), p_e);
+      unlock_bucket(p_ht, l_hash);
     }
-  /* else: UNLOCK: p_ht->pp_entries[l_key] */
+  entries_moved(p_ht);
 
   return p_ret;
 }
 
+/* Go to the next entry of a concurrent table, which has no insertion
+ * order list. p_next of the iterator is the next entry in the chain,
+ * and i_pos the next bucket. */
+static void *next_in_buckets(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator, const void **pp_key, unsigned int *size)
+{
+  ght_hash_entry_t *p_e = p_iterator->p_next;
+
+  while (!p_e && p_iterator->i_pos < p_ht->i_size)
+    {
+      p_e = p_ht->pp_entries[p_iterator->i_pos++];
+    }
+  p_iterator->p_entry = p_e;
+
+  if (p_e)
+    {
+      p_iterator->p_next = p_e->p_next;
+      *pp_key = p_e->key.p_key;
+      if (size != NULL)
+        *size = p_e->key.i_size;
+
+      return p_e->p_data;
+    }
+
+  p_iterator->p_next = NULL;
+  *pp_key = NULL;
+  if (size != NULL)
+    *size = 0;
+
+  return NULL;
+}
+
 static inline void *first_keysize(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator, const void **pp_key, unsigned int *size)
 {
   assert(p_ht && p_iterator);
 
+  if (p_ht->p_engine && p_ht->p_engine->fn_first)
+    {
+      return p_ht->p_engine->fn_first(p_ht, p_iterator, pp_key, size);
+    }
+  if (p_ht->p_stripes)
+    {
+      /* Move all entries to the current buckets first */
+      lock_stripes(p_ht);
+      finish_stripes(p_ht);
+      unlock_stripes(p_ht);
+
+      p_iterator->p_next = NULL;
+      p_iterator->i_pos = 0;
+      return next_in_buckets(p_ht, p_iterator, pp_key, size);
+    }
+
   /* Fill the iterator */
   p_iterator->p_entry = p_ht->p_oldest;
 
@@ -635,6 +2471,15 @@ static inline void *next_keysize(ght_hash_table_t *p_ht, ght_iterator_t *p_itera
 {
   assert(p_ht && p_iterator);
 
+  if (p_ht->p_engine && p_ht->p_engine->fn_next)
+    {
+      return p_ht->p_engine->fn_next(p_ht, p_iterator, pp_key, size);
+    }
+  if (p_ht->p_stripes)
+    {
+      return next_in_buckets(p_ht, p_iterator, pp_key, size);
+    }
+
   if (p_iterator->p_next)
     {
       /* More entries */
@@ -660,6 +2505,100 @@ static inline void *next_keysize(ght_hash_table_t *p_ht, ght_iterator_t *p_itera
 }
 
 
+/* Remove the current entry of an iteration */
+void *ght_iterator_remove(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator)
+{
+  ght_hash_entry_t *p_e;
+  ght_uint32_t l_hash;
+  void *p_ret;
+
+  assert(p_ht && p_iterator);
+
+  if (p_ht->p_engine)
+    {
+      p_ret = p_ht->p_engine->fn_iterator_remove(p_ht, p_iterator);
+    }
+  else
+    {
+      /* p_next of the iterator is not affected */
+      p_e = p_iterator->p_entry;
+      assert(p_e);
+      l_hash = p_e->i_hash;
+      lock_bucket(p_ht, l_hash);
+      p_ret = remove_entry(p_ht, get_bucket(p_ht, l_hash), p_e);
+      unlock_bucket(p_ht, l_hash);
+    }
+  p_iterator->p_entry = NULL;
+  entries_moved(p_ht);
+
+  return p_ret;
+}
+
+/* ght_remove_if() for a concurrent table, one stripe at a time with
+ * only that stripe locked */
+static unsigned int remove_if_stripes(ght_hash_table_t *p_ht, ght_fn_remove_if_t fn_pred, void *p_ctx)
+{
+  unsigned int i_removed = 0;
+  unsigned int s, i;
+
+  for (s = 0; s < p_ht->i_stripes; s++)
+    {
+      rwlock_wrlock(&p_ht->p_stripes[s].lock);
+      while (stripe_migrating(p_ht, s))
+	{
+	  stripe_migrate(p_ht, s);
+	}
+      for (i = s; i < p_ht->i_size; i += p_ht->i_stripes)
+	{
+	  ght_hash_entry_t *p_e = p_ht->pp_entries[i];
+
+	  while (p_e)
+	    {
+	      ght_hash_entry_t *p_next = p_e->p_next;
+
+	      if (fn_pred(p_ctx, p_e->p_data, p_e->key.p_key, p_e->key.i_size))
+		{
+		  remove_entry(p_ht, i, p_e);
+		  i_removed++;
+		}
+	      p_e = p_next;
+	    }
+	}
+      rwlock_wrunlock(&p_ht->p_stripes[s].lock);
+    }
+
+  return i_removed;
+}
+
+/* Remove all entries fn_pred returns TRUE for, in one iteration */
+unsigned int ght_remove_if(ght_hash_table_t *p_ht, ght_fn_remove_if_t fn_pred, void *p_ctx)
+{
+  ght_iterator_t iterator;
+  unsigned int i_removed = 0;
+  unsigned int i_size;
+  const void *p_key;
+  void *p_e;
+
+  assert(p_ht && fn_pred);
+
+  if (p_ht->p_stripes)
+    {
+      return remove_if_stripes(p_ht, fn_pred, p_ctx);
+    }
+
+  for (p_e = first_keysize(p_ht, &iterator, &p_key, &i_size); p_e;
+       p_e = next_keysize(p_ht, &iterator, &p_key, &i_size))
+    {
+      if (fn_pred(p_ctx, p_e, p_key, i_size))
+	{
+	  ght_iterator_remove(p_ht, &iterator);
+	  i_removed++;
+	}
+    }
+
+  return i_removed;
+}
+
 /* Get the next entry in an iteration. You have to call ght_first
    once initially before you use this function */
 void *ght_next(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator, const void **pp_key)
@@ -681,10 +2620,15 @@ void ght_finalize(ght_hash_table_t *p_ht)
 
   assert(p_ht);
 
+  if (p_ht->p_engine)
+    {
+      p_ht->p_engine->fn_finalize(p_ht);
+    }
+
   if (p_ht->pp_entries)
     {
-      /* For each bucket, free all entries */
-      for (i=0; i<p_ht->i_size; i++)
+      /* For each bucket, free all entries (unless the pool frees them) */
+      for (i=0; i<p_ht->i_size && !entries_released_at_once(p_ht); i++)
 	{
 	  free_entry_chain(p_ht, p_ht->pp_entries[i]);
 	  p_ht->pp_entries[i] = NULL;
@@ -697,74 +2641,84 @@ void ght_finalize(ght_hash_table_t *p_ht)
       free (p_ht->p_nr);
       p_ht->p_nr = NULL;
     }
+  if (p_ht->pp_old_entries)
+    {
+      /* Free the entries which were not yet moved by an incremental rehash */
+      for (i=0; i<p_ht->i_old_size && !entries_released_at_once(p_ht); i++)
+	{
+	  free_entry_chain(p_ht, p_ht->pp_old_entries[i]);
+	}
+      free (p_ht->pp_old_entries);
+      free (p_ht->p_old_nr);
+    }
+  if (p_ht->p_stripes)
+    {
+      for (i=0; i<p_ht->i_stripes; i++)
+	{
+	  if (!entries_released_at_once(p_ht))
+	    {
+	      free_retired(p_ht, p_ht->p_stripes[i].p_retired);
+	      free_retired(p_ht, p_ht->p_stripes[i].p_waiting);
+	    }
+	  rwlock_destroy(&p_ht->p_stripes[i].lock);
+	}
+      free (p_ht->p_stripes);
+    }
+  free_retired_buckets(p_ht, TRUE);
+  if (p_ht->allocator.fn_release)
+    {
+      /* Release all entries at once */
+      p_ht->allocator.fn_release(p_ht->p_alloc_ctx);
+    }
 
   free (p_ht);
 }
 
-/* Rehash the hash table (i.e. change its size and reinsert all
- * items). This operation is slow and should not be used frequently.
+/* Rehash the hash table (i.e. change its size and move all items to
+ * the new buckets). The entries are relinked into the new bucket array,
+ * so the only allocation done is that of the new buckets.
  */
 void ght_rehash(ght_hash_table_t *p_ht, unsigned int i_size)
 {
-  ght_hash_table_t *p_tmp;
-  ght_iterator_t iterator;
-  const void *p_key;
-  void *p;
-  int i;
+  ght_rehash_parallel(p_ht, i_size, 1);
+}
 
+/* Rehash the hash table with several threads */
+void ght_rehash_parallel(ght_hash_table_t *p_ht, unsigned int i_size, unsigned int i_threads)
+{
   assert(p_ht);
 
-  /* Recreate the hash table with the new size */
-  p_tmp = ght_create(i_size);
-  assert(p_tmp);
-
-  /* Set the flags for the new hash table */
-  ght_set_hash(p_tmp, p_ht->fn_hash);
-  ght_set_alloc(p_tmp, p_ht->fn_alloc, p_ht->fn_free);
-  ght_set_heuristics(p_tmp, GHT_HEURISTICS_NONE);
-  ght_set_rehash(p_tmp, FALSE);
-
-  /* Walk through all elements in the table and insert them into the temporary one. */
-  for (p = ght_first(p_ht, &iterator, &p_key); p; p = ght_next(p_ht, &iterator, &p_key))
+  entries_moved(p_ht);
+  if (p_ht->p_engine)
     {
-      assert(iterator.p_entry);
-
-      /* Insert the entry into the new table */
-      if (ght_insert(p_tmp,
-		     iterator.p_entry->p_data,
-		     iterator.p_entry->key.i_size, iterator.p_entry->key.p_key) < 0)
-	{
-	  fprintf(stderr, "hash_table.c ERROR: Out of memory error or entry already in hash table\n"
-		  "when rehashing (internal error)\n");
-	}
+      p_ht->p_engine->fn_rehash(p_ht, i_size);
+      return;
     }
 
-  /* Remove the old table... */
-  for (i=0; i<p_ht->i_size; i++)
+  if (p_ht->p_stripes)
     {
-      if (p_ht->pp_entries[i])
+      lock_stripes(p_ht);
+      finish_stripes(p_ht);
+      if (i_size < p_ht->i_stripes)
 	{
-	  /* Delete the entries in the bucket */
-	  free_entry_chain (p_ht, p_ht->pp_entries[i]);
-	  p_ht->pp_entries[i] = NULL;
+	  i_size = p_ht->i_stripes;
 	}
     }
+  /* Finish an ongoing incremental rehash first */
+  else if (p_ht->pp_old_entries)
+    {
+      rehash_step(p_ht, p_ht->i_old_size);
+    }
 
-  free (p_ht->pp_entries);
-  free (p_ht->p_nr);
-
-  /* ... and replace it with the new */
-  p_ht->i_size = p_tmp->i_size;
-  p_ht->i_size_mask = p_tmp->i_size_mask;
-  p_ht->i_items = p_tmp->i_items;
-  p_ht->pp_entries = p_tmp->pp_entries;
-  p_ht->p_nr = p_tmp->p_nr;
-
-  p_ht->p_oldest = p_tmp->p_oldest;
-  p_ht->p_newest = p_tmp->p_newest;
+  /* Move every bucket to a new bucket array at once */
+  start_rehash(p_ht, i_size);
+  if (p_ht->pp_old_entries)
+    {
+      rehash_parallel(p_ht, i_threads);
+    }
 
-  /* Clean up */
-  p_tmp->pp_entries = NULL;
-  p_tmp->p_nr = NULL;
-  free (p_tmp);
+  if (p_ht->p_stripes)
+    {
+      unlock_stripes(p_ht);
+    }
 }